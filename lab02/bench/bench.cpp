@@ -0,0 +1,571 @@
+#include "BatchDecoder.h"
+#include "Cpu.h"
+#include "DecodeAhead.h"
+#include "Decoder.h"
+#include "Executor.h"
+#include "Memory.h"
+#include "MicroOps.h"
+#include "PredecodedText.h"
+#include "RegisterFile.h"
+#include "Scheduler.h"
+#include "SpmdEngine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <dirent.h>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// riscv_bench: throughput of the simulator hot paths.
+//
+//   riscv_bench [--reps N] [--scale X] [--json file] [--programs dir] [--filter substr]
+//
+// Every benchmark runs N repetitions and reports ns per operation (mean,
+// stddev, min) with the matching MIPS and operations per ns. Component
+// benchmarks use a synthetic RV32I instruction mix, full-pipeline
+// benchmarks run the prebuilt ELF tests from programs/build/assembly/bin
+// in a loop.
+
+namespace
+{
+    // Rough dynamic mix of compiled integer code
+    const std::vector<Word> instructionMix = {
+        0xff010113, // addi sp, sp, -16
+        0x00150513, // addi a0, a0, 1
+        0x00b50533, // add a0, a0, a1
+        0x40c585b3, // sub a1, a1, a2
+        0x00259593, // slli a1, a1, 2
+        0x00d67633, // and a2, a2, a3
+        0x00012503, // lw a0, 0(sp)
+        0x00a12223, // sw a0, 4(sp)
+        0x00b50463, // beq a0, a1, 8
+        0xfe0518e3, // bne a0, zero, -16
+        0x020000ef, // jal ra, 32
+        0x00008067, // ret
+        0x12345537, // lui a0, 0x12345
+        0x00000297, // auipc t0, 0
+        0x00000013, // nop
+        0x00f76713, // ori a4, a4, 15
+    };
+
+    volatile Word sink;
+
+    struct Result
+    {
+        std::string name;
+        uint64_t opsPerRep = 0;
+        std::vector<double> nsPerOp;
+
+        double Mean() const
+        {
+            double sum = 0;
+            for (double ns : nsPerOp)
+                sum += ns;
+            return nsPerOp.empty() ? 0 : sum / nsPerOp.size();
+        }
+
+        double StdDev() const
+        {
+            if (nsPerOp.size() < 2)
+                return 0;
+            double mean = Mean();
+            double sum = 0;
+            for (double ns : nsPerOp)
+                sum += (ns - mean) * (ns - mean);
+            return std::sqrt(sum / (nsPerOp.size() - 1));
+        }
+
+        double Min() const
+        {
+            return nsPerOp.empty() ? 0 : *std::min_element(nsPerOp.begin(), nsPerOp.end());
+        }
+
+        double Mips() const
+        {
+            double mean = Mean();
+            return mean > 0 ? 1e3 / mean : 0;
+        }
+
+        double OpsPerNs() const
+        {
+            double mean = Mean();
+            return mean > 0 ? 1 / mean : 0;
+        }
+    };
+
+    struct Settings
+    {
+        unsigned reps = 10;
+        double scale = 1.0;
+        std::string jsonFile;
+        std::string programsDir = "programs/build/assembly/bin";
+        std::string filter;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    // body() runs one repetition and returns the number of operations it did;
+    // it is responsible for timing only the interesting part via `elapsed`.
+    Result Measure(const std::string& name, unsigned reps,
+                   const std::function<uint64_t(double& elapsed)>& body)
+    {
+        Result result;
+        result.name = name;
+        double warmup = 0;
+        body(warmup);
+        for (unsigned rep = 0; rep < reps; rep++)
+        {
+            double elapsed = 0;
+            uint64_t ops = body(elapsed);
+            result.opsPerRep = ops;
+            result.nsPerOp.push_back(ops ? elapsed * 1e9 / ops : 0);
+        }
+        return result;
+    }
+
+    template<typename Func>
+    double Time(Func func)
+    {
+        auto start = Clock::now();
+        func();
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    std::vector<InstructionPtr> DecodeMix(Decoder& decoder)
+    {
+        std::vector<InstructionPtr> instrs;
+        for (Word word : instructionMix)
+        {
+            auto instr = decoder.Decode(word);
+            instr->_src1Val = 0x100;
+            instr->_src2Val = 0x3;
+            instrs.push_back(std::move(instr));
+        }
+        return instrs;
+    }
+
+    Result BenchDecode(const Settings& settings)
+    {
+        Decoder decoder;
+        uint64_t rounds = static_cast<uint64_t>(20000 * settings.scale) + 1;
+        return Measure("decode/mix", settings.reps, [&](double& elapsed) {
+            Word acc = 0;
+            elapsed = Time([&]() {
+                for (uint64_t r = 0; r < rounds; r++)
+                    for (Word word : instructionMix)
+                        acc += static_cast<Word>(decoder.Decode(word)->_type);
+            });
+            sink = acc;
+            return rounds * instructionMix.size();
+        });
+    }
+
+    // Decoding into an existing Instruction, without the allocation
+    Result BenchDecodeInPlace(const Settings& settings)
+    {
+        Instruction instr;
+        uint64_t rounds = static_cast<uint64_t>(20000 * settings.scale) + 1;
+        return Measure("decode/mix_in_place", settings.reps, [&](double& elapsed) {
+            Word acc = 0;
+            elapsed = Time([&]() {
+                for (uint64_t r = 0; r < rounds; r++)
+                {
+                    for (Word word : instructionMix)
+                    {
+                        Decoder::Decode(word, instr);
+                        acc += static_cast<Word>(instr._type) + instr._imm.value_or(0);
+                    }
+                }
+            });
+            sink = acc;
+            return rounds * instructionMix.size();
+        });
+    }
+
+    // Predecoding a 4 MiB text segment into DecodedWords
+    Result BenchBatchDecode(const Settings& settings, BatchDecoder::Isa isa)
+    {
+        std::vector<Word> text(static_cast<size_t>((1u << 20u) * settings.scale) + 1);
+        for (size_t i = 0; i < text.size(); i++)
+            text[i] = instructionMix[(i * 7) % instructionMix.size()];
+        DecodedWords decoded;
+        return Measure(std::string("decode/batch_") + BatchDecoder::Name(isa), settings.reps, [&](double& elapsed) {
+            elapsed = Time([&]() { BatchDecoder::Decode(text.data(), text.size(), decoded, isa); });
+            sink = decoded.imm[text.size() / 2];
+            return text.size();
+        });
+    }
+
+    Result BenchExecute(const Settings& settings)
+    {
+        Decoder decoder;
+        Executor exe;
+        auto instrs = DecodeMix(decoder);
+        uint64_t rounds = static_cast<uint64_t>(50000 * settings.scale) + 1;
+        return Measure("execute/mix", settings.reps, [&](double& elapsed) {
+            Word acc = 0;
+            elapsed = Time([&]() {
+                for (uint64_t r = 0; r < rounds; r++)
+                {
+                    Word ip = 0x200;
+                    for (auto& instr : instrs)
+                    {
+                        exe.Execute(instr, ip);
+                        acc += instr->_data + instr->_nextIp;
+                        ip += 4;
+                    }
+                }
+            });
+            sink = acc;
+            return rounds * instrs.size();
+        });
+    }
+
+    Result BenchRegisterFile(const Settings& settings)
+    {
+        Decoder decoder;
+        RegisterFile rf;
+        auto instrs = DecodeMix(decoder);
+        uint64_t rounds = static_cast<uint64_t>(100000 * settings.scale) + 1;
+        return Measure("regfile/read_write", settings.reps, [&](double& elapsed) {
+            Word acc = 0;
+            elapsed = Time([&]() {
+                for (uint64_t r = 0; r < rounds; r++)
+                {
+                    for (auto& instr : instrs)
+                    {
+                        rf.Read(instr);
+                        instr->_data = instr->_src1Val + 1;
+                        rf.Write(instr);
+                        acc += instr->_src2Val;
+                    }
+                }
+            });
+            sink = acc;
+            return rounds * instrs.size();
+        });
+    }
+
+    Result BenchMemoryFetch(const Settings& settings, Memory& mem)
+    {
+        uint64_t count = static_cast<uint64_t>(2000000 * settings.scale) + 1;
+        return Measure("memory/fetch", settings.reps, [&](double& elapsed) {
+            Word acc = 0;
+            elapsed = Time([&]() {
+                Word ip = 0x200;
+                for (uint64_t i = 0; i < count; i++)
+                {
+                    acc += mem.Request(ip);
+                    ip = (ip + 4) & 0xffffu;
+                }
+            });
+            sink = acc;
+            return count;
+        });
+    }
+
+    Result BenchMemoryLoadStore(const Settings& settings, Memory& mem)
+    {
+        Decoder decoder;
+        auto load = decoder.Decode(0x00012503);  // lw a0, 0(sp)
+        auto store = decoder.Decode(0x00a12223); // sw a0, 4(sp)
+        uint64_t count = static_cast<uint64_t>(1000000 * settings.scale) + 1;
+        return Measure("memory/load_store", settings.reps, [&](double& elapsed) {
+            Word acc = 0;
+            elapsed = Time([&]() {
+                for (uint64_t i = 0; i < count; i++)
+                {
+                    Word addr = 0x4000 + ((i * 64) & 0xfffcu);
+                    load->_addr = addr;
+                    mem.Request(load);
+                    store->_addr = addr + 4;
+                    store->_data = load->_data + 1;
+                    mem.Request(store);
+                    acc += load->_data;
+                }
+            });
+            sink = acc;
+            return count * 2;
+        });
+    }
+
+    // Runs the program to its exit message, returns retired instructions
+    template <typename CpuType>
+    uint64_t RunProgram(Memory& mem, double& elapsed)
+    {
+        constexpr uint64_t limit = 100000000;
+        CpuType cpu{mem};
+        cpu.Reset(0x200);
+        uint64_t instructions = 0;
+        elapsed += Time([&]() {
+            while (instructions < limit)
+            {
+                cpu.ProcessInstruction();
+                instructions++;
+                auto msg = cpu.GetMessage();
+                if (msg && msg->unpacked.type == CpuToHostType::ExitCode)
+                    break;
+            }
+        });
+        return instructions;
+    }
+
+    // RunProgram with the text segments predecoded and instruction pairs
+    // fused; the Build() is not timed
+    template <typename CpuType>
+    uint64_t RunFusedProgram(Memory& mem, double& elapsed)
+    {
+        constexpr uint64_t limit = 100000000;
+        PredecodedText predecoded;
+        predecoded.EnableFusion(true);
+        predecoded.Build(mem);
+        CpuType cpu{mem};
+        cpu.SetPredecoded(&predecoded);
+        cpu.Reset(0x200);
+        elapsed += Time([&]() {
+            while (cpu.InstructionsRetired() < limit)
+            {
+                cpu.ProcessInstruction(2);
+                auto msg = cpu.GetMessage();
+                if (msg && msg->unpacked.type == CpuToHostType::ExitCode)
+                    break;
+            }
+        });
+        return cpu.InstructionsRetired();
+    }
+
+    // RunProgram with the decode on a helper thread
+    template <typename CpuType>
+    uint64_t RunDecodeAheadProgram(Memory& mem, double& elapsed)
+    {
+        constexpr uint64_t limit = 100000000;
+        DecodeAhead ahead{mem};
+        ahead.Start();
+        CpuType cpu{mem};
+        cpu.SetDecodeAhead(&ahead);
+        cpu.Reset(0x200);
+        elapsed += Time([&]() {
+            while (cpu.InstructionsRetired() < limit)
+            {
+                cpu.ProcessInstruction();
+                auto msg = cpu.GetMessage();
+                if (msg && msg->unpacked.type == CpuToHostType::ExitCode)
+                    break;
+            }
+        });
+        return cpu.InstructionsRetired();
+    }
+
+    // RunProgram on compiled micro-op blocks. The blocks are kept from run
+    // to run like a code cache; those of the previous program are found
+    // stale and compiled again, which is timed.
+    template <typename CpuType>
+    uint64_t RunUopProgram(Memory& mem, double& elapsed)
+    {
+        constexpr uint64_t limit = 100000000;
+        static UopEngine uops;
+        CpuType cpu{mem};
+        cpu.SetUopEngine(&uops);
+        cpu.Reset(0x200);
+        elapsed += Time([&]() {
+            while (cpu.InstructionsRetired() < limit)
+            {
+                cpu.ProcessInstruction(limit - cpu.InstructionsRetired());
+                auto msg = cpu.GetMessage();
+                if (msg && msg->unpacked.type == CpuToHostType::ExitCode)
+                    break;
+            }
+        });
+        return cpu.InstructionsRetired();
+    }
+
+    // The program in every SpmdEngine lane, returns instructions over all
+    // lanes; copying the lane memories is not timed
+    uint64_t RunSpmdProgram(Memory& mem, double& elapsed)
+    {
+        constexpr uint64_t limit = 100000000;
+        SpmdEngine spmd(mem, 0x200);
+        elapsed += Time([&]() { spmd.Run(limit); });
+        return spmd.laneSteps;
+    }
+
+    // 16 copies of the program multiplexed on this thread, returns their
+    // instructions; creating the tasks is not timed
+    uint64_t RunScheduledProgram(Memory& mem, double& elapsed)
+    {
+        Scheduler scheduler(1000);
+        for (int i = 0; i < 16; i++)
+            scheduler.Spawn(std::make_unique<SimTask>(mem, 0x200));
+        elapsed += Time([&]() { scheduler.Run(); });
+        uint64_t instructions = 0;
+        for (size_t id = 0; id < scheduler.Tasks(); id++)
+            instructions += scheduler.Task(id).GetCpu().InstructionsRetired();
+        return instructions;
+    }
+
+    std::vector<std::string> ListPrograms(const std::string& dir)
+    {
+        std::vector<std::string> programs;
+        DIR* d = opendir(dir.c_str());
+        if (!d)
+            return programs;
+        while (dirent* entry = readdir(d))
+        {
+            std::string name = entry->d_name;
+            if (name.size() > 6 && name.compare(name.size() - 6, 6, ".riscv") == 0)
+                programs.push_back(name);
+        }
+        closedir(d);
+        std::sort(programs.begin(), programs.end());
+        return programs;
+    }
+
+    std::vector<Result> BenchPrograms(const Settings& settings)
+    {
+        std::vector<Result> results;
+        auto programs = ListPrograms(settings.programsDir);
+        if (programs.empty())
+        {
+            std::cerr << "note: no ELF programs in \"" << settings.programsDir
+                      << "\", skipping Cpu::ProcessInstruction benchmarks" << std::endl;
+            return results;
+        }
+
+        std::vector<Memory> images(programs.size());
+        for (size_t i = 0; i < programs.size(); i++)
+            images[i].LoadElf(settings.programsDir + "/" + programs[i]);
+
+        // Each program is only a few hundred instructions, so repeat it
+        unsigned runs = static_cast<unsigned>(200 * settings.scale) + 1;
+        Memory mem;
+        auto bench = [&](const std::string& prefix, auto run) {
+            for (size_t i = 0; i < programs.size(); i++)
+            {
+                std::string name = prefix + programs[i].substr(0, programs[i].size() - 6);
+                if (!settings.filter.empty() && name.find(settings.filter) == std::string::npos)
+                    continue;
+                results.push_back(Measure(name, settings.reps, [&](double& elapsed) {
+                    uint64_t instructions = 0;
+                    for (unsigned r = 0; r < runs; r++)
+                    {
+                        mem = images[i];
+                        instructions += run(mem, elapsed);
+                    }
+                    return instructions;
+                }));
+            }
+        };
+        bench("cpu/", RunProgram<Cpu>);
+        // Same programs with listeners, HPM events and coverage compiled out
+        bench("cpu-functional/", RunProgram<BasicCpu<FunctionalCpuConfig>>);
+        bench("cpu-fused/", RunFusedProgram<BasicCpu<FunctionalCpuConfig>>);
+        bench("cpu-uops/", RunUopProgram<BasicCpu<FunctionalCpuConfig>>);
+        bench("cpu-decode-ahead/", RunDecodeAheadProgram<BasicCpu<FunctionalCpuConfig>>);
+        bench("spmd/", RunSpmdProgram);
+        bench("sched/", RunScheduledProgram);
+        return results;
+    }
+
+    void Print(const Result& result)
+    {
+        std::cout << std::left << std::setw(32) << result.name << std::right
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(10) << result.Mean() << " ns/op"
+                  << "  +-" << std::setw(7) << result.StdDev()
+                  << "  min " << std::setw(8) << result.Min()
+                  << std::setw(10) << result.Mips() << " MIPS"
+                  << std::setprecision(3) << std::setw(8) << result.OpsPerNs() << " op/ns"
+                  << "  (" << result.opsPerRep << " ops x " << result.nsPerOp.size() << ")" << std::endl;
+    }
+
+    void WriteJson(const std::string& filename, const std::vector<Result>& results, const Settings& settings)
+    {
+        std::ofstream out(filename);
+        if (!out.is_open())
+        {
+            std::cerr << "ERROR: failed opening file \"" << filename << "\"" << std::endl;
+            return;
+        }
+        out << std::setprecision(6) << std::fixed;
+        out << "{\n  \"timestamp\": " << std::time(nullptr) << ",\n  \"reps\": " << settings.reps
+            << ",\n  \"scale\": " << settings.scale << ",\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const Result& r = results[i];
+            out << "    {\"name\": \"" << r.name << "\", \"ops_per_rep\": " << r.opsPerRep
+                << ", \"ns_per_op_mean\": " << r.Mean() << ", \"ns_per_op_stddev\": " << r.StdDev()
+                << ", \"ns_per_op_min\": " << r.Min() << ", \"mips\": " << r.Mips()
+                << ", \"ops_per_ns\": " << r.OpsPerNs()
+                << ", \"samples\": [";
+            for (size_t j = 0; j < r.nsPerOp.size(); j++)
+                out << (j ? ", " : "") << r.nsPerOp[j];
+            out << "]}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "usage: riscv_bench [--reps N] [--scale X] [--json file] [--programs dir] [--filter substr]"
+                      << std::endl;
+            return 1;
+        }
+        if (arg == "--reps")
+            settings.reps = std::max(1ul, std::stoul(argv[++i]));
+        else if (arg == "--scale")
+            settings.scale = std::stod(argv[++i]);
+        else if (arg == "--json")
+            settings.jsonFile = argv[++i];
+        else if (arg == "--programs")
+            settings.programsDir = argv[++i];
+        else if (arg == "--filter")
+            settings.filter = argv[++i];
+        else
+        {
+            std::cerr << "ERROR: unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    auto run = [&](const std::string& name, const std::function<Result()>& bench) {
+        if (!settings.filter.empty() && name.find(settings.filter) == std::string::npos)
+            return;
+        results.push_back(bench());
+        Print(results.back());
+    };
+
+    Memory mem;
+    run("decode/mix", [&]() { return BenchDecode(settings); });
+    run("decode/mix_in_place", [&]() { return BenchDecodeInPlace(settings); });
+    for (auto isa : {BatchDecoder::Isa::Scalar, BatchDecoder::Isa::Sse41, BatchDecoder::Isa::Avx2})
+        if (BatchDecoder::Supported(isa))
+            run(std::string("decode/batch_") + BatchDecoder::Name(isa), [&]() { return BenchBatchDecode(settings, isa); });
+    run("execute/mix", [&]() { return BenchExecute(settings); });
+    run("regfile/read_write", [&]() { return BenchRegisterFile(settings); });
+    run("memory/fetch", [&]() { return BenchMemoryFetch(settings, mem); });
+    run("memory/load_store", [&]() { return BenchMemoryLoadStore(settings, mem); });
+
+    for (auto& result : BenchPrograms(settings))
+    {
+        results.push_back(result);
+        Print(result);
+    }
+
+    if (!settings.jsonFile.empty())
+        WriteJson(settings.jsonFile, results, settings);
+    return 0;
+}
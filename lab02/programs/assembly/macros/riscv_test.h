@@ -43,6 +43,38 @@ _start:
         or tmp_reg_2, tmp_reg_1, tmp_reg_2;                             \
         csrw mtohost, tmp_reg_2                                         \
 
+//-----------------------------------------------------------------------
+// Region-of-interest Macros
+// The simulator collects statistics (and runs its detailed models when
+// started with --roi) only between ROI_BEGIN and ROI_END. PHASE starts a
+// new phase reported as "phase<id>".
+//-----------------------------------------------------------------------
+
+#define ROI_BEGIN(tmp_reg)                                              \
+        la tmp_reg, 0x00040000;                                         \
+        csrw mtohost, tmp_reg
+
+#define ROI_END(tmp_reg)                                                \
+        la tmp_reg, 0x00050000;                                         \
+        csrw mtohost, tmp_reg
+
+#define PHASE(id, tmp_reg)                                              \
+        la tmp_reg, (0x00060000 | (id));                                \
+        csrw mtohost, tmp_reg
+
+//-----------------------------------------------------------------------
+// Fuzzing Macro
+// Asks the host for the next input: buf receives up to len bytes and a1
+// is set to the input length. With --fuzz everything before this point
+// runs once; every input restarts from right after it.
+//-----------------------------------------------------------------------
+
+#define FUZZ_INPUT(buf, len, tmp_reg)                                   \
+        la a0, buf;                                                     \
+        li a1, len;                                                     \
+        la tmp_reg, 0x00080000;                                         \
+        csrw mtohost, tmp_reg
+
 //-----------------------------------------------------------------------
 // End Macro (return value in TESTNUM)
 // TESTNUM always < 65536 here, so no need to set ExitCode on MSB
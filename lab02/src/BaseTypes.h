@@ -12,7 +12,12 @@ enum class CpuToHostType : uint16_t
     ExitCode = 0,
     PrintChar = 1,
     PrintIntLow = 2,
-    PrintIntHigh = 3
+    PrintIntHigh = 3,
+    RoiBegin = 4,       // start of the region of interest
+    RoiEnd = 5,         // end of the region of interest
+    Phase = 6,          // data = phase id, starts a new phase
+    PhaseNameChar = 7,  // data = char, appended to the name of the next phase
+    FuzzInput = 8       // a0 = input buffer, a1 = its capacity; the host sets a1 to the input length
 };
 
 union CpuToHostData
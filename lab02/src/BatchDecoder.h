@@ -0,0 +1,222 @@
+#ifndef RISCV_SIM_BATCHDECODER_H
+#define RISCV_SIM_BATCHDECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define RISCV_SIM_BATCH_X86 1
+#endif
+
+#include "Decoder.h"
+
+// Decoder::Fields of a run of instruction words, one array per field
+struct DecodedWords
+{
+    std::vector<uint8_t> opcode;
+    std::vector<uint8_t> rd;
+    std::vector<uint8_t> funct3;
+    std::vector<uint8_t> rs1;
+    std::vector<uint8_t> rs2;
+    std::vector<uint8_t> funct7;
+    std::vector<Word> imm;
+
+    void Resize(size_t count)
+    {
+        opcode.resize(count);
+        rd.resize(count);
+        funct3.resize(count);
+        rs1.resize(count);
+        rs2.resize(count);
+        funct7.resize(count);
+        imm.resize(count);
+    }
+
+    size_t Size() const
+    {
+        return opcode.size();
+    }
+
+    Decoder::Fields Get(size_t i) const
+    {
+        return Decoder::Fields{opcode[i], rd[i], funct3[i], rs1[i], rs2[i], funct7[i], imm[i]};
+    }
+
+    void Set(size_t i, const Decoder::Fields& fields)
+    {
+        opcode[i] = fields.opcode;
+        rd[i] = fields.rd;
+        funct3[i] = fields.funct3;
+        rs1[i] = fields.rs1;
+        rs2[i] = fields.rs2;
+        funct7[i] = fields.funct7;
+        imm[i] = fields.imm;
+    }
+
+    // Same result as Decoder::Decode of the i-th word
+    void Expand(size_t i, Instruction& instr) const
+    {
+        Decoder::Expand(Get(i), instr);
+    }
+};
+
+// Field extraction for whole text segments, 8 words per AVX2 step or two
+// 4-word SSE4.1 steps. Immediates of all formats are computed and sign
+// extended in vector registers, then the one matching the opcode is
+// selected with compare masks. Words left over at the end, and hosts
+// without the instruction sets, go through Decoder::Extract.
+class BatchDecoder
+{
+public:
+    enum class Isa
+    {
+        Scalar,
+        Sse41,
+        Avx2,
+    };
+
+    // Widest implementation the host supports
+    static Isa Best()
+    {
+#ifdef RISCV_SIM_BATCH_X86
+        if (__builtin_cpu_supports("avx2"))
+            return Isa::Avx2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return Isa::Sse41;
+#endif
+        return Isa::Scalar;
+    }
+
+    static bool Supported(Isa isa)
+    {
+        return isa <= Best();
+    }
+
+    static const char* Name(Isa isa)
+    {
+        switch (isa)
+        {
+            case Isa::Avx2:
+                return "avx2";
+            case Isa::Sse41:
+                return "sse41";
+            default:
+                return "scalar";
+        }
+    }
+
+    // isa must be Supported()
+    static void Decode(const Word* words, size_t count, DecodedWords& out, Isa isa = Best())
+    {
+        out.Resize(count);
+        size_t done = 0;
+#ifdef RISCV_SIM_BATCH_X86
+        if (isa == Isa::Avx2)
+            done = DecodeAvx2(words, count, out);
+        else if (isa == Isa::Sse41)
+            done = DecodeSse41(words, count, out);
+#endif
+        for (size_t i = done; i < count; i++)
+            out.Set(i, Decoder::Extract(words[i]));
+    }
+
+private:
+#ifdef RISCV_SIM_BATCH_X86
+    typedef Word Words4 __attribute__((vector_size(16)));
+    typedef int32_t Ints4 __attribute__((vector_size(16)));
+    typedef Word Words8 __attribute__((vector_size(32)));
+    typedef int32_t Ints8 __attribute__((vector_size(32)));
+
+    typedef uint8_t Raw16 __attribute__((vector_size(16)));
+    typedef uint8_t Raw32 __attribute__((vector_size(32)));
+
+    // Low byte of every lane. A byte shuffle: GCC extracts lane by lane for
+    // __builtin_convertvector.
+    __attribute__((always_inline)) static void StoreBytes(uint8_t* dst, const Words4& lanes)
+    {
+        Raw16 raw = reinterpret_cast<Raw16>(lanes);
+#ifdef __clang__
+        auto picked = __builtin_shufflevector(raw, raw, 0, 4, 8, 12);
+#else
+        Raw16 picked = __builtin_shuffle(raw, Raw16{0, 4, 8, 12});
+#endif
+        __builtin_memcpy(dst, &picked, 4);
+    }
+
+    __attribute__((always_inline)) static void StoreBytes(uint8_t* dst, const Words8& lanes)
+    {
+        Raw32 raw = reinterpret_cast<Raw32>(lanes);
+#ifdef __clang__
+        auto picked = __builtin_shufflevector(raw, raw, 0, 4, 8, 12, 16, 20, 24, 28);
+#else
+        Raw32 picked = __builtin_shuffle(raw, Raw32{0, 4, 8, 12, 16, 20, 24, 28});
+#endif
+        __builtin_memcpy(dst, &picked, 8);
+    }
+
+    // Decodes one vector of words starting at i with GCC vector extensions.
+    // It is always inlined, so the instructions are those of the target of
+    // the calling function. Comparisons give all ones in matching lanes.
+    template <typename U, typename S>
+    __attribute__((always_inline)) static void DecodeStep(const Word* words, size_t i, DecodedWords& out)
+    {
+        U w;
+        __builtin_memcpy(&w, words + i, sizeof(w));
+        U opcode = w & 0x7fu;
+        U funct3 = (w >> 12u) & 7u;
+
+        U sign = reinterpret_cast<U>(reinterpret_cast<S>(w) >> 31);
+        U immI = reinterpret_cast<U>(reinterpret_cast<S>(w) >> 20);
+        U immS = (immI & ~31u) | ((w >> 7u) & 31u);
+        U immB = sign << 12u | ((w << 4u) & 0x800u) | ((w >> 20u) & 0x7e0u) | ((w >> 7u) & 0x1eu);
+        U immU = w & 0xfffff000u;
+        U immJ = sign << 20u | (w & 0xff000u) | ((w >> 9u) & 0x800u) | ((w >> 20u) & 0x7feu);
+
+        U opImm = reinterpret_cast<U>(opcode == static_cast<Word>(Opcode::OpImm));
+        U shamt = opImm & reinterpret_cast<U>(funct3 == static_cast<Word>(AluFunc::Sr));
+        U useI = ~shamt & (opImm
+                           | reinterpret_cast<U>(opcode == static_cast<Word>(Opcode::Load))
+                           | reinterpret_cast<U>(opcode == static_cast<Word>(Opcode::Jalr)));
+        U useU = reinterpret_cast<U>(opcode == static_cast<Word>(Opcode::Lui))
+                 | reinterpret_cast<U>(opcode == static_cast<Word>(Opcode::Auipc));
+
+        U imm = (useI & immI)
+                | (shamt & (w >> 20u) & 31u)
+                | (reinterpret_cast<U>(opcode == static_cast<Word>(Opcode::Store)) & immS)
+                | (reinterpret_cast<U>(opcode == static_cast<Word>(Opcode::Branch)) & immB)
+                | (useU & immU)
+                | (reinterpret_cast<U>(opcode == static_cast<Word>(Opcode::Jal)) & immJ)
+                | (reinterpret_cast<U>(opcode == static_cast<Word>(Opcode::System)) & (w >> 20u));
+        __builtin_memcpy(&out.imm[i], &imm, sizeof(imm));
+
+        StoreBytes(&out.opcode[i], opcode);
+        StoreBytes(&out.rd[i], (w >> 7u) & 31u);
+        StoreBytes(&out.funct3[i], funct3);
+        StoreBytes(&out.rs1[i], (w >> 15u) & 31u);
+        StoreBytes(&out.rs2[i], (w >> 20u) & 31u);
+        StoreBytes(&out.funct7[i], w >> 25u);
+    }
+
+    __attribute__((target("avx2"))) static size_t DecodeAvx2(const Word* words, size_t count, DecodedWords& out)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+            DecodeStep<Words8, Ints8>(words, i, out);
+        return i;
+    }
+
+    __attribute__((target("sse4.1"))) static size_t DecodeSse41(const Word* words, size_t count, DecodedWords& out)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            DecodeStep<Words4, Ints4>(words, i, out);
+            DecodeStep<Words4, Ints4>(words, i + 4, out);
+        }
+        return i;
+    }
+#endif
+};
+
+#endif //RISCV_SIM_BATCHDECODER_H
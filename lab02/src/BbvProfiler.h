@@ -0,0 +1,138 @@
+#ifndef RISCV_SIM_BBVPROFILER_H
+#define RISCV_SIM_BBVPROFILER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "Memory.h"
+#include "RetireListener.h"
+
+// Basic-block vectors: for every interval of `interval` retired
+// instructions, the number of instructions executed in each basic block.
+// A block ends at every Br, J and Jr, so blocks are dynamic entry points
+// rather than a static CFG. Block ids are dense, in first-seen order.
+class BbvProfiler : public RetireListener
+{
+public:
+    // Sparse vector of (block id, instructions) sorted by id
+    using Vector = std::vector<std::pair<uint32_t, uint64_t>>;
+
+    BbvProfiler(uint64_t interval)
+        : _interval(interval ? interval : 1),
+          _slotIds(Memory::WordCount(), 0)
+    {
+    }
+
+    void OnRetire(const Instruction& instr, Word ip, Word /*word*/) override
+    {
+        if (!_inBlock)
+        {
+            _blockStart = ip;
+            _inBlock = true;
+        }
+        _blockLength++;
+        if (instr._type == IType::Br || instr._type == IType::J || instr._type == IType::Jr)
+        {
+            FlushBlock();
+            _inBlock = false;
+        }
+        if (++_inInterval == _interval)
+            EndInterval();
+    }
+
+    // Flushes the last, partial interval
+    void Finish()
+    {
+        if (_inInterval)
+            EndInterval();
+    }
+
+    const std::vector<Vector>& Intervals() const
+    {
+        return _intervals;
+    }
+
+    // Instructions in each interval; only the last one may be short
+    const std::vector<uint64_t>& Lengths() const
+    {
+        return _lengths;
+    }
+
+    size_t BlockCount() const
+    {
+        return _blockIps.size();
+    }
+
+    Word BlockIp(uint32_t id) const
+    {
+        return _blockIps[id];
+    }
+
+    // SimPoint .bb format, one "T:id:count :id:count ..." line per
+    // interval with 1-based block ids
+    void WriteBbv(std::ostream& out) const
+    {
+        for (const auto& vector : _intervals)
+        {
+            out << 'T';
+            for (const auto& [id, count] : vector)
+                out << ':' << id + 1 << ':' << count << ' ';
+            out << '\n';
+        }
+    }
+
+private:
+    // Adds the instructions of the current block since the last flush
+    void FlushBlock()
+    {
+        uint32_t& slotId = _slotIds[Memory::Slot(_blockStart)];
+        if (slotId == 0)
+        {
+            _blockIps.push_back(_blockStart);
+            _counts.push_back(0);
+            slotId = static_cast<uint32_t>(_blockIps.size());
+        }
+        uint32_t id = slotId - 1;
+        if (_counts[id] == 0)
+            _touched.push_back(id);
+        _counts[id] += _blockLength;
+        _blockLength = 0;
+    }
+
+    // A block crossing the interval boundary is split between both
+    void EndInterval()
+    {
+        if (_blockLength)
+            FlushBlock();
+
+        Vector vector;
+        vector.reserve(_touched.size());
+        std::sort(_touched.begin(), _touched.end());
+        for (uint32_t id : _touched)
+        {
+            vector.emplace_back(id, _counts[id]);
+            _counts[id] = 0;
+        }
+        _touched.clear();
+        _intervals.push_back(std::move(vector));
+        _lengths.push_back(_inInterval);
+        _inInterval = 0;
+    }
+
+    uint64_t _interval;
+    uint64_t _inInterval = 0;
+    Word _blockStart = 0;
+    uint64_t _blockLength = 0;
+    bool _inBlock = false;
+    std::vector<uint32_t> _slotIds;     // Memory slot -> block id + 1
+    std::vector<Word> _blockIps;
+    std::vector<uint64_t> _counts;      // current interval, by block id
+    std::vector<uint32_t> _touched;
+    std::vector<Vector> _intervals;
+    std::vector<uint64_t> _lengths;
+};
+
+#endif //RISCV_SIM_BBVPROFILER_H
@@ -0,0 +1,129 @@
+#ifndef RISCV_SIM_BRANCHPREDICTOR_H
+#define RISCV_SIM_BRANCHPREDICTOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "TimingEvent.h"
+
+struct BranchPredictorConfig
+{
+    Word bhtEntries = 256;  // 2-bit saturating counters
+    Word btbEntries = 64;
+    Word rasDepth = 8;
+};
+
+class BranchPredictor
+{
+public:
+    BranchPredictor(const BranchPredictorConfig& config = BranchPredictorConfig())
+        : _config(config),
+          _bht(config.bhtEntries ? config.bhtEntries : 1, 1),
+          _btb(config.btbEntries ? config.btbEntries : 1)
+    {
+    }
+
+    // Predicts the next ip for a control instruction, then trains on the outcome.
+    // Returns true on mispredict.
+    bool Process(const TimingEvent& event)
+    {
+        Word predicted = Predict(event);
+        Update(event);
+
+        bool mispredicted = predicted != event.nextIp;
+        if (mispredicted)
+            mispredicts++;
+        predictions++;
+        return mispredicted;
+    }
+
+    // Trains on the outcome without predicting or counting, for warming
+    void Warm(const TimingEvent& event)
+    {
+        Update(event);
+    }
+
+    void Reset()
+    {
+        std::fill(_bht.begin(), _bht.end(), 1);
+        std::fill(_btb.begin(), _btb.end(), BtbEntry());
+        _ras.clear();
+        ResetStats();
+    }
+
+    void ResetStats()
+    {
+        predictions = 0;
+        mispredicts = 0;
+    }
+
+    const BranchPredictorConfig& GetConfig() const
+    {
+        return _config;
+    }
+
+    uint64_t predictions = 0;
+    uint64_t mispredicts = 0;
+
+private:
+    struct BtbEntry
+    {
+        Word ip = 0;
+        Word target = 0;
+        bool valid = false;
+    };
+
+    Word Index(Word ip, size_t size) const
+    {
+        return (ip >> 2u) % size;
+    }
+
+    Word Predict(const TimingEvent& event) const
+    {
+        Word fallThrough = event.ip + 4;
+
+        if (event.IsReturn() && !_ras.empty())
+            return _ras.back();
+
+        if (event.type == IType::Br && _bht[Index(event.ip, _bht.size())] < 2)
+            return fallThrough;
+
+        const BtbEntry& entry = _btb[Index(event.ip, _btb.size())];
+        if (entry.valid && entry.ip == event.ip)
+            return entry.target;
+
+        return fallThrough;
+    }
+
+    void Update(const TimingEvent& event)
+    {
+        if (event.type == IType::Br)
+        {
+            uint8_t& counter = _bht[Index(event.ip, _bht.size())];
+            if (event.IsTaken() && counter < 3)
+                counter++;
+            else if (!event.IsTaken() && counter > 0)
+                counter--;
+        }
+
+        if (event.IsTaken())
+            _btb[Index(event.ip, _btb.size())] = BtbEntry{event.ip, event.nextIp, true};
+
+        if (event.IsReturn() && !_ras.empty())
+            _ras.pop_back();
+        if (event.IsCall() && _config.rasDepth)
+        {
+            if (_ras.size() == _config.rasDepth)
+                _ras.erase(_ras.begin());
+            _ras.push_back(event.ip + 4);
+        }
+    }
+
+    BranchPredictorConfig _config;
+    std::vector<uint8_t> _bht;
+    std::vector<BtbEntry> _btb;
+    std::vector<Word> _ras;
+};
+
+#endif //RISCV_SIM_BRANCHPREDICTOR_H
@@ -0,0 +1,106 @@
+#ifndef RISCV_SIM_CACHE_H
+#define RISCV_SIM_CACHE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "BaseTypes.h"
+
+struct CacheConfig
+{
+    Word sizeBytes = 4096;
+    Word ways = 1;
+    Word lineBytes = 32;
+    Word missPenalty = 10;
+};
+
+// Timing-only model: tags and LRU state, no data
+class Cache
+{
+public:
+    Cache(const CacheConfig& config = CacheConfig())
+        : _config(config)
+    {
+        _sets = config.sizeBytes / (config.lineBytes * config.ways);
+        if (_sets == 0)
+            _sets = 1;
+        _lines.resize(_sets * config.ways);
+        for (_lineShift = 0; (1u << _lineShift) < config.lineBytes; _lineShift++);
+    }
+
+    // Returns true on hit, fills the line on miss
+    bool Access(Word addr)
+    {
+        bool hit = Touch(addr);
+        if (hit)
+            hits++;
+        else
+            misses++;
+        return hit;
+    }
+
+    // Access() that leaves the hit/miss counters alone, for warming
+    bool Touch(Word addr)
+    {
+        Word lineAddr = addr >> _lineShift;
+        Word set = lineAddr % _sets;
+        Line* begin = &_lines[set * _config.ways];
+        Line* victim = begin;
+
+        _tick++;
+        for (Line* line = begin; line != begin + _config.ways; line++)
+        {
+            if (line->valid && line->tag == lineAddr)
+            {
+                line->lastUse = _tick;
+                return true;
+            }
+            if (!line->valid || (victim->valid && line->lastUse < victim->lastUse))
+                victim = line;
+        }
+
+        victim->valid = true;
+        victim->tag = lineAddr;
+        victim->lastUse = _tick;
+        return false;
+    }
+
+    void Reset()
+    {
+        for (auto& line : _lines)
+            line = Line();
+        _tick = 0;
+        hits = 0;
+        misses = 0;
+    }
+
+    void ResetStats()
+    {
+        hits = 0;
+        misses = 0;
+    }
+
+    const CacheConfig& GetConfig() const
+    {
+        return _config;
+    }
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+private:
+    struct Line
+    {
+        Word tag = 0;
+        bool valid = false;
+        uint64_t lastUse = 0;
+    };
+
+    CacheConfig _config;
+    Word _sets;
+    unsigned _lineShift;
+    uint64_t _tick = 0;
+    std::vector<Line> _lines;
+};
+
+#endif //RISCV_SIM_CACHE_H
@@ -0,0 +1,225 @@
+#ifndef RISCV_SIM_CALLGRAPHPROFILER_H
+#define RISCV_SIM_CALLGRAPHPROFILER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "Memory.h"
+#include "RetireListener.h"
+#include "ShadowStack.h"
+#include "Symbols.h"
+#include "TimingModel.h"
+
+// Deterministic call-graph profile in the spirit of gprof: every retired
+// instruction is charged to the function on top of the shadow stack, and
+// every call/return updates caller->callee edges with inclusive costs.
+// Cycles are collected when a timing model is given; it has to be
+// registered with the Cpu before this profiler so its counters already
+// include the instruction being retired.
+class CallGraphProfiler : public RetireListener
+{
+public:
+    CallGraphProfiler(const SymbolTable& symbols, Word entry, const TimingModel* timing = nullptr)
+        : _symbols(symbols),
+          _timing(timing),
+          _selfInstr(Memory::WordCount(), 0),
+          _selfCycles(timing ? Memory::WordCount() : 0, 0),
+          _owner(Memory::WordCount(), noOwner)
+    {
+        _stack.Reset(entry);
+        _functions[entry].activations = 1;
+    }
+
+    void OnRetire(const Instruction& instr, Word ip, Word /*word*/) override
+    {
+        size_t slot = Memory::Slot(ip);
+        if (_owner[slot] == noOwner)
+            _owner[slot] = _stack.Frames().back().function;
+
+        _instructions++;
+        _selfInstr[slot]++;
+        if (_timing)
+        {
+            // The model counters may have been reset since the last instruction
+            uint64_t cycles = _timing->cycles >= _lastModelCycles ? _timing->cycles - _lastModelCycles : _timing->cycles;
+            _lastModelCycles = _timing->cycles;
+            _selfCycles[slot] += cycles;
+            _cycles += cycles;
+        }
+
+        Word caller = _stack.Frames().back().function;
+        switch (_stack.Update(instr, ip))
+        {
+            case ShadowStack::Event::Call:
+            {
+                Word callee = _stack.Frames().back().function;
+                Edge& edge = _edges[EdgeKey{caller, ip, callee}];
+                edge.calls++;
+                bool outermost = _functions[callee].activations++ == 0;
+                _active.push_back(Activation{&edge, callee, _instructions, _cycles, outermost});
+                break;
+            }
+            case ShadowStack::Event::Return:
+                for (size_t i = 0; i < _stack.Popped() && !_active.empty(); i++)
+                    Leave();
+                break;
+            case ShadowStack::Event::None:
+                break;
+        }
+    }
+
+    // Closes the frames still open when the program stopped
+    void Finish()
+    {
+        while (!_active.empty())
+            Leave();
+
+        Function& root = _functions[_stack.Frames().front().function];
+        root.inclInstr = _instructions;
+        root.inclCycles = _cycles;
+    }
+
+    void WriteCallgrind(std::ostream& out, const std::string& program)
+    {
+        Finish();
+
+        out << "# callgrind format\n"
+            << "version: 1\n"
+            << "creator: riscv_sim\n"
+            << "cmd: " << program << "\n"
+            << "positions: instr\n"
+            << "events: Ir" << (_timing ? " Cycles" : "") << "\n"
+            << "summary: " << _instructions;
+        if (_timing)
+            out << ' ' << _cycles;
+        out << "\n\nob=" << program << "\n";
+
+        std::map<Word, std::vector<size_t>> slotsByFunction;
+        for (size_t slot = 0; slot < _owner.size(); slot++)
+            if (_owner[slot] != noOwner)
+                slotsByFunction[_owner[slot]].push_back(slot);
+        for (const auto& entry : _edges)
+            slotsByFunction[std::get<0>(entry.first)];
+
+        auto edge = _edges.begin();
+        for (const auto& [function, slots] : slotsByFunction)
+        {
+            out << "\nfn=" << _symbols.Name(function) << "\n";
+            for (size_t slot : slots)
+            {
+                out << "0x" << std::hex << slot * 4 << std::dec << ' ' << _selfInstr[slot];
+                if (_timing)
+                    out << ' ' << _selfCycles[slot];
+                out << '\n';
+            }
+            for (; edge != _edges.end() && std::get<0>(edge->first) == function; ++edge)
+            {
+                const auto& [caller, site, callee] = edge->first;
+                out << "cfn=" << _symbols.Name(callee) << "\n"
+                    << "calls=" << edge->second.calls << " 0x" << std::hex << callee << "\n"
+                    << "0x" << site << std::dec << ' ' << edge->second.inclInstr;
+                if (_timing)
+                    out << ' ' << edge->second.inclCycles;
+                out << '\n';
+            }
+        }
+    }
+
+    // Flat per-function table sorted by inclusive instructions
+    void Report(std::ostream& out, size_t top)
+    {
+        Finish();
+
+        std::map<Word, uint64_t> self;
+        for (size_t slot = 0; slot < _owner.size(); slot++)
+            if (_owner[slot] != noOwner)
+                self[_owner[slot]] += _selfInstr[slot];
+
+        std::vector<Word> functions;
+        for (const auto& entry : _functions)
+            functions.push_back(entry.first);
+        std::stable_sort(functions.begin(), functions.end(), [this](Word a, Word b) {
+            return _functions[a].inclInstr > _functions[b].inclInstr;
+        });
+
+        out << "callgraph: " << _instructions << " instructions, " << _edges.size() << " call edges" << std::endl;
+        out << "  " << std::setw(12) << "inclusive" << std::setw(12) << "self"
+            << std::setw(10) << "calls" << "  function" << std::endl;
+        for (size_t i = 0; i < functions.size() && i < top; i++)
+        {
+            const Function& function = _functions[functions[i]];
+            out << "  " << std::setw(12) << function.inclInstr << std::setw(12) << self[functions[i]]
+                << std::setw(10) << function.calls << "  " << _symbols.Name(functions[i]) << std::endl;
+        }
+    }
+
+private:
+    static constexpr Word noOwner = 0xffffffff;
+
+    // caller entry, call site, callee entry
+    using EdgeKey = std::tuple<Word, Word, Word>;
+
+    struct Edge
+    {
+        uint64_t calls = 0;
+        uint64_t inclInstr = 0;
+        uint64_t inclCycles = 0;
+    };
+
+    struct Function
+    {
+        uint64_t calls = 0;
+        uint64_t inclInstr = 0;
+        uint64_t inclCycles = 0;
+        unsigned activations = 0;   // recursion depth, inclusive cost counts the outermost only
+    };
+
+    struct Activation
+    {
+        Edge* edge;
+        Word function;
+        uint64_t instrAtCall;
+        uint64_t cyclesAtCall;
+        bool outermost;
+    };
+
+    void Leave()
+    {
+        Activation& activation = _active.back();
+        uint64_t instr = _instructions - activation.instrAtCall;
+        uint64_t cycles = _cycles - activation.cyclesAtCall;
+        activation.edge->inclInstr += instr;
+        activation.edge->inclCycles += cycles;
+
+        Function& function = _functions[activation.function];
+        function.calls++;
+        function.activations--;
+        if (activation.outermost)
+        {
+            function.inclInstr += instr;
+            function.inclCycles += cycles;
+        }
+        _active.pop_back();
+    }
+
+    const SymbolTable& _symbols;
+    const TimingModel* _timing;
+    ShadowStack _stack;
+    std::vector<Activation> _active;
+    std::map<EdgeKey, Edge> _edges;
+    std::map<Word, Function> _functions;
+    std::vector<uint64_t> _selfInstr;
+    std::vector<uint64_t> _selfCycles;
+    std::vector<Word> _owner;
+    uint64_t _instructions = 0;
+    uint64_t _cycles = 0;
+    uint64_t _lastModelCycles = 0;
+};
+
+#endif //RISCV_SIM_CALLGRAPHPROFILER_H
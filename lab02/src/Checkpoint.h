@@ -0,0 +1,261 @@
+#ifndef RISCV_SIM_CHECKPOINT_H
+#define RISCV_SIM_CHECKPOINT_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Cpu.h"
+#include "Memory.h"
+
+// Architectural state of a Cpu and its Memory at an instruction boundary.
+//
+// File layout: CheckpointHeader, the indices of the saved pages, padding to
+// a page boundary, then the saved pages. Only dirty Memory pages are
+// saved; restoring copies them straight out of the mapping and zeroes the
+// pages the target dirtied itself, so its cost depends on the pages
+// touched, not on the memory size. Timing model state is not part of a
+// checkpoint and has to be warmed up after restoring.
+
+struct CheckpointHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t pageBytes;
+    uint32_t pageCount;
+    Word ip;
+    uint64_t pagesOffset;
+    Word regs[32];
+    CsrFile::Counters counters;
+};
+
+namespace CheckpointFormat
+{
+    constexpr char magic[8] = {'R', 'V', 'C', 'K', 'P', 'T', '0', '1'};
+    constexpr uint32_t version = 1;
+}
+
+class Checkpoint
+{
+public:
+    Checkpoint() = default;
+    Checkpoint(const Checkpoint&) = delete;
+    Checkpoint& operator=(const Checkpoint&) = delete;
+
+    Checkpoint(Checkpoint&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    Checkpoint& operator=(Checkpoint&& other) noexcept
+    {
+        std::swap(_data, other._data);
+        std::swap(_size, other._size);
+        std::swap(_mapped, other._mapped);
+        std::swap(_owned, other._owned);
+        std::swap(_header, other._header);
+        std::swap(_pages, other._pages);
+        return *this;
+    }
+
+    ~Checkpoint()
+    {
+        Unmap();
+    }
+
+    // Serialises the state into the file format
+    static std::vector<uint8_t> Capture(Cpu& cpu, const Memory& mem)
+    {
+        std::vector<uint32_t> pages;
+        for (size_t page = 0; page < Memory::PageCount(); page++)
+            if (mem.PageDirty(page))
+                pages.push_back(static_cast<uint32_t>(page));
+
+        CheckpointHeader header{};
+        std::memcpy(header.magic, CheckpointFormat::magic, sizeof(header.magic));
+        header.version = CheckpointFormat::version;
+        header.pageBytes = Memory::pageBytes;
+        header.pageCount = static_cast<uint32_t>(pages.size());
+        header.ip = cpu.Ip();
+        header.pagesOffset = PagesOffset(pages.size());
+        for (RId i = 0; i < 32; i++)
+            header.regs[i] = cpu.Registers().Get(i);
+        header.counters = cpu.Csrs().SaveCounters();
+
+        std::vector<uint8_t> data(header.pagesOffset + pages.size() * Memory::pageBytes, 0);
+        std::memcpy(data.data(), &header, sizeof(header));
+        std::memcpy(data.data() + sizeof(header), pages.data(), pages.size() * sizeof(uint32_t));
+        uint8_t* pageData = data.data() + header.pagesOffset;
+        for (uint32_t page : pages)
+        {
+            std::memcpy(pageData, mem.Page(page), Memory::pageBytes);
+            pageData += Memory::pageBytes;
+        }
+        return data;
+    }
+
+    static bool Save(const std::string& filename, Cpu& cpu, const Memory& mem)
+    {
+        std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cerr << "ERROR: checkpoint: failed opening file \"" << filename << "\"" << std::endl;
+            return false;
+        }
+
+        std::vector<uint8_t> data = Capture(cpu, mem);
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        if (!file)
+        {
+            std::cerr << "ERROR: checkpoint: failed writing file \"" << filename << "\"" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Takes a Capture() result, e.g. from an in-memory checkpoint series
+    bool Load(std::vector<uint8_t> data)
+    {
+        Unmap();
+        _owned = std::move(data);
+        _data = _owned.data();
+        _size = _owned.size();
+        return Parse();
+    }
+
+    bool Open(const std::string& filename)
+    {
+        Unmap();
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            std::cerr << "ERROR: checkpoint: failed opening file \"" << filename << "\"" << std::endl;
+            return false;
+        }
+
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(CheckpointHeader))
+        {
+            std::cerr << "ERROR: checkpoint: file too small to be a checkpoint" << std::endl;
+            close(fd);
+            return false;
+        }
+
+        _size = st.st_size;
+        void* mapped = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            std::cerr << "ERROR: checkpoint: mmap failed" << std::endl;
+            return false;
+        }
+        _data = static_cast<const uint8_t*>(mapped);
+        _mapped = true;
+        return Parse();
+    }
+
+    // May be called any number of times, also on the same Cpu and Memory
+    void Restore(Cpu& cpu, Memory& mem) const
+    {
+        for (size_t page = 0; page < Memory::PageCount(); page++)
+            if (mem.PageDirty(page))
+                mem.ZeroPage(page);
+        mem.ClearDirty();
+
+        const uint8_t* pageData = _data + _header.pagesOffset;
+        for (uint32_t page : _pages)
+        {
+            mem.WritePage(page, reinterpret_cast<const Word*>(pageData));
+            pageData += Memory::pageBytes;
+        }
+
+        cpu.Reset(_header.ip);
+        for (RId i = 0; i < 32; i++)
+            cpu.Registers().Set(i, _header.regs[i]);
+        cpu.Csrs().RestoreCounters(_header.counters);
+    }
+
+    Word Ip() const
+    {
+        return _header.ip;
+    }
+
+    uint64_t InstructionsRetired() const
+    {
+        return _header.counters.instret;
+    }
+
+    size_t PageCount() const
+    {
+        return _pages.size();
+    }
+
+private:
+    bool Parse()
+    {
+        if (_size < sizeof(CheckpointHeader))
+        {
+            std::cerr << "ERROR: checkpoint: file too small to be a checkpoint" << std::endl;
+            return false;
+        }
+
+        std::memcpy(&_header, _data, sizeof(_header));
+        if (std::memcmp(_header.magic, CheckpointFormat::magic, sizeof(_header.magic)) != 0
+            || _header.version != CheckpointFormat::version || _header.pageBytes != Memory::pageBytes)
+        {
+            std::cerr << "ERROR: checkpoint: unknown file format" << std::endl;
+            return false;
+        }
+        if (_header.pagesOffset != PagesOffset(_header.pageCount)
+            || _header.pagesOffset + uint64_t(_header.pageCount) * Memory::pageBytes > _size)
+        {
+            std::cerr << "ERROR: checkpoint: truncated file" << std::endl;
+            return false;
+        }
+
+        _pages.resize(_header.pageCount);
+        std::memcpy(_pages.data(), _data + sizeof(_header), _pages.size() * sizeof(uint32_t));
+        for (uint32_t page : _pages)
+        {
+            if (page >= Memory::PageCount())
+            {
+                std::cerr << "ERROR: checkpoint: page " << page << " is out of memory" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Saved pages start on a page boundary, so they can be mapped directly
+    static uint64_t PagesOffset(size_t pageCount)
+    {
+        uint64_t end = sizeof(CheckpointHeader) + pageCount * sizeof(uint32_t);
+        return (end + Memory::pageBytes - 1) / Memory::pageBytes * Memory::pageBytes;
+    }
+
+    void Unmap()
+    {
+        if (_mapped)
+            munmap(const_cast<uint8_t*>(_data), _size);
+        _mapped = false;
+        _data = nullptr;
+        _owned.clear();
+    }
+
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+    bool _mapped = false;
+    std::vector<uint8_t> _owned;
+    CheckpointHeader _header{};
+    std::vector<uint32_t> _pages;
+};
+
+#endif //RISCV_SIM_CHECKPOINT_H
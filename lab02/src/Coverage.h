@@ -0,0 +1,117 @@
+#ifndef RISCV_SIM_COVERAGE_H
+#define RISCV_SIM_COVERAGE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <sys/shm.h>
+
+#include "BaseTypes.h"
+
+// AFL-compatible edge coverage: every taken Br/J/Jr increments
+// map[hash(ip) >> 1 ^ hash(target)], with 8-bit wrapping counters. If the
+// process runs under afl-fuzz (__AFL_SHM_ID is set) the map is the
+// fuzzer's shared memory segment, otherwise a private buffer.
+class EdgeCoverage
+{
+public:
+    static constexpr size_t defaultSize = 1u << 16;    // AFL MAP_SIZE
+
+    // size must be a power of two
+    EdgeCoverage(size_t size = defaultSize)
+        : _mask(size - 1)
+    {
+        if (const char* id = std::getenv("__AFL_SHM_ID"))
+        {
+            void* shared = shmat(std::atoi(id), nullptr, 0);
+            if (shared != reinterpret_cast<void*>(-1))
+            {
+                _map = static_cast<uint8_t*>(shared);
+                _shared = true;
+                return;
+            }
+            std::cerr << "ERROR: coverage: shmat failed, using a private map" << std::endl;
+        }
+        _own.assign(size, 0);
+        _map = _own.data();
+    }
+
+    ~EdgeCoverage()
+    {
+        if (_shared)
+            shmdt(_map);
+    }
+
+    EdgeCoverage(const EdgeCoverage&) = delete;
+    EdgeCoverage& operator=(const EdgeCoverage&) = delete;
+
+    void Edge(Word ip, Word target)
+    {
+        _map[((Hash(ip) >> 1u) ^ Hash(target)) & _mask]++;
+    }
+
+    void Clear()
+    {
+        std::memset(_map, 0, Size());
+    }
+
+    // Ors the touched entries into `seen`; returns true if any was new
+    bool MergeInto(std::vector<uint8_t>& seen) const
+    {
+        seen.resize(Size(), 0);
+        bool found = false;
+        for (size_t i = 0; i < Size(); i++)
+        {
+            if (_map[i] && !seen[i])
+            {
+                seen[i] = 1;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    size_t Edges() const
+    {
+        size_t edges = 0;
+        for (size_t i = 0; i < Size(); i++)
+            edges += _map[i] != 0;
+        return edges;
+    }
+
+    const uint8_t* Map() const
+    {
+        return _map;
+    }
+
+    size_t Size() const
+    {
+        return _mask + 1;
+    }
+
+    bool Shared() const
+    {
+        return _shared;
+    }
+
+private:
+    // Instruction addresses are word aligned and clustered, spread them
+    static Word Hash(Word ip)
+    {
+        ip >>= 2u;
+        ip ^= ip >> 16u;
+        ip *= 0x7feb352du;
+        ip ^= ip >> 15u;
+        return ip;
+    }
+
+    size_t _mask;
+    uint8_t* _map = nullptr;
+    bool _shared = false;
+    std::vector<uint8_t> _own;
+};
+
+#endif //RISCV_SIM_COVERAGE_H
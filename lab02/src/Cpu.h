@@ -2,24 +2,49 @@
 #ifndef RISCV_SIM_CPU_H
 #define RISCV_SIM_CPU_H
 
+#include "CpuConfig.h"
 #include "Memory.h"
+#include "DecodeAhead.h"
 #include "Decoder.h"
+#include "PredecodedText.h"
 #include "RegisterFile.h"
 #include "CsrFile.h"
 #include "Executor.h"
+#include "MicroOps.h"
+#include "RetireListener.h"
 
-class Cpu
+#include <algorithm>
+#include <vector>
+
+// Config selects the optional per-instruction work, see CpuConfig.h
+template <typename Config = CpuConfig>
+class BasicCpu
 {
 public:
-    Cpu(Memory& mem)
+    BasicCpu(Memory& mem)
         : _mem(mem)
     {
 
     }
 
-    void ProcessInstruction()
+    // Retires one instruction, or up to budget of them if a compiled block
+    // or a fused pair of the predecoded text starts at the ip
+    void ProcessInstruction(uint64_t budget = 1)
     {
-        auto instr = _decoder.Decode(_mem.Request(_ip));
+        if (budget > 1 && _uops && CanBatch() && _uops->Run(_ip, _rf, _mem, _csrf, budget, Coverage()))
+            return;
+        Word word = _mem.Request(_ip);
+        if (budget > 1 && _predecoded && _predecoded->FusionEnabled() && CanBatch())
+        {
+            if (const auto* pair = _predecoded->Fused(_ip, word, _mem))
+            {
+                ProcessFused(*pair);
+                return;
+            }
+        }
+        auto instr = _predecoded ? _predecoded->Decode(_ip, word)
+                     : _ahead    ? _ahead->Decode(_ip, word)
+                                 : _decoder.Decode(word);
         _rf.Read(instr);
         _csrf.Read(instr);
 
@@ -27,29 +52,198 @@ public:
         _mem.Request(instr);
         _rf.Write(instr);
         _csrf.Write(instr);
-        _csrf.InstructionExecuted();
+        if constexpr (Config::hpmEvents)
+            _csrf.InstructionExecuted(instr, _ip);
+        else
+            _csrf.Retire();
+        if constexpr (Config::listeners)
+            for (auto listener : _listeners)
+                listener->OnRetire(*instr, _ip, word);
         _ip = instr->_nextIp;
     }
 
+    // Runs until the guest sends a tohost message, which is returned, or
+    // until budget instructions have retired. budget is decreased by the
+    // instructions run, so a caller can suspend and resume the guest at
+    // either point.
+    std::optional<CpuToHostData> RunFor(uint64_t& budget)
+    {
+        while (budget)
+        {
+            uint64_t retired = InstructionsRetired();
+            ProcessInstruction(budget);
+            budget -= InstructionsRetired() - retired;
+            if (auto msg = GetMessage())
+                return msg;
+        }
+        return std::nullopt;
+    }
+
     void Reset(Word ip)
     {
         _csrf.Reset();
         _ip = ip;
     }
 
+    Word Ip() const
+    {
+        return _ip;
+    }
+
+    // Resumes at ip without touching registers or counters
+    void SetIp(Word ip)
+    {
+        _ip = ip;
+    }
+
     std::optional<CpuToHostData> GetMessage()
     {
         return _csrf.GetMessage();
     }
 
+    uint64_t InstructionsRetired() const
+    {
+        return _csrf.InstructionsRetired();
+    }
+
+    CsrFile& Csrs()
+    {
+        return _csrf;
+    }
+
+    RegisterFile& Registers()
+    {
+        return _rf;
+    }
+
+    // Not owned, must outlive the Cpu
+    void SetCoverage(EdgeCoverage* coverage)
+    {
+        static_assert(Config::coverage, "coverage is disabled in this Cpu configuration");
+        _exe.SetCoverage(coverage);
+    }
+
+    Decoder& GetDecoder()
+    {
+        return _decoder;
+    }
+
+    // Decodes from the table instead of every fetched word; not owned
+    void SetPredecoded(PredecodedText* predecoded)
+    {
+        _predecoded = predecoded;
+    }
+
+    // Takes instructions decoded on a helper thread; not owned
+    void SetDecodeAhead(DecodeAhead* ahead)
+    {
+        _ahead = ahead;
+    }
+
+    // Runs compiled micro-op blocks where it can; not owned
+    void SetUopEngine(UopEngine* uops)
+    {
+        _uops = uops;
+    }
+
+    // Listeners are not owned and must outlive the Cpu
+    void AddListener(RetireListener* listener)
+    {
+        static_assert(Config::listeners, "listeners are disabled in this Cpu configuration");
+        _listeners.push_back(listener);
+    }
+
+    void RemoveListener(RetireListener* listener)
+    {
+        _listeners.erase(std::remove(_listeners.begin(), _listeners.end(), listener), _listeners.end());
+    }
+
 private:
+    // Fused pairs and compiled blocks retire without an Instruction for
+    // each of their instructions, so nothing may observe those
+    bool CanBatch() const
+    {
+        if constexpr (Config::listeners)
+            if (!_listeners.empty())
+                return false;
+        if constexpr (Config::hpmEvents)
+            if (_csrf.CountsEvents())
+                return false;
+        return true;
+    }
+
+    EdgeCoverage* Coverage() const
+    {
+        if constexpr (Config::coverage)
+            return _exe.GetCoverage();
+        else
+            return nullptr;
+    }
+
+    // Taken transfers of fused pairs and compiled blocks, as the Executor
+    // records them
+    void Edge(Word ip, Word target)
+    {
+        if (EdgeCoverage* coverage = Coverage())
+            coverage->Edge(ip, target);
+    }
+
+    // Same register, memory and ip updates as the two instructions in order
+    void ProcessFused(const PredecodedText::FusedPair& pair)
+    {
+        using Fusion = PredecodedText::Fusion;
+        using Exe = BasicExecutor<Config::coverage>;
+
+        Word nextIp = _ip + 8;
+        switch (pair.kind)
+        {
+            case Fusion::LuiAddi:
+                _rf.Set(pair.rd, pair.imm);
+                if (pair.rd2)
+                    _rf.Set(pair.rd2, pair.imm + pair.offset);
+                break;
+            case Fusion::AuipcJalr:
+                _rf.Set(pair.rd, _ip + pair.imm);
+                nextIp = _ip + pair.imm + pair.offset;
+                Edge(_ip + 4, nextIp);
+                if (pair.rd2)
+                    _rf.Set(pair.rd2, _ip + 8);
+                break;
+            case Fusion::AuipcLw:
+                _rf.Set(pair.rd, _ip + pair.imm);
+                if (pair.rd2)
+                    _rf.Set(pair.rd2, _mem.Request(_ip + pair.imm + pair.offset));
+                break;
+            default:
+            {
+                Word second = pair.src2 ? _rf.Get(pair.src2.value()) : pair.imm;
+                _rf.Set(pair.rd, Exe::Alu(pair.alu, _rf.Get(pair.src1), second));
+                if (Exe::Taken(pair.br, _rf.Get(pair.brSrc1), _rf.Get(pair.brSrc2)))
+                {
+                    nextIp = _ip + 4 + pair.offset;
+                    Edge(_ip + 4, nextIp);
+                }
+                break;
+            }
+        }
+        _csrf.Retire();
+        _csrf.Retire();
+        _ip = nextIp;
+    }
+
     Reg32 _ip;
     Decoder _decoder;
     RegisterFile _rf;
     CsrFile _csrf;
-    Executor _exe;
+    BasicExecutor<Config::coverage> _exe;
     Memory& _mem;
+    std::vector<RetireListener*> _listeners;
+    PredecodedText* _predecoded = nullptr;
+    UopEngine* _uops = nullptr;
+    DecodeAhead* _ahead = nullptr;
 };
 
 
+using Cpu = BasicCpu<>;
+
 #endif //RISCV_SIM_CPU_H
@@ -0,0 +1,25 @@
+#ifndef RISCV_SIM_CPUCONFIG_H
+#define RISCV_SIM_CPUCONFIG_H
+
+// Compile-time feature set of BasicCpu. A disabled feature costs nothing
+// per instruction: its code is removed with `if constexpr`, and the
+// matching setters (AddListener, SetCoverage) do not compile.
+
+// Everything on; this is the Cpu used by riscv_sim
+struct CpuConfig
+{
+    static constexpr bool listeners = true;     // RetireListener hooks: tracing, timing models, profilers
+    static constexpr bool hpmEvents = true;     // mhpmcounter event counting on retire
+    static constexpr bool coverage = true;      // edge coverage hook in the Executor
+};
+
+// Pure functional execution: architectural state, instret/cycle and the
+// tohost channel only
+struct FunctionalCpuConfig
+{
+    static constexpr bool listeners = false;
+    static constexpr bool hpmEvents = false;
+    static constexpr bool coverage = false;
+};
+
+#endif //RISCV_SIM_CPUCONFIG_H
@@ -1,13 +1,29 @@
-
 #ifndef RISCV_SIM_CSRFILE_H
 #define RISCV_SIM_CSRFILE_H
 
+#include <array>
+#include <cstdint>
 #include <optional>
 #include "Instruction.h"
 
+// cycle/instret are 64-bit, the guest reads them as {cycle, cycleh} pairs.
+// mhpmcounter3..31 count the HpmEvent selected in the matching mhpmevent;
+// with no event selected the only per-instruction cost is one mask test.
 class CsrFile
 {
 public:
+    static constexpr unsigned firstHpm = 3;
+    static constexpr unsigned numHpm = 32;
+
+    // Architectural counter state, for checkpoints
+    struct Counters
+    {
+        uint64_t instret;
+        uint64_t cycles;
+        std::array<uint64_t, numHpm> hpmCounters;
+        std::array<HpmEvent, numHpm> hpmEvents;
+    };
+
     void Reset()
     {
         numInstr = 0;
@@ -15,33 +31,133 @@ public:
         coreId = 0;
         cpuToHostData.reset();
         startReg = true;
+        hpmCounters.fill(0);
+        hpmEvents.fill(HpmEvent::None);
+        eventMask = 0;
     }
     void Read(InstructionPtr& instr)
     {
         if (!instr->_csr)
             return;
 
-        switch (static_cast<CsrIdx>(instr->_csr.value()))
+        RId idx = static_cast<RId>(instr->_csr.value());
+        switch (static_cast<CsrIdx>(idx))
         {
-            case CsrIdx::Instret: instr->_csrVal = numInstr; break;
-            case CsrIdx::Cycle  : instr->_csrVal = numCycles; break;
-            case CsrIdx::Mhartid: instr->_csrVal = coreId; break;
+            case CsrIdx::Instret  : instr->_csrVal = Low(numInstr); return;
+            case CsrIdx::Instreth : instr->_csrVal = High(numInstr); return;
+            case CsrIdx::Minstret : instr->_csrVal = Low(numInstr); return;
+            case CsrIdx::Minstreth: instr->_csrVal = High(numInstr); return;
+            case CsrIdx::Cycle    : instr->_csrVal = Low(numCycles); return;
+            case CsrIdx::Cycleh   : instr->_csrVal = High(numCycles); return;
+            case CsrIdx::Mcycle   : instr->_csrVal = Low(numCycles); return;
+            case CsrIdx::Mcycleh  : instr->_csrVal = High(numCycles); return;
+            case CsrIdx::Time     : instr->_csrVal = Low(numCycles); return;
+            case CsrIdx::Timeh    : instr->_csrVal = High(numCycles); return;
+            case CsrIdx::Mhartid  : instr->_csrVal = coreId; return;
             default: break;
         }
+
+        if (auto n = BankIndex(idx, CsrIdx::Hpmcounter))
+            instr->_csrVal = Low(hpmCounters[*n]);
+        else if (auto n = BankIndex(idx, CsrIdx::Mhpmcounter))
+            instr->_csrVal = Low(hpmCounters[*n]);
+        else if (auto n = BankIndex(idx, CsrIdx::Hpmcounterh))
+            instr->_csrVal = High(hpmCounters[*n]);
+        else if (auto n = BankIndex(idx, CsrIdx::Mhpmcounterh))
+            instr->_csrVal = High(hpmCounters[*n]);
+        else if (auto n = BankIndex(idx, CsrIdx::Mhpmevent))
+            instr->_csrVal = static_cast<Word>(hpmEvents[*n]);
     }
     void Write(InstructionPtr& instr)
     {
-        if (instr->_type == IType::Csrw && instr->_csr.value_or(CsrIdx::None) == CsrIdx::Mtohost)
+        if (instr->_type != IType::Csrw)
+            return;
+
+        RId idx = static_cast<RId>(instr->_csr.value_or(CsrIdx::None));
+        switch (static_cast<CsrIdx>(idx))
         {
-            cpuToHostData = CpuToHostData{instr->_data};
+            case CsrIdx::Mtohost  : cpuToHostData = CpuToHostData{instr->_data}; return;
+            case CsrIdx::Minstret : SetLow(numInstr, instr->_data); return;
+            case CsrIdx::Minstreth: SetHigh(numInstr, instr->_data); return;
+            case CsrIdx::Mcycle   : SetLow(numCycles, instr->_data); return;
+            case CsrIdx::Mcycleh  : SetHigh(numCycles, instr->_data); return;
+            default: break;
         }
+
+        if (auto n = BankIndex(idx, CsrIdx::Mhpmcounter))
+            SetLow(hpmCounters[*n], instr->_data);
+        else if (auto n = BankIndex(idx, CsrIdx::Mhpmcounterh))
+            SetHigh(hpmCounters[*n], instr->_data);
+        else if (auto n = BankIndex(idx, CsrIdx::Mhpmevent))
+            SelectEvent(*n, instr->_data < static_cast<Word>(HpmEvent::Count)
+                            ? static_cast<HpmEvent>(instr->_data) : HpmEvent::None);
     }
-    void InstructionExecuted()
+    void InstructionExecuted(InstructionPtr& instr, Word ip)
+    {
+        numInstr++;
+        numCycles++;
+        if (eventMask)
+            CountInstructionEvents(*instr, ip);
+    }
+
+    // InstructionExecuted() without event counting
+    void Retire()
     {
         numInstr++;
         numCycles++;
     }
 
+    // Some mhpmevent selects an event counted per instruction
+    bool CountsEvents() const
+    {
+        return eventMask != 0;
+    }
+
+    void Retire(uint64_t count)
+    {
+        numInstr += count;
+        numCycles += count;
+    }
+
+    // Reported by the timing model for stalls beyond the base cycle
+    void AddCycles(uint64_t cycles)
+    {
+        numCycles += cycles;
+    }
+
+    void CountEvent(HpmEvent event)
+    {
+        if (!(eventMask & EventBit(event)))
+            return;
+        for (unsigned n = firstHpm; n < numHpm; n++)
+            if (hpmEvents[n] == event)
+                hpmCounters[n]++;
+    }
+
+    uint64_t InstructionsRetired() const
+    {
+        return numInstr;
+    }
+
+    uint64_t Cycles() const
+    {
+        return numCycles;
+    }
+
+    Counters SaveCounters() const
+    {
+        return Counters{numInstr, numCycles, hpmCounters, hpmEvents};
+    }
+
+    void RestoreCounters(const Counters& counters)
+    {
+        numInstr = counters.instret;
+        numCycles = counters.cycles;
+        hpmCounters = counters.hpmCounters;
+        for (unsigned n = firstHpm; n < numHpm; n++)
+            SelectEvent(n, counters.hpmEvents[n]);
+    }
+
     std::optional<CpuToHostData> GetMessage()
     {
         std::optional<CpuToHostData> ret;
@@ -49,12 +165,54 @@ public:
         return ret;
     }
 private:
-    Word numInstr = 0;
-    Word numCycles = 0;
+    static Word Low(uint64_t value) { return static_cast<Word>(value); }
+    static Word High(uint64_t value) { return static_cast<Word>(value >> 32u); }
+    static void SetLow(uint64_t& reg, Word value) { reg = (reg & 0xffffffff00000000ull) | value; }
+    static void SetHigh(uint64_t& reg, Word value) { reg = (reg & 0xffffffffull) | (uint64_t(value) << 32u); }
+    static uint32_t EventBit(HpmEvent event) { return 1u << static_cast<unsigned>(event); }
+
+    static std::optional<unsigned> BankIndex(RId idx, CsrIdx base)
+    {
+        unsigned n = idx - static_cast<RId>(base);
+        if (idx < static_cast<RId>(base) || n < firstHpm || n >= numHpm)
+            return std::nullopt;
+        return n;
+    }
+
+    void SelectEvent(unsigned n, HpmEvent event)
+    {
+        hpmEvents[n] = event;
+        eventMask = 0;
+        for (unsigned i = firstHpm; i < numHpm; i++)
+            if (hpmEvents[i] != HpmEvent::None)
+                eventMask |= EventBit(hpmEvents[i]);
+    }
+
+    void CountInstructionEvents(const Instruction& instr, Word ip)
+    {
+        switch (instr._type)
+        {
+            case IType::Ld: CountEvent(HpmEvent::Loads); break;
+            case IType::St: CountEvent(HpmEvent::Stores); break;
+            case IType::Br:
+                CountEvent(HpmEvent::Branches);
+                if (instr._nextIp != ip + 4)
+                    CountEvent(HpmEvent::TakenBranches);
+                break;
+            case IType::J:
+            case IType::Jr: CountEvent(HpmEvent::Jumps); break;
+            default: break;
+        }
+    }
+
+    uint64_t numInstr = 0;
+    uint64_t numCycles = 0;
     Word coreId = 0;
     std::optional<CpuToHostData> cpuToHostData;
     bool startReg = false;
-
+    std::array<uint64_t, numHpm> hpmCounters{};
+    std::array<HpmEvent, numHpm> hpmEvents{};
+    uint32_t eventMask = 0;
 };
 
 #endif //RISCV_SIM_CSRFILE_H
@@ -0,0 +1,206 @@
+#ifndef RISCV_SIM_DECODEAHEAD_H
+#define RISCV_SIM_DECODEAHEAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <thread>
+
+#include "Decoder.h"
+#include "Memory.h"
+#include "Parallel.h"
+
+// Decodes ahead of the Cpu on a helper thread. The helper follows the
+// predicted path (jumps taken, backward branches taken, forward ones not)
+// and queues the decoded instructions; it stops at a Jr, whose target it
+// cannot know. The Cpu takes the queued instruction for its ip, or decodes
+// it itself and redirects the helper to continue after that ip, dropping
+// whatever is still queued. With nothing to do (stopped at a Jr, or the
+// queue full) the helper sleeps until the Cpu redirects it or has taken
+// half of the queue, so an idle helper costs the host no time.
+//
+// The helper reads Memory with SharedRequest() while the guest may store to
+// it, see there for what this assumes of the stores; host-side bulk writes
+// must not happen while it runs. Every queued entry keeps the word it was
+// decoded from and is only used if the Cpu fetched the same word, so a
+// read older than a guest store costs a miss, never a wrong instruction.
+class DecodeAhead
+{
+public:
+    explicit DecodeAhead(const Memory& mem)
+        : _mem(mem)
+    {
+    }
+
+    ~DecodeAhead()
+    {
+        Stop();
+    }
+
+    DecodeAhead(const DecodeAhead&) = delete;
+    DecodeAhead& operator=(const DecodeAhead&) = delete;
+
+    void Start()
+    {
+        if (_helper.joinable())
+            return;
+        _stop = false;
+        _helper = std::thread([this]() { RunHelper(); });
+    }
+
+    void Stop()
+    {
+        if (!_helper.joinable())
+            return;
+        _stop = true;
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _wake.notify_one();
+        }
+        _helper.join();
+    }
+
+    bool Running() const
+    {
+        return _helper.joinable();
+    }
+
+    // The instruction at ip, given the word the Cpu fetched from there
+    InstructionPtr Decode(Word ip, Word word)
+    {
+        while (Entry* entry = _queue.Front())
+        {
+            // Decoded before the last redirect
+            if (entry->epoch != _epoch)
+            {
+                _queue.Pop();
+                continue;
+            }
+            if (entry->ip != ip || entry->word != word)
+                break;
+            auto instr = std::make_unique<Instruction>(entry->decoded);
+            _queue.Pop();
+            hits++;
+            if (_queue.Size() == queueSize / 2)
+                Wake();
+            return instr;
+        }
+
+        auto instr = std::make_unique<Instruction>();
+        Decoder::Decode(word, *instr);
+        misses++;
+        _epoch++;
+        _redirect.store(uint64_t(_epoch) << 32u | ip, std::memory_order_release);
+        Wake();
+        return instr;
+    }
+
+    // Decoded instructions waiting for the Cpu
+    size_t Queued() const
+    {
+        return _queue.Size();
+    }
+
+    void Report(std::ostream& out) const
+    {
+        out << "decode-ahead: hits=" << hits << " misses=" << misses << std::endl;
+    }
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;    // decoded by the Cpu, each one redirects the helper
+
+private:
+    static constexpr size_t queueSize = 256;
+
+    struct Entry
+    {
+        uint32_t epoch = 0;
+        Word ip = 0;
+        Word word = 0;
+        Instruction decoded{};
+    };
+
+    // Next ip on the predicted path, nullopt after a Jr
+    static std::optional<Word> Predict(const Instruction& instr, Word ip)
+    {
+        if (instr._type == IType::J || (instr._type == IType::Br && static_cast<int32_t>(instr._imm.value()) < 0))
+            return ip + instr._imm.value();
+        if (instr._type == IType::Jr)
+            return std::nullopt;
+        return ip + 4;
+    }
+
+    void RunHelper()
+    {
+        uint32_t epoch = 0;
+        std::optional<Word> ip;
+        Entry entry;
+        while (!_stop.load(std::memory_order_relaxed))
+        {
+            uint64_t redirect = _redirect.load(std::memory_order_acquire);
+            if (static_cast<uint32_t>(redirect >> 32u) != epoch)
+            {
+                // The Cpu decodes the instruction at the redirect itself
+                epoch = static_cast<uint32_t>(redirect >> 32u);
+                Word from = static_cast<Word>(redirect);
+                Decoder::Decode(_mem.SharedRequest(from), entry.decoded);
+                ip = Predict(entry.decoded, from);
+            }
+            if (!ip || _queue.Size() + 1 >= queueSize)
+            {
+                Park(epoch, !ip);
+                continue;
+            }
+
+            entry.epoch = epoch;
+            entry.ip = ip.value();
+            entry.word = _mem.SharedRequest(ip.value());
+            Decoder::Decode(entry.word, entry.decoded);
+            _queue.Push(entry);
+            ip = Predict(entry.decoded, ip.value());
+        }
+    }
+
+    // Sleeps until a redirect from epoch, or until the queue is half empty
+    // unless the helper is stopped at a Jr
+    void Park(uint32_t epoch, bool stopped)
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        _parked.store(true, std::memory_order_relaxed);
+        // Pairs with the fence in Wake(): either the Cpu sees _parked, or
+        // this thread sees the redirect or the pops that came before it
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        _wake.wait(lock, [&]() {
+            return _stop.load(std::memory_order_relaxed)
+                   || static_cast<uint32_t>(_redirect.load(std::memory_order_acquire) >> 32u) != epoch
+                   || (!stopped && _queue.Size() <= queueSize / 2);
+        });
+        _parked.store(false, std::memory_order_relaxed);
+    }
+
+    // Called by the Cpu after a redirect or a pop
+    void Wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!_parked.load(std::memory_order_relaxed))
+            return;
+        std::lock_guard<std::mutex> lock(_lock);
+        _wake.notify_one();
+    }
+
+    const Memory& _mem;
+    SpscQueue<Entry, queueSize> _queue;
+    std::atomic<uint64_t> _redirect{0};     // epoch << 32 | ip, written by the Cpu
+    uint32_t _epoch = 0;                    // of the Cpu side
+    std::atomic<bool> _stop{false};
+    std::atomic<bool> _parked{false};      // the helper sleeps, or is about to
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::thread _helper;
+};
+
+#endif //RISCV_SIM_DECODEAHEAD_H
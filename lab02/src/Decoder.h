@@ -2,487 +2,304 @@
 #ifndef RISCV_SIM_DECODER_H
 #define RISCV_SIM_DECODER_H
 
-#include "SwitchMaker.h"
+#include <array>
+#include <optional>
+#include <vector>
+
 #include "Instruction.h"
 
-// This decoder implementation is stateless, so it could be a function as well
-class Decoder
+// Decoding tables, built at compile time. Everything that depends only on
+// the opcode, funct3 and funct7 is precomputed into one row per 7-bit
+// opcode; funct7 matters only through bit 30 (SUB, SRA, SRAI) in RV32I.
+namespace DecoderTable
 {
-
-public:
-
-    InstructionPtr Decode(Word data)
-    {
-
-        DecodedInstr decoded{data};
-
-        auto instr = (*sMaker).DoOperation(static_cast<Opcode>(decoded.i.opcode), decoded);
-        
-
-        if (instr->_dst.value_or(0) == 0)
-            instr->_dst.reset();
-
-        return instr;
-    }
-
-private:
-    class InstructionMaker;
-
-    class _SwitchMaker
-	{
-        private:
-            using UniqueSwitchPtr = std::unique_ptr<InstructionMaker>;
-
-            SwitchMaker<Opcode, UniqueSwitchPtr> sMaker;
-	    public:
-
-            _SwitchMaker()
-            {
-                sMaker.AddCompare(CreateInstance<OpImmMaker>());
-                sMaker.AddCompare(CreateInstance<AmoMaker>());
-                sMaker.AddCompare(CreateInstance<AuipcMaker>());
-                sMaker.AddCompare(CreateInstance<BranchMaker>());
-                sMaker.AddCompare(CreateInstance<JalMaker>());
-                sMaker.AddCompare(CreateInstance<JalrMaker>());
-                sMaker.AddCompare(CreateInstance<LoadMaker>());
-                sMaker.AddCompare(CreateInstance<LuiMaker>());
-                sMaker.AddCompare(CreateInstance<MiscMemMaker>());
-                sMaker.AddCompare(CreateInstance<OpMaker>());
-                sMaker.AddCompare(CreateInstance<StoreMaker>());
-                sMaker.AddCompare(CreateInstance<SystemMaker>());
-
-                sMaker.AddDefault(CreateInstance<DefaultMaker>());
-            }
-
-            SwitchMaker<Opcode, UniqueSwitchPtr>& operator*()
-            {
-                return sMaker;
-            }
-	};
-
-    using Imm = int32_t;
-
-    static _SwitchMaker inline sMaker = _SwitchMaker();
-
-    static Imm SignExtend(Imm i, unsigned sbit)
+    enum class ImmFormat : uint8_t
     {
-        return i + ((0xffffffff << (sbit + 1)) * ((i & (1u << sbit)) >> sbit));
-    }
-
-
-
+        None,
+        I,
+        Shamt,  // I with only the low 5 bits (SRLI, SRAI)
+        S,
+        B,
+        U,
+        J,
+    };
 
-    union DecodedInstr
+    // Register and CSR fields a row uses
+    enum Operands : uint8_t
     {
-        Word instr;
-        struct rType
-        {
-            uint32_t opcode : 7;
-            uint32_t rd : 5;
-            uint32_t funct3 : 3;
-            uint32_t rs1 : 5;
-            uint32_t rs2 : 5;
-            uint32_t reserved1 : 5;
-            uint32_t aluSel : 1;
-            uint32_t reserved2 : 1;
-        } r;
-        struct iType
-        {
-            uint32_t opcode : 7;
-            uint32_t rd : 5;
-            uint32_t funct3 : 3;
-            uint32_t rs1 : 5;
-            uint32_t imm11_0 : 12;
-        } i;
-        struct sType
-        {
-            uint32_t opcode : 7;
-            uint32_t imm4_0 : 5;
-            uint32_t funct3 : 3;
-            uint32_t rs1 : 5;
-            uint32_t rs2 : 5;
-            uint32_t imm11_5 : 7;
-        } s;
-        struct bType
-        {
-            uint32_t opcode : 7;
-            uint32_t imm11 : 1;
-            uint32_t imm4_1 : 4;
-            uint32_t funct3 : 3;
-            uint32_t rs1 : 5;
-            uint32_t rs2 : 5;
-            uint32_t imm10_5 : 6;
-            uint32_t imm12 : 1;
-        } b;
-        struct uType
-        {
-            uint32_t opcode : 7;
-            uint32_t rd : 5;
-            uint32_t imm31_12 : 20;
-        } u;
-        struct jType
-        {
-            uint32_t opcode : 7;
-            uint32_t rd : 5;
-            uint32_t imm19_12 : 8;
-            uint32_t imm11 : 1;
-            uint32_t imm10_1 : 10;
-            uint32_t imm20 : 1;
-        } j;
-
+        Rd      = 1u << 0u,
+        Rs1     = 1u << 1u,
+        Rs2     = 1u << 2u,
+        Rs1Zero = 1u << 3u,     // src1 is x0 regardless of the encoding (LUI)
+        Csr     = 1u << 4u,
     };
 
-    class InstructionMaker
+    struct Row
     {
-        public:
-            InstructionMaker(Opcode _type)
-            {
-                type = _type;
-            }
-
-            Opcode GetSwitchType()
-            {
-                return type;
-            }
-
-            InstructionPtr virtual operator()(DecodedInstr decoded) = 0;
-
-        protected:
-            Opcode type;
-
-            InstructionPtr GetNewInstraction()
-            {
-                return std::make_unique<Instruction>();
-            }
-
-            Imm GetimmI(DecodedInstr decoded)
-            {
-                return SignExtend(decoded.i.imm11_0, 11);
-            }
-
-            Imm GetimmS(DecodedInstr decoded)
-            {
-                return SignExtend(decoded.s.imm11_5 << 5u | decoded.s.imm4_0, 11);
-            }
-
-            Word GetimmU(DecodedInstr decoded)
-            {
-                return decoded.u.imm31_12 << 12u;
-            }
-
-            Imm GetimmB(DecodedInstr decoded)
-            {
-                return SignExtend((decoded.b.imm12 << 12u) | (decoded.b.imm11 << 11u) |
-                              (decoded.b.imm10_5 << 5u) | (decoded.b.imm4_1 << 1u),
-                              12);
-            }
-
-            Imm GetimmJ(DecodedInstr decoded)
-            {
-                return SignExtend((decoded.j.imm20 << 20u) | (decoded.j.imm19_12 << 12u) |
-                              (decoded.j.imm11 << 11u) | (decoded.j.imm10_1 << 1u),
-                              20);
-            }
+        IType type[8];          // by funct3
+        AluFunc alu[2][8];      // by bit 30, funct3
+        BrFunc br[8];           // by funct3
+        ImmFormat imm[8];       // by funct3
+        uint8_t operands;
     };
 
-    template<typename T, typename... Args>
-    static std::unique_ptr<InstructionMaker> CreateInstance(Args&&... args)
+    constexpr Row Uniform(IType type, AluFunc alu, BrFunc br, ImmFormat imm, uint8_t operands)
     {
-        return std::unique_ptr<InstructionMaker>(new T(std::forward<Args>(args)...));
+        Row row{};
+        for (unsigned funct3 = 0; funct3 < 8; funct3++)
+        {
+            row.type[funct3] = type;
+            row.alu[0][funct3] = alu;
+            row.alu[1][funct3] = alu;
+            row.br[funct3] = br;
+            row.imm[funct3] = imm;
+        }
+        row.operands = operands;
+        return row;
     }
 
-
-    class OpImmMaker : public InstructionMaker
+    constexpr std::array<Row, 128> Make()
     {
-        using Imm = int32_t;
-        public:
-            
-            OpImmMaker() : InstructionMaker(Opcode::OpImm) {}
-
-            InstructionPtr operator()(DecodedInstr decoded) override
+        std::array<Row, 128> table{};
+        for (auto& row : table)
+            row = Uniform(IType::Unsupported, AluFunc::None, BrFunc::NT, ImmFormat::None, 0);
+
+        // Instructions not using the ALU still carry Add: the Executor runs
+        // the ALU for every instruction that has a src1
+        Row opImm = Uniform(IType::Alu, AluFunc::Add, BrFunc::NT, ImmFormat::I, Rd | Rs1);
+        Row op = Uniform(IType::Alu, AluFunc::Add, BrFunc::NT, ImmFormat::None, Rd | Rs1 | Rs2);
+        for (unsigned funct3 = 0; funct3 < 8; funct3++)
+        {
+            for (unsigned alt = 0; alt < 2; alt++)
             {
-                auto instr = GetNewInstraction();
-                instr->_imm = GetimmI(decoded);
-                instr->_type = IType::Alu;
-                instr->_aluFunc = static_cast<AluFunc>(decoded.i.funct3);
-                if (instr->_aluFunc == AluFunc::Sr)
-                {
-                    instr->_aluFunc = decoded.r.aluSel ? AluFunc::Sra : AluFunc::Srl;
-                    instr->_imm.value() &= 31u;
-                }
-                instr->_dst = RId(decoded.i.rd);
-                instr->_src1 = RId(decoded.i.rs1);
-                return instr;
+                opImm.alu[alt][funct3] = static_cast<AluFunc>(funct3);
+                op.alu[alt][funct3] = static_cast<AluFunc>(funct3);
             }
-    };
-
-
-    class OpMaker : public InstructionMaker
-    {
-        public:
+        }
+        opImm.alu[0][static_cast<unsigned>(AluFunc::Sr)] = AluFunc::Srl;
+        opImm.alu[1][static_cast<unsigned>(AluFunc::Sr)] = AluFunc::Sra;
+        opImm.imm[static_cast<unsigned>(AluFunc::Sr)] = ImmFormat::Shamt;
+        op.alu[1][static_cast<unsigned>(AluFunc::Add)] = AluFunc::Sub;
+        op.alu[0][static_cast<unsigned>(AluFunc::Sr)] = AluFunc::Srl;
+        op.alu[1][static_cast<unsigned>(AluFunc::Sr)] = AluFunc::Sra;
+        table[static_cast<uint8_t>(Opcode::OpImm)] = opImm;
+        table[static_cast<uint8_t>(Opcode::Op)] = op;
+
+        table[static_cast<uint8_t>(Opcode::Lui)] =
+            Uniform(IType::Alu, AluFunc::Add, BrFunc::NT, ImmFormat::U, Rd | Rs1Zero);
+        table[static_cast<uint8_t>(Opcode::Auipc)] =
+            Uniform(IType::Auipc, AluFunc::Add, BrFunc::NT, ImmFormat::U, Rd);
+        table[static_cast<uint8_t>(Opcode::Jal)] =
+            Uniform(IType::J, AluFunc::Add, BrFunc::AT, ImmFormat::J, Rd);
+        table[static_cast<uint8_t>(Opcode::Jalr)] =
+            Uniform(IType::Jr, AluFunc::Add, BrFunc::AT, ImmFormat::I, Rd | Rs1);
+
+        Row branch = Uniform(IType::Br, AluFunc::Add, BrFunc::NT, ImmFormat::B, Rs1 | Rs2);
+        for (unsigned funct3 = 0; funct3 < 8; funct3++)
+            branch.br[funct3] = static_cast<BrFunc>(funct3);
+        table[static_cast<uint8_t>(Opcode::Branch)] = branch;
+
+        Row load = Uniform(IType::Unsupported, AluFunc::Add, BrFunc::NT, ImmFormat::I, Rd | Rs1);
+        load.type[fnLW] = IType::Ld;
+        table[static_cast<uint8_t>(Opcode::Load)] = load;
+
+        Row store = Uniform(IType::Unsupported, AluFunc::Add, BrFunc::NT, ImmFormat::S, Rs1 | Rs2);
+        store.type[fnSW] = IType::St;
+        table[static_cast<uint8_t>(Opcode::Store)] = store;
+
+        // Narrowed further by Decode(): CSRW needs rd = x0, CSRR rs1 = x0
+        Row system = Uniform(IType::Unsupported, AluFunc::Add, BrFunc::NT, ImmFormat::None, Rd | Rs1 | Csr);
+        system.type[fnCSRRW] = IType::Csrw;
+        system.type[fnCSRRS] = IType::Csrr;
+        table[static_cast<uint8_t>(Opcode::System)] = system;
+
+        return table;
+    }
 
-            OpMaker() : InstructionMaker(Opcode::Op) {}
+    inline constexpr std::array<Row, 128> rows = Make();
 
-            InstructionPtr operator()(DecodedInstr decoded) override
-            {
-                auto instr = GetNewInstraction();
-                instr->_type = IType::Alu;
-                auto funct3 = AluFunc(decoded.r.funct3);
-                if (funct3 == AluFunc::Add)
-                {
-                    instr->_aluFunc = decoded.r.aluSel == 0 ? AluFunc::Add : AluFunc::Sub;
-                }
-                else if (funct3 == AluFunc::Sr)
-                {
-                    instr->_aluFunc = decoded.r.aluSel ? AluFunc::Sra : AluFunc::Srl;
-                }
-                else
-                {
-                    instr->_aluFunc = funct3;
-                }
-                instr->_dst = RId(decoded.r.rd);
-                instr->_src1 = RId(decoded.r.rs1);
-                instr->_src2 = RId(decoded.r.rs2);
-                return instr;
-	        }
-
-    };
+    static_assert(rows[static_cast<uint8_t>(Opcode::Op)].alu[1][0] == AluFunc::Sub);
+    static_assert(rows[static_cast<uint8_t>(Opcode::OpImm)].alu[1][0] == AluFunc::Add);
+    static_assert(rows[static_cast<uint8_t>(Opcode::Load)].type[fnLW] == IType::Ld);
+    static_assert(rows[static_cast<uint8_t>(Opcode::MiscMem)].type[0] == IType::Unsupported);
+}
 
+// Table-driven decoder: one table lookup by the opcode, then the register
+// fields and the immediate the row asks for.
+//
+// Decode(Word) goes through a direct-mapped memo of recently decoded words,
+// keyed by the word alone: programs reuse a few encodings heavily (nop,
+// ret, stack adjustments), also in code a PC-keyed cache cannot hold.
+class Decoder
+{
+public:
+    static constexpr size_t defaultCacheEntries = 1024;
 
-    class LuiMaker : public InstructionMaker
+    // entries is rounded up to a power of two; 0 disables the memo
+    explicit Decoder(size_t cacheEntries = defaultCacheEntries)
     {
-        public:
-
-            LuiMaker() : InstructionMaker(Opcode::Lui) {}
-
-            InstructionPtr operator()(DecodedInstr decoded) override
-            {
-                auto instr = GetNewInstraction();
-                 instr->_type = IType::Alu;
-                instr->_aluFunc = AluFunc::Add;
-                instr->_dst = RId(decoded.u.rd);
-                instr->_src1 = 0;
-                instr->_imm = GetimmU(decoded);
-                return instr;
-            }
-    };
+        SetCacheEntries(cacheEntries);
+    }
 
-    class AuipcMaker : public InstructionMaker
+    void SetCacheEntries(size_t entries)
     {
-        public:
-            
-            AuipcMaker() : InstructionMaker(Opcode::Auipc) {}
-
-            InstructionPtr operator()(DecodedInstr decoded) override
-            {
-                auto instr = GetNewInstraction();
-                instr->_type = IType::Auipc;
-                instr->_dst = RId(decoded.u.rd);
-                instr->_imm = GetimmU(decoded);
-                return instr;
-            }
-
-        private:
-    };
+        // Every entry starts as word 0. An entry is only consulted for the
+        // words that map to it, so this never hits for another word.
+        Entry zero;
+        Decode(0, zero.decoded);
+        _cacheBits = 0;
+        while ((size_t(1) << _cacheBits) < entries)
+            _cacheBits++;
+        _cache.assign(entries ? size_t(1) << _cacheBits : 0, zero);
+        cacheHits = 0;
+        cacheMisses = 0;
+    }
 
-    class JalMaker : public InstructionMaker
+    InstructionPtr Decode(Word data)
     {
-        using Imm = int32_t;
-        public:
-            
-            JalMaker() : InstructionMaker(Opcode::Jal){}
-            
-            InstructionPtr operator()(DecodedInstr decoded) override
-            {
-                auto instr = GetNewInstraction();
-                instr->_type = IType::J;
-                instr->_brFunc = BrFunc::AT;
-                instr->_dst = RId(decoded.j.rd);
-                instr->_imm = GetimmJ(decoded);
-                return instr;
-            }
-
-        private:
-    };
+        if (_cache.empty())
+        {
+            auto instr = std::make_unique<Instruction>();
+            Decode(data, *instr);
+            return instr;
+        }
 
+        Entry& entry = _cache[_cacheBits ? (data * 0x9e3779b1u) >> (32u - _cacheBits) : 0];
+        if (entry.word == data)
+        {
+            cacheHits++;
+        }
+        else
+        {
+            cacheMisses++;
+            entry.word = data;
+            Decode(data, entry.decoded);
+        }
+        return std::make_unique<Instruction>(entry.decoded);
+    }
 
-    class JalrMaker : public InstructionMaker
+    size_t CacheEntries() const
     {
-        using Imm = int32_t;
-        public:
-            
-            JalrMaker() : InstructionMaker(Opcode::Jalr) {}
-
-            InstructionPtr operator()(DecodedInstr decoded) override
-            {
-                auto instr = GetNewInstraction();
-                instr->_type = IType::Jr;
-                instr->_brFunc = BrFunc::AT;
-                instr->_dst = RId(decoded.i.rd);
-                instr->_src1 = RId(decoded.i.rs1);
-                instr->_imm = GetimmI(decoded);
-                return instr;
-            }
-    };
-
+        return _cache.size();
+    }
 
-    class BranchMaker : public InstructionMaker
+    double CacheHitRate() const
     {
-        using Imm = int32_t;
-        public:
-            
-            BranchMaker() : InstructionMaker(Opcode::Branch) {}
+        uint64_t lookups = cacheHits + cacheMisses;
+        return lookups ? double(cacheHits) / lookups : 0.0;
+    }
 
-            InstructionPtr operator()(DecodedInstr decoded) override
-            {
-                auto instr = GetNewInstraction();
-                instr->_type = IType::Br;
-                instr->_brFunc = static_cast<BrFunc>(decoded.b.funct3);
-                instr->_src1 = RId(decoded.b.rs1);
-                instr->_src2 = RId(decoded.b.rs2);
-                instr->_imm = GetimmB(decoded);
-                return instr;
-            }
-    };
+    uint64_t cacheHits = 0;
+    uint64_t cacheMisses = 0;
 
-    class LoadMaker : public InstructionMaker
+    // Raw fields of one instruction word. imm is the immediate of the
+    // row's format (0 if it has none); for SYSTEM it is the CSR index.
+    struct Fields
     {
-        using Imm = int32_t;
-        public:
-            
-            LoadMaker() : InstructionMaker(Opcode::Load) {}
-
-            InstructionPtr operator()(DecodedInstr decoded) override
-            {
-                auto instr = GetNewInstraction();
-                instr->_type = decoded.i.funct3 == fnLW ? IType::Ld : IType::Unsupported;
-                instr->_aluFunc = AluFunc::Add;
-                instr->_dst = RId(decoded.i.rd);
-                instr->_src1 = RId(decoded.i.rs1);
-                instr->_imm = GetimmI(decoded);
-                return instr;
-            }
-
+        uint8_t opcode;
+        uint8_t rd;
+        uint8_t funct3;
+        uint8_t rs1;
+        uint8_t rs2;
+        uint8_t funct7;
+        Word imm;
     };
 
-
-    class StoreMaker : public InstructionMaker
+    static Fields Extract(Word data)
     {
-        using Imm = int32_t;
-        public:
-            
-            StoreMaker() : InstructionMaker(Opcode::Store) {}
-
-            InstructionPtr operator()(DecodedInstr decoded) override
-            {
-                auto instr = GetNewInstraction();
-                instr->_type = decoded.i.funct3 == fnSW ? IType::St : IType::Unsupported;
-                instr->_aluFunc = AluFunc::Add;
-                instr->_src1 = RId(decoded.s.rs1);
-                instr->_src2 = RId(decoded.s.rs2);
-                instr->_imm = GetimmS(decoded);
-                return instr;
-            }
-    };
-
+        const DecoderTable::Row& row = DecoderTable::rows[data & 0x7fu];
+        Fields fields{};
+        fields.opcode = data & 0x7fu;
+        fields.rd = (data >> 7u) & 31u;
+        fields.funct3 = (data >> 12u) & 7u;
+        fields.rs1 = (data >> 15u) & 31u;
+        fields.rs2 = (data >> 20u) & 31u;
+        fields.funct7 = data >> 25u;
+        if (row.operands & DecoderTable::Csr)
+            fields.imm = data >> 20u;
+        else
+            fields.imm = Immediate(row.imm[fields.funct3], data).value_or(0);
+        return fields;
+    }
 
-    class SystemMaker : public InstructionMaker
+    // Sets every decoded field of instr, execution results are left alone
+    static void Decode(Word data, Instruction& instr)
     {
-        using Imm = int32_t;
-        public:
-            
-            SystemMaker() : InstructionMaker(Opcode::System) {}
-
-            InstructionPtr operator()(DecodedInstr decoded) override
-            {
-                auto instr = GetNewInstraction();
-                if (decoded.i.funct3 == fnCSRRW && decoded.i.rd == 0)
-                {
-                    instr->_type = IType::Csrw;
-                }
-                else if (decoded.i.funct3 == fnCSRRS && decoded.i.rs1 == 0)
-                {
-                    instr->_type = IType::Csrr;
-                }
-                instr->_dst = RId(decoded.i.rd);
-                instr->_src1 = RId(decoded.i.rs1);
-                instr->_csr = static_cast<CsrIdx>(GetimmI(decoded) & 0xfff);
-                return instr;
-            }
-
-    };
+        Expand(Extract(data), instr);
+    }
 
-    class MiscMemMaker : public InstructionMaker
+    static void Expand(const Fields& fields, Instruction& instr)
     {
-        public:
-            
-            MiscMemMaker() : InstructionMaker(Opcode::MiscMem)
-            {
-            }
-
-            InstructionPtr operator()(DecodedInstr decoded) override
-            {
-                return (*this)();
-            }
-
-            InstructionPtr operator()()
-            {
-                auto instr = GetNewInstraction();
-                instr->_type = IType::Unsupported;
-                instr->_aluFunc = AluFunc::None;
-                instr->_brFunc = BrFunc::NT;
-                return instr;
-            }
-
-    };
-
+        using namespace DecoderTable;
+
+        const Row& row = rows[fields.opcode];
+        unsigned funct3 = fields.funct3;
+        RId rd = fields.rd;
+        RId rs1 = fields.rs1;
+
+        instr._type = row.type[funct3];
+        instr._aluFunc = row.alu[(fields.funct7 >> 5u) & 1u][funct3];
+        instr._brFunc = row.br[funct3];
+
+        // Writes to x0 are dropped
+        instr._dst = (row.operands & Rd) && rd != 0 ? std::optional<RId>(rd) : std::nullopt;
+        if (row.operands & Rs1)
+            instr._src1 = rs1;
+        else if (row.operands & Rs1Zero)
+            instr._src1 = 0;
+        else
+            instr._src1.reset();
+        instr._src2 = row.operands & Rs2 ? std::optional<RId>(fields.rs2) : std::nullopt;
+        instr._imm = row.imm[funct3] != ImmFormat::None ? std::optional<Word>(fields.imm) : std::nullopt;
+
+        if (row.operands & Csr)
+        {
+            if ((instr._type == IType::Csrw && rd != 0) || (instr._type == IType::Csrr && rs1 != 0))
+                instr._type = IType::Unsupported;
+            instr._csr = static_cast<CsrIdx>(fields.imm);
+        }
+        else
+        {
+            instr._csr.reset();
+        }
+    }
 
-    class AmoMaker : public InstructionMaker
+    static constexpr std::optional<Word> Immediate(DecoderTable::ImmFormat format, Word data)
     {
-        public:
-            
-            AmoMaker() : InstructionMaker(Opcode::Amo)
-            {
-            }
-
-            InstructionPtr operator()(DecodedInstr decoded) override
-            {
-                return (*this)();
-            }
-
-            InstructionPtr operator()()
-            {
-                auto instr = GetNewInstraction();
-                instr->_type = IType::Unsupported;
-                instr->_aluFunc = AluFunc::None;
-                instr->_brFunc = BrFunc::NT;
-                return instr;
-            }
+        using DecoderTable::ImmFormat;
 
-    };
+        // All ones if the instruction sign bit is set
+        Word sign = 0u - (data >> 31u);
+        switch (format)
+        {
+            case ImmFormat::I:
+                return sign << 12u | data >> 20u;
+            case ImmFormat::Shamt:
+                return (data >> 20u) & 31u;
+            case ImmFormat::S:
+                return sign << 12u | (data >> 25u) << 5u | ((data >> 7u) & 31u);
+            case ImmFormat::B:
+                return sign << 12u | ((data >> 7u) & 1u) << 11u | ((data >> 25u) & 0x3fu) << 5u
+                       | ((data >> 8u) & 0xfu) << 1u;
+            case ImmFormat::U:
+                return data & 0xfffff000u;
+            case ImmFormat::J:
+                return sign << 20u | ((data >> 12u) & 0xffu) << 12u | ((data >> 20u) & 1u) << 11u
+                       | ((data >> 21u) & 0x3ffu) << 1u;
+            default:
+                return std::nullopt;
+        }
+    }
 
-    class DefaultMaker : public InstructionMaker
+private:
+    struct Entry
     {
-        public:
-            
-            DefaultMaker() : InstructionMaker(Opcode::System)
-            {
-            }
-
-            InstructionPtr operator()(DecodedInstr decoded) override
-            {
-                return (*this)();
-            }
-
-            InstructionPtr operator()()
-            {
-                auto instr = GetNewInstraction();
-                instr->_type = IType::Unsupported;
-                instr->_aluFunc = AluFunc::None;
-                instr->_brFunc = BrFunc::NT;
-                return instr;
-            }
+        Word word = 0;
+        Instruction decoded{};
     };
+
+    std::vector<Entry> _cache;
+    unsigned _cacheBits = 0;
 };
 
 #endif //RISCV_SIM_DECODER_H
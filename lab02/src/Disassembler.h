@@ -0,0 +1,237 @@
+#ifndef RISCV_SIM_DISASSEMBLER_H
+#define RISCV_SIM_DISASSEMBLER_H
+
+#include <cstdio>
+#include <string>
+#include <tuple>
+
+#include "Instruction.h"
+
+// objdump-like text for a raw RV32I encoding; ip is used to print
+// absolute branch and jump targets.
+class Disassembler
+{
+public:
+    static std::string Disassemble(Word word, Word ip = 0)
+    {
+        Word rd = (word >> 7u) & 31u;
+        Word funct3 = (word >> 12u) & 7u;
+        Word rs1 = (word >> 15u) & 31u;
+        Word rs2 = (word >> 20u) & 31u;
+        Word funct7 = word >> 25u;
+        SignedWord immI = static_cast<SignedWord>(word) >> 20;
+        SignedWord immS = (static_cast<SignedWord>(word & 0xfe000000u) >> 20) | static_cast<SignedWord>(rd);
+        SignedWord immB = (static_cast<SignedWord>(word & 0x80000000u) >> 19) | ((word & 0x80u) << 4u)
+                          | ((word >> 20u) & 0x7e0u) | ((word >> 7u) & 0x1eu);
+        SignedWord immJ = (static_cast<SignedWord>(word & 0x80000000u) >> 11) | (word & 0xff000u)
+                          | ((word >> 9u) & 0x800u) | ((word >> 20u) & 0x7feu);
+
+        switch (static_cast<Opcode>(word & 0x7fu))
+        {
+            case Opcode::Lui:
+                return Format("lui %s, 0x%x", Reg(rd), word >> 12u);
+            case Opcode::Auipc:
+                return Format("auipc %s, 0x%x", Reg(rd), word >> 12u);
+            case Opcode::Jal:
+                return Format("jal %s, 0x%x", Reg(rd), ip + immJ);
+            case Opcode::Jalr:
+                if (rd == 0 && rs1 == 1 && immI == 0)
+                    return "ret";
+                return Format("jalr %s, %d(%s)", Reg(rd), immI, Reg(rs1));
+            case Opcode::Branch:
+            {
+                static const char* names[] = {"beq", "bne", nullptr, nullptr, "blt", "bge", "bltu", "bgeu"};
+                if (!names[funct3])
+                    break;
+                return Format("%s %s, %s, 0x%x", names[funct3], Reg(rs1), Reg(rs2), ip + immB);
+            }
+            case Opcode::Load:
+            {
+                static const char* names[] = {"lb", "lh", "lw", nullptr, "lbu", "lhu", nullptr, nullptr};
+                if (!names[funct3])
+                    break;
+                return Format("%s %s, %d(%s)", names[funct3], Reg(rd), immI, Reg(rs1));
+            }
+            case Opcode::Store:
+            {
+                static const char* names[] = {"sb", "sh", "sw", nullptr, nullptr, nullptr, nullptr, nullptr};
+                if (!names[funct3])
+                    break;
+                return Format("%s %s, %d(%s)", names[funct3], Reg(rs2), immS, Reg(rs1));
+            }
+            case Opcode::OpImm:
+            {
+                if (word == 0x00000013u)
+                    return "nop";
+                if (funct3 == 0b001)
+                    return Format("slli %s, %s, %u", Reg(rd), Reg(rs1), rs2);
+                if (funct3 == 0b101)
+                    return Format("%s %s, %s, %u", funct7 ? "srai" : "srli", Reg(rd), Reg(rs1), rs2);
+                static const char* names[] = {"addi", nullptr, "slti", "sltiu", "xori", nullptr, "ori", "andi"};
+                if (funct3 == 0 && immI == 0)
+                    return Format("mv %s, %s", Reg(rd), Reg(rs1));
+                if (funct3 == 0 && rs1 == 0)
+                    return Format("li %s, %d", Reg(rd), immI);
+                return Format("%s %s, %s, %d", names[funct3], Reg(rd), Reg(rs1), immI);
+            }
+            case Opcode::Op:
+            {
+                static const char* names[] = {"add", "sll", "slt", "sltu", "xor", "srl", "or", "and"};
+                const char* name = names[funct3];
+                if (funct7 == 0b0100000 && funct3 == 0b000)
+                    name = "sub";
+                else if (funct7 == 0b0100000 && funct3 == 0b101)
+                    name = "sra";
+                else if (funct7 != 0)
+                    break;
+                return Format("%s %s, %s, %s", name, Reg(rd), Reg(rs1), Reg(rs2));
+            }
+            case Opcode::MiscMem:
+                return funct3 == fnFENCE ? "fence" : "fence.i";
+            case Opcode::System:
+            {
+                Word csr = word >> 20u;
+                if (funct3 == fnPRIV)
+                    return csr == 0 ? "ecall" : csr == 1 ? "ebreak" : Format("system 0x%x", csr);
+                if (funct3 == fnCSRRS && rs1 == 0)
+                    return Format("csrr %s, %s", Reg(rd), Csr(csr).c_str());
+                if (funct3 == fnCSRRW && rd == 0)
+                    return Format("csrw %s, %s", Csr(csr).c_str(), Reg(rs1));
+                static const char* names[] = {nullptr, "csrrw", "csrrs", "csrrc", nullptr, "csrrwi", "csrrsi", "csrrci"};
+                if (!names[funct3])
+                    break;
+                return Format("%s %s, %s, %s", names[funct3], Reg(rd), Csr(csr).c_str(), Reg(rs1));
+            }
+            case Opcode::Amo:
+                return "amo";
+        }
+        return Format(".word 0x%08x", word);
+    }
+
+    static const char* Reg(Word idx)
+    {
+        static const char* names[32] = {
+            "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+            "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+            "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+            "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+        return names[idx & 31u];
+    }
+
+    static std::string Csr(Word csr)
+    {
+        switch (static_cast<CsrIdx>(csr))
+        {
+            case CsrIdx::Instret: return "instret";
+            case CsrIdx::Cycle: return "cycle";
+            case CsrIdx::Time: return "time";
+            case CsrIdx::Instreth: return "instreth";
+            case CsrIdx::Cycleh: return "cycleh";
+            case CsrIdx::Timeh: return "timeh";
+            case CsrIdx::Mcycle: return "mcycle";
+            case CsrIdx::Minstret: return "minstret";
+            case CsrIdx::Mcycleh: return "mcycleh";
+            case CsrIdx::Minstreth: return "minstreth";
+            case CsrIdx::Mhartid: return "mhartid";
+            case CsrIdx::Mtohost: return "mtohost";
+            default: break;
+        }
+
+        static const std::tuple<CsrIdx, const char*, const char*> banks[] = {
+            {CsrIdx::Hpmcounter, "hpmcounter", ""}, {CsrIdx::Hpmcounterh, "hpmcounter", "h"},
+            {CsrIdx::Mhpmcounter, "mhpmcounter", ""}, {CsrIdx::Mhpmcounterh, "mhpmcounter", "h"},
+            {CsrIdx::Mhpmevent, "mhpmevent", ""}};
+        for (const auto& [base, prefix, suffix] : banks)
+        {
+            Word n = csr - static_cast<Word>(base);
+            if (csr >= static_cast<Word>(base) && n >= 3 && n < 32)
+                return Format("%s%u%s", prefix, n, suffix);
+        }
+        return Format("0x%x", csr);
+    }
+
+    static const char* ToString(IType type)
+    {
+        switch (type)
+        {
+            case IType::Unsupported: return "Unsupported";
+            case IType::Alu: return "Alu";
+            case IType::Ld: return "Ld";
+            case IType::St: return "St";
+            case IType::J: return "J";
+            case IType::Jr: return "Jr";
+            case IType::Br: return "Br";
+            case IType::Csrr: return "Csrr";
+            case IType::Csrw: return "Csrw";
+            case IType::Auipc: return "Auipc";
+        }
+        return "?";
+    }
+
+    static const char* ToString(AluFunc func)
+    {
+        switch (func)
+        {
+            case AluFunc::Add: return "Add";
+            case AluFunc::Sll: return "Sll";
+            case AluFunc::Slt: return "Slt";
+            case AluFunc::Sltu: return "Sltu";
+            case AluFunc::Xor: return "Xor";
+            case AluFunc::And: return "And";
+            case AluFunc::Or: return "Or";
+            case AluFunc::Sr: return "Sr";
+            case AluFunc::Sub: return "Sub";
+            case AluFunc::Sra: return "Sra";
+            case AluFunc::Srl: return "Srl";
+            case AluFunc::None: return "None";
+        }
+        return "?";
+    }
+
+    static const char* ToString(BrFunc func)
+    {
+        switch (func)
+        {
+            case BrFunc::Eq: return "Eq";
+            case BrFunc::Neq: return "Neq";
+            case BrFunc::Lt: return "Lt";
+            case BrFunc::Ltu: return "Ltu";
+            case BrFunc::Ge: return "Ge";
+            case BrFunc::Geu: return "Geu";
+            case BrFunc::AT: return "AT";
+            case BrFunc::NT: return "NT";
+        }
+        return "?";
+    }
+
+    static const char* ToString(Opcode opcode)
+    {
+        switch (opcode)
+        {
+            case Opcode::Load: return "Load";
+            case Opcode::MiscMem: return "MiscMem";
+            case Opcode::OpImm: return "OpImm";
+            case Opcode::Auipc: return "Auipc";
+            case Opcode::Store: return "Store";
+            case Opcode::Amo: return "Amo";
+            case Opcode::Op: return "Op";
+            case Opcode::Lui: return "Lui";
+            case Opcode::Branch: return "Branch";
+            case Opcode::Jalr: return "Jalr";
+            case Opcode::Jal: return "Jal";
+            case Opcode::System: return "System";
+        }
+        return nullptr;
+    }
+
+private:
+    template<typename... Args>
+    static std::string Format(const char* format, Args... args)
+    {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), format, args...);
+        return buf;
+    }
+};
+
+#endif //RISCV_SIM_DISASSEMBLER_H
@@ -3,13 +3,17 @@
 #define RISCV_SIM_EXECUTOR_H
 
 #include "Instruction.h"
+#include "Coverage.h"
 #include <memory>
 #include <unordered_map>
 #include <math.h>
 #include <limits>
+#include <stdexcept>
 
 
-class Executor
+// WithCoverage = false compiles the coverage hook out of ChangeAddress
+template <bool WithCoverage = true>
+class BasicExecutor
 {
 public:
     void Execute(InstructionPtr& instr, Word ip)
@@ -17,7 +21,53 @@ public:
         DoAlu(instr, ip);
         ChangeAddress(instr, ip);
     }
+
+    // Records taken control transfers; nullptr (the default) disables it
+    void SetCoverage(EdgeCoverage* coverage)
+    {
+        _coverage = coverage;
+    }
+
+    EdgeCoverage* GetCoverage() const
+    {
+        return _coverage;
+    }
+
+    // Switch forms of GetOperation and GetTransition, for fused pairs
+    static Word Alu(AluFunc func, Word first, Word second)
+    {
+        switch (func)
+        {
+            case AluFunc::Add: return GetAdd(first, second);
+            case AluFunc::Sub: return GetSub(first, second);
+            case AluFunc::And: return GetAnd(first, second);
+            case AluFunc::Or: return GetOr(first, second);
+            case AluFunc::Xor: return GetXor(first, second);
+            case AluFunc::Slt: return GetSlt(first, second);
+            case AluFunc::Sltu: return GetSltu(first, second);
+            case AluFunc::Sll: return GetSll(first, second);
+            case AluFunc::Srl: return GetSrl(first, second);
+            case AluFunc::Sra: return GetSra(first, second);
+            default: throw std::out_of_range("unsupported ALU function");
+        }
+    }
+
+    static bool Taken(BrFunc func, Word first, Word second)
+    {
+        switch (func)
+        {
+            case BrFunc::Eq: return first == second;
+            case BrFunc::Neq: return first != second;
+            case BrFunc::Lt: return GetSlt(first, second);
+            case BrFunc::Ltu: return GetSltu(first, second);
+            case BrFunc::Ge: return !GetSlt(first, second);
+            case BrFunc::Geu: return !GetSltu(first, second);
+            case BrFunc::AT: return true;
+            default: return false;
+        }
+    }
 private:
+    EdgeCoverage* _coverage = nullptr;
 
     void DoAlu(InstructionPtr& instr, Word ip)
     {
@@ -37,7 +87,12 @@ private:
     void ChangeAddress(InstructionPtr& instr, Word ip)
     {
         if(GetTransition.at(instr->_brFunc)(instr) && GetChangeAddress.count(instr->_type))
+        {
             instr->_nextIp = GetChangeAddress.at(instr->_type)(instr, ip);
+            if constexpr (WithCoverage)
+                if(_coverage)
+                    _coverage->Edge(ip, instr->_nextIp);
+        }
         else
             instr->_nextIp = ip + 4;
     }
@@ -217,4 +272,6 @@ private:
     }
 };
 
+using Executor = BasicExecutor<>;
+
 #endif // RISCV_SIM_EXECUTOR_H
@@ -0,0 +1,249 @@
+#ifndef RISCV_SIM_FUZZER_H
+#define RISCV_SIM_FUZZER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <random>
+#include <vector>
+
+#include "Cpu.h"
+#include "DecodeAhead.h"
+#include "Memory.h"
+#include "Simulation.h"
+
+// In-memory copy of a Cpu and its Memory. Taking it clears the Memory
+// dirty bits, so Reset() only copies back the pages written since.
+class Snapshot
+{
+public:
+    Snapshot(Cpu& cpu, Memory& mem)
+        : _ip(cpu.Ip()),
+          _counters(cpu.Csrs().SaveCounters()),
+          _mem(Memory::PageCount() * Memory::pageWords)
+    {
+        for (RId i = 0; i < 32; i++)
+            _regs[i] = cpu.Registers().Get(i);
+        for (size_t page = 0; page < Memory::PageCount(); page++)
+            std::memcpy(&_mem[page * Memory::pageWords], mem.Page(page), Memory::pageBytes);
+        mem.ClearDirty();
+    }
+
+    // Returns the number of pages copied back
+    size_t Reset(Cpu& cpu, Memory& mem) const
+    {
+        size_t pages = 0;
+        for (size_t page = 0; page < Memory::PageCount(); page++)
+        {
+            if (mem.PageDirty(page))
+            {
+                mem.WritePage(page, &_mem[page * Memory::pageWords]);
+                pages++;
+            }
+        }
+        mem.ClearDirty();
+
+        cpu.Reset(_ip);
+        for (RId i = 0; i < 32; i++)
+            cpu.Registers().Set(i, _regs[i]);
+        cpu.Csrs().RestoreCounters(_counters);
+        return pages;
+    }
+
+private:
+    Word _ip;
+    Word _regs[32];
+    CsrFile::Counters _counters;
+    std::vector<Word> _mem;
+};
+
+// Persistent-mode fuzzing. The program runs normally up to its first
+// FuzzInput request, where the state is snapshotted; every input is then
+// injected into the guest buffer (a0, capacity a1) and run to the exit
+// code, after which only the dirtied pages are reset. With edge coverage
+// attached, runs reaching new edges are reported so the caller can keep
+// them as seeds.
+class FuzzSession
+{
+public:
+    struct Result
+    {
+        std::optional<int> exitCode;    // empty on timeout or if no input was requested
+        bool consumedInput = false;
+        bool newCoverage = false;       // reached an edge no earlier run did
+    };
+
+    // maxInstructions bounds every run, to catch hangs
+    FuzzSession(Cpu& cpu, Memory& mem, uint64_t maxInstructions)
+        : _cpu(cpu),
+          _mem(mem),
+          _sim(cpu),
+          _maxInstructions(maxInstructions)
+    {
+        _sim.SetQuiet(true);
+        _sim.SetInputHook([this]() {
+            HelperStopped stopped(_ahead);
+            Inject();
+        });
+    }
+
+    // Makes runs report new edges; the map is cleared before every run
+    void SetCoverage(EdgeCoverage* coverage)
+    {
+        _coverage = coverage;
+        _cpu.SetCoverage(coverage);
+    }
+
+    // Makes the Cpu decode ahead; the helper is stopped while the session
+    // resets or writes the guest memory. Not owned
+    void SetDecodeAhead(DecodeAhead* ahead)
+    {
+        _ahead = ahead;
+        _cpu.SetDecodeAhead(ahead);
+    }
+
+    Result Run(const std::vector<uint8_t>& input)
+    {
+        // The previous run ended without asking for an input
+        if (runs && !_snapshot)
+            return Result();
+
+        auto start = std::chrono::steady_clock::now();
+        {
+            HelperStopped stopped(_ahead);
+            if (_snapshot)
+                pagesReset += _snapshot->Reset(_cpu, _mem);
+            _input = &input;
+            _consumed = false;
+            if (_snapshot)
+                Inject();
+        }
+        if (_coverage)
+            _coverage->Clear();
+
+        Result result;
+        result.exitCode = _sim.RunUntil(_cpu.InstructionsRetired() + _maxInstructions);
+        result.consumedInput = _consumed;
+        if (_coverage)
+            result.newCoverage = _coverage->MergeInto(_seen);
+
+        runs++;
+        if (!result.exitCode)
+            timeouts++;
+        else
+            exitCodes[result.exitCode.value()]++;
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    // Random bit flips, byte replacements, insertions and deletions
+    static std::vector<uint8_t> Mutate(const std::vector<uint8_t>& input, std::mt19937& rng, size_t maxSize)
+    {
+        std::vector<uint8_t> out = input;
+        int mutations = 1 + static_cast<int>(rng() % 4);
+        for (int i = 0; i < mutations; i++)
+        {
+            switch (rng() % 4)
+            {
+                case 0:
+                    if (!out.empty())
+                        out[rng() % out.size()] ^= static_cast<uint8_t>(1u << (rng() % 8));
+                    break;
+                case 1:
+                    if (!out.empty())
+                        out[rng() % out.size()] = static_cast<uint8_t>(rng());
+                    break;
+                case 2:
+                    if (out.size() < maxSize)
+                        out.insert(out.begin() + rng() % (out.size() + 1), static_cast<uint8_t>(rng()));
+                    break;
+                default:
+                    if (!out.empty())
+                        out.erase(out.begin() + rng() % out.size());
+                    break;
+            }
+        }
+        return out;
+    }
+
+    void Report(std::ostream& out) const
+    {
+        out << "fuzz: runs=" << runs << " timeouts=" << timeouts;
+        if (_coverage)
+            out << " edges=" << std::count(_seen.begin(), _seen.end(), 1);
+        out
+            << std::fixed << std::setprecision(2)
+            << " pages-reset/run=" << (runs ? double(pagesReset) / runs : 0.0)
+            << std::setprecision(0)
+            << " runs/s=" << (seconds > 0 ? runs / seconds : 0.0)
+            << std::defaultfloat;
+        for (const auto& [code, count] : exitCodes)
+            out << " exit[" << code << "]=" << count;
+        out << std::endl;
+    }
+
+    uint64_t runs = 0;
+    uint64_t timeouts = 0;
+    uint64_t pagesReset = 0;
+    double seconds = 0;
+    std::map<int, uint64_t> exitCodes;
+
+private:
+    // Stops a running decode-ahead helper for the host writes to the guest
+    // memory of its scope, which would race its reads
+    class HelperStopped
+    {
+    public:
+        explicit HelperStopped(DecodeAhead* ahead)
+            : _ahead(ahead && ahead->Running() ? ahead : nullptr)
+        {
+            if (_ahead)
+                _ahead->Stop();
+        }
+
+        ~HelperStopped()
+        {
+            if (_ahead)
+                _ahead->Start();
+        }
+
+        HelperStopped(const HelperStopped&) = delete;
+        HelperStopped& operator=(const HelperStopped&) = delete;
+
+    private:
+        DecodeAhead* _ahead;
+    };
+
+    void Inject()
+    {
+        if (!_snapshot)
+            _snapshot.emplace(_cpu, _mem);
+
+        constexpr size_t memBytes = Memory::WordCount() * sizeof(Word);
+        Word buffer = _cpu.Registers().Get(10);
+        size_t count = std::min<size_t>(_input ? _input->size() : 0, _cpu.Registers().Get(11));
+        count = buffer < memBytes ? std::min(count, memBytes - buffer) : 0;
+        if (count)
+            _mem.StoreBytes(buffer, _input->data(), count);
+        _cpu.Registers().Set(11, static_cast<Word>(count));
+        _consumed = true;
+    }
+
+    Cpu& _cpu;
+    Memory& _mem;
+    Simulation _sim;
+    uint64_t _maxInstructions;
+    std::optional<Snapshot> _snapshot;
+    const std::vector<uint8_t>* _input = nullptr;
+    bool _consumed = false;
+    EdgeCoverage* _coverage = nullptr;
+    DecodeAhead* _ahead = nullptr;
+    std::vector<uint8_t> _seen;
+};
+
+#endif //RISCV_SIM_FUZZER_H
@@ -0,0 +1,206 @@
+#ifndef RISCV_SIM_HOSTCOUNTERS_H
+#define RISCV_SIM_HOSTCOUNTERS_H
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Host hardware counters (perf_event_open) around simulation regions.
+// Counts are attributed to the execution engine named in Begin() and
+// normalised by the guest instructions retired in that region. Counters
+// the host does not provide (no PMU, container, perf_event_paranoid) are
+// reported as n/a; wall time is always available. The counters are opened
+// separately, so one the PMU cannot provide does not take the others with
+// it; when the kernel multiplexes them each count is scaled by the share
+// of the region it was actually running.
+class HostCounters
+{
+public:
+    enum Counter
+    {
+        Cycles,
+        Instructions,
+        BranchMisses,
+        L1dMisses,
+        LlcMisses,
+        CounterCount
+    };
+
+    HostCounters()
+    {
+        _fds.fill(-1);
+#ifndef __linux__
+        _error = "not supported on this host";
+#else
+        Open(Cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        Open(Instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        Open(BranchMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        Open(L1dMisses, PERF_TYPE_HW_CACHE,
+             PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+        Open(LlcMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+    }
+
+    ~HostCounters()
+    {
+#ifdef __linux__
+        for (int fd : _fds)
+            if (fd >= 0)
+                close(fd);
+#endif
+    }
+
+    HostCounters(const HostCounters&) = delete;
+    HostCounters& operator=(const HostCounters&) = delete;
+
+    bool Available(Counter counter) const
+    {
+        return _fds[counter] >= 0;
+    }
+
+    bool AnyAvailable() const
+    {
+        for (int fd : _fds)
+            if (fd >= 0)
+                return true;
+        return false;
+    }
+
+    // Starts a region for `engine`; guestRetired is the guest instruction
+    // count at this point. An open region is closed first.
+    void Begin(const std::string& engine, uint64_t guestRetired)
+    {
+        if (_engine)
+            End(guestRetired);
+        _engine = &_regions[engine];
+        _startRetired = guestRetired;
+        _startTime = std::chrono::steady_clock::now();
+        for (int i = 0; i < CounterCount; i++)
+            Read(static_cast<Counter>(i), _start[i]);
+    }
+
+    void End(uint64_t guestRetired)
+    {
+        if (!_engine)
+            return;
+        for (int i = 0; i < CounterCount; i++)
+        {
+            Sample end;
+            if (!Read(static_cast<Counter>(i), end))
+                continue;
+            // Enabled but never running: nothing to scale from
+            uint64_t running = end.running - _start[i].running;
+            if (running)
+                _engine->counts[i] += static_cast<uint64_t>(
+                    static_cast<double>(end.value - _start[i].value) * (end.enabled - _start[i].enabled) / running);
+        }
+        _engine->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - _startTime).count();
+        _engine->guest += guestRetired - _startRetired;
+        _engine = nullptr;
+    }
+
+    void Report(std::ostream& out) const
+    {
+        static const char* names[CounterCount] = {"cycles", "instructions", "branch-misses", "l1d-misses", "llc-misses"};
+
+        if (!AnyAvailable())
+            out << "host: hardware counters unavailable (" << _error << "), reporting wall time only" << std::endl;
+
+        for (const auto& [engine, region] : _regions)
+        {
+            double guest = region.guest ? static_cast<double>(region.guest) : 1.0;
+            out << "host[" << engine << "]: guest-instructions=" << region.guest
+                << std::fixed << std::setprecision(3)
+                << " seconds=" << region.seconds
+                << " ns/instr=" << region.seconds * 1e9 / guest
+                << " mips=" << (region.seconds > 0 ? region.guest / region.seconds / 1e6 : 0.0);
+            for (int i = 0; i < CounterCount; i++)
+            {
+                out << ' ' << names[i] << "/instr=";
+                if (Available(static_cast<Counter>(i)))
+                    out << region.counts[i] / guest;
+                else
+                    out << "n/a";
+            }
+            out << std::defaultfloat << std::endl;
+        }
+    }
+
+private:
+    struct Region
+    {
+        std::array<uint64_t, CounterCount> counts{};
+        double seconds = 0;
+        uint64_t guest = 0;
+    };
+
+    // Layout of read() with PERF_FORMAT_TOTAL_TIME_ENABLED | _RUNNING
+    struct Sample
+    {
+        uint64_t value = 0;
+        uint64_t enabled = 0;   // ns the counter was enabled
+        uint64_t running = 0;   // ns it was on the PMU
+    };
+
+#ifdef __linux__
+    void Open(Counter counter, uint32_t type, uint64_t config)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd < 0)
+        {
+            if (_error.empty())
+                _error = std::string("perf_event_open: ") + std::strerror(errno);
+            return;
+        }
+        _fds[counter] = fd;
+    }
+#endif
+
+    // False if the counter is not available; one that fails to read is
+    // closed and reported as n/a from then on
+    bool Read(Counter counter, Sample& sample)
+    {
+#ifdef __linux__
+        if (_fds[counter] < 0)
+            return false;
+        if (read(_fds[counter], &sample, sizeof(sample)) == sizeof(sample))
+            return true;
+        if (_error.empty())
+            _error = std::string("read: ") + std::strerror(errno);
+        close(_fds[counter]);
+        _fds[counter] = -1;
+#endif
+        return false;
+    }
+
+    std::array<int, CounterCount> _fds;
+    std::array<Sample, CounterCount> _start{};
+    std::map<std::string, Region> _regions;
+    Region* _engine = nullptr;
+    uint64_t _startRetired = 0;
+    std::chrono::steady_clock::time_point _startTime;
+    std::string _error;
+};
+
+#endif //RISCV_SIM_HOSTCOUNTERS_H
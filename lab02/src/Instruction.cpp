@@ -4,4 +4,4 @@
 constexpr unsigned maxInstructionInFlight = 8;
 
 template <>
-PoolAllocator<Instruction> PoolAllocated<Instruction>::allocator{maxInstructionInFlight};
\ No newline at end of file
+thread_local PoolAllocator<Instruction> PoolAllocated<Instruction>::allocator{maxInstructionInFlight};
\ No newline at end of file
@@ -29,9 +29,45 @@ enum class CsrIdx : RId
 {
     Instret = 0xc02,
     Cycle   = 0xc00,
+    Time    = 0xc01,
     Mhartid = 0xf10,
     Mtohost = 0x780,
     None    = 0xfff,
+
+    // High halves of the 64-bit counters
+    Instreth = 0xc82,
+    Cycleh   = 0xc80,
+    Timeh    = 0xc81,
+
+    // Machine mode (writable) aliases
+    Mcycle    = 0xb00,
+    Minstret  = 0xb02,
+    Mcycleh   = 0xb80,
+    Minstreth = 0xb82,
+
+    // Counter banks: index 3..31 is added to the base
+    Hpmcounter   = 0xc00,
+    Hpmcounterh  = 0xc80,
+    Mhpmcounter  = 0xb00,
+    Mhpmcounterh = 0xb80,
+    Mhpmevent    = 0x320,
+};
+
+// Event selectors for mhpmevent3..31
+enum class HpmEvent : uint8_t
+{
+    None          = 0,
+    Loads         = 1,
+    Stores        = 2,
+    Branches      = 3,
+    TakenBranches = 4,
+    Jumps         = 5,
+    // Following ones need a timing model attached to the Cpu
+    ICacheMisses  = 6,
+    DCacheMisses  = 7,
+    Mispredicts   = 8,
+    LoadUseStalls = 9,
+    Count,
 };
 
 // LR, SC, FENCE not implemented
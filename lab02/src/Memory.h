@@ -3,21 +3,36 @@
 #define RISCV_SIM_DATAMEMORY_H
 
 #include "Instruction.h"
+#include "Symbols.h"
 #include <iostream>
 #include <fstream>
 #include <elf.h>
 #include <cstring>
 #include <vector>
+#include <array>
+#include <algorithm>
 
 class Memory
 {
 public:
+    static constexpr size_t pageBytes = 4096;
+    static constexpr size_t pageWords = pageBytes / sizeof(Word);
+
+    // Executable PT_LOAD segment
+    struct Segment
+    {
+        Word addr;
+        Word bytes;
+    };
+
     Memory()
     {
         mem.fill(0);
+        dirty.fill(0);
     }
 
-    bool LoadElf(const std::string& elf_filename)
+    // If symbols is given, code symbols from .symtab are added to it
+    bool LoadElf(const std::string& elf_filename, SymbolTable* symbols = nullptr)
     {
         std::ifstream elffile;
         elffile.open(elf_filename, std::ios::in | std::ios::binary);
@@ -58,28 +73,100 @@ public:
 
         if (e_ident[EI_CLASS] == ELFCLASS32) {
             // 32-bit ELF
-            return this->load_elf_specific<Elf32_Ehdr, Elf32_Phdr>(buf.data(), buf_sz);
+            return this->load_elf_specific<Elf32_Ehdr, Elf32_Phdr>(buf.data(), buf_sz)
+                && (!symbols || this->load_symbols<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym>(buf.data(), buf_sz, *symbols));
         } else if (e_ident[EI_CLASS] == ELFCLASS64) {
             // 64-bit ELF
-            return this->load_elf_specific<Elf64_Ehdr, Elf64_Phdr>(buf.data(), buf_sz);
+            return this->load_elf_specific<Elf64_Ehdr, Elf64_Phdr>(buf.data(), buf_sz)
+                && (!symbols || this->load_symbols<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym>(buf.data(), buf_sz, *symbols));
         } else {
             std::cerr << "ERROR: load_elf: file is neither 32-bit nor 64-bit" << std::endl;
             return false;
         }
     }
-    Word Request(Word ip)
+    Word Request(Word ip) const
     {
         return mem[ToWordAddr(ip)];
     }
 
+    // Request() for a thread other than the one running the Cpu: a relaxed
+    // atomic load. It relies on word stores (Store(), guest sw) being single
+    // aligned 32-bit stores, which GCC and Clang do not split on the hosts
+    // the simulator builds for; the bulk writes (LoadElf, StoreBytes,
+    // WritePage, ZeroPage) must not run meanwhile.
+    Word SharedRequest(Word ip) const
+    {
+        return __atomic_load_n(&mem[ToWordAddr(ip)], __ATOMIC_RELAXED);
+    }
+
     void Request(InstructionPtr& instr)
     {
         if (instr->_type == IType::Ld)
             instr->_data = mem[ToWordAddr(instr->_addr)];
         else if (instr->_type == IType::St)
-            mem[ToWordAddr(instr->_addr)] = instr->_data;
+            Store(instr->_addr, instr->_data);
+    }
+
+    // Host-side access for loaders and tests, bypasses the Cpu
+    void Store(Word addr, Word data)
+    {
+        mem[ToWordAddr(addr)] = data;
+        MarkDirty(ToWordAddr(addr) / pageWords);
+    }
+
+    // Byte-granular host write, e.g. to inject an input buffer
+    void StoreBytes(Word addr, const uint8_t* data, size_t count)
+    {
+        if (count == 0)
+            return;
+        std::memcpy(reinterpret_cast<uint8_t*>(mem.data()) + addr, data, count);
+        MarkDirty(addr / pageBytes, (addr + count - 1) / pageBytes);
+    }
+
+    // Pages written since construction or the last ClearDirty(), including
+    // the ones filled by LoadElf. A page that is not dirty is all zeroes
+    // unless ClearDirty() was called on a non-empty image.
+    static constexpr size_t PageCount() { return size / pageWords; }
+
+    bool PageDirty(size_t page) const
+    {
+        return dirty[page / 64] & (uint64_t(1) << (page % 64));
+    }
+
+    const Word* Page(size_t page) const
+    {
+        return &mem[page * pageWords];
+    }
+
+    // Overwrites a whole page and marks it dirty
+    void WritePage(size_t page, const Word* data)
+    {
+        std::memcpy(&mem[page * pageWords], data, pageBytes);
+        MarkDirty(page);
+    }
+
+    void ZeroPage(size_t page)
+    {
+        std::memset(&mem[page * pageWords], 0, pageBytes);
     }
 
+    void ClearDirty()
+    {
+        dirty.fill(0);
+    }
+
+    // Executable segments of the ELF files loaded so far, clipped to the memory
+    const std::vector<Segment>& TextSegments() const
+    {
+        return text;
+    }
+
+    // Memory size in 4-byte words, i.e. the number of instruction slots
+    static constexpr size_t WordCount() { return size; }
+
+    // Dense index of the instruction slot holding ip
+    static constexpr size_t Slot(Word ip) { return ToWordAddr(ip) % size; }
+
 private:
     template <typename Elf_Ehdr, typename Elf_Phdr>
     bool load_elf_specific(char* buf, size_t buf_sz) {
@@ -109,20 +196,75 @@ private:
                     // start of memory: phdr[i].p_paddr
                     std::memcpy(memptr + phdr[i].p_paddr, buf + phdr[i].p_offset, phdr[i].p_filesz);
                 }
+                MarkDirty(phdr[i].p_paddr / pageBytes, (phdr[i].p_paddr + phdr[i].p_memsz - 1) / pageBytes);
                 if (phdr[i].p_memsz > phdr[i].p_filesz) {
                     // copy 0's to fill up remaining memory
                     size_t zeros_sz = phdr[i].p_memsz - phdr[i].p_filesz;
                     std::memset(memptr + phdr[i].p_paddr + phdr[i].p_filesz, 0, zeros_sz);
                 }
+                if ((phdr[i].p_flags & PF_X) && phdr[i].p_paddr < size * sizeof(Word)) {
+                    Word end = std::min<uint64_t>(phdr[i].p_paddr + phdr[i].p_memsz, size * sizeof(Word));
+                    text.push_back(Segment{static_cast<Word>(phdr[i].p_paddr), end - static_cast<Word>(phdr[i].p_paddr)});
+                }
+            }
+        }
+        return true;
+    }
+
+
+    template <typename Elf_Ehdr, typename Elf_Shdr, typename Elf_Sym>
+    bool load_symbols(char* buf, size_t buf_sz, SymbolTable& symbols) {
+        Elf_Ehdr *ehdr = (Elf_Ehdr*) buf;
+        if (ehdr->e_shoff == 0 || ehdr->e_shnum == 0)
+            return true; // stripped, nothing to do
+        if (buf_sz < ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf_Shdr)) {
+            std::cerr << "ERROR: load_elf: file too small for expected number of section headers" << std::endl;
+            return false;
+        }
+        Elf_Shdr *shdr = (Elf_Shdr*) (buf + ehdr->e_shoff);
+        for (int i = 0 ; i < ehdr->e_shnum ; i++) {
+            if (shdr[i].sh_type != SHT_SYMTAB || shdr[i].sh_link >= ehdr->e_shnum)
+                continue;
+            const Elf_Shdr& strtab = shdr[shdr[i].sh_link];
+            if (shdr[i].sh_offset + shdr[i].sh_size > buf_sz || strtab.sh_offset + strtab.sh_size > buf_sz) {
+                std::cerr << "ERROR: load_elf: symbol table overflow" << std::endl;
+                return false;
+            }
+            Elf_Sym *sym = (Elf_Sym*) (buf + shdr[i].sh_offset);
+            size_t count = shdr[i].sh_size / sizeof(Elf_Sym);
+            for (size_t j = 0 ; j < count ; j++) {
+                // keep functions and labels that live in executable sections
+                unsigned type = ELF32_ST_TYPE(sym[j].st_info);
+                if ((type != STT_FUNC && type != STT_NOTYPE) || sym[j].st_shndx == SHN_UNDEF
+                    || sym[j].st_shndx >= ehdr->e_shnum || !(shdr[sym[j].st_shndx].sh_flags & SHF_EXECINSTR)
+                    || sym[j].st_name >= strtab.sh_size)
+                    continue;
+                const char* name = buf + strtab.sh_offset + sym[j].st_name;
+                if (*name == 0)
+                    continue;
+                int priority = (type == STT_FUNC ? 2 : 0) + (ELF32_ST_BIND(sym[j].st_info) == STB_GLOBAL ? 1 : 0);
+                symbols.Add(sym[j].st_value, sym[j].st_size, name, priority);
             }
         }
         return true;
     }
 
+    void MarkDirty(size_t page)
+    {
+        dirty[page / 64] |= uint64_t(1) << (page % 64);
+    }
+
+    void MarkDirty(size_t first, size_t last)
+    {
+        for (size_t page = first; page <= last && page < PageCount(); page++)
+            MarkDirty(page);
+    }
 
-    static Word ToWordAddr(Word ip) { return ip >> 2u; }
+    static constexpr Word ToWordAddr(Word ip) { return ip >> 2u; }
     static constexpr size_t size = 128*1024; // memory size in 4-byte words
     std::array<Word, size> mem;
+    std::array<uint64_t, (size / pageWords + 63) / 64> dirty; // one bit per page
+    std::vector<Segment> text;
 };
 
 #endif //RISCV_SIM_DATAMEMORY_H
@@ -0,0 +1,421 @@
+#ifndef RISCV_SIM_MICROOPS_H
+#define RISCV_SIM_MICROOPS_H
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "CsrFile.h"
+#include "Decoder.h"
+#include "Executor.h"
+#include "Memory.h"
+#include "RegisterFile.h"
+
+// Micro-op of a compiled block. Register 0 as dst means no write.
+enum class UopKind : uint8_t
+{
+    Const,      // dst = imm
+    Alu,        // dst = src1 alu src2
+    AluImm,     // dst = src1 alu imm
+    Load,       // dst = [src1 + imm]
+    Store,      // [src1 + imm] = src2
+    // Terminators, only last in a block
+    Branch,     // to imm if src1 br src2, else to the fall-through
+    Jump,       // dst = link, to imm
+    JumpReg,    // dst = link, to src1 + imm
+};
+
+struct Uop
+{
+    UopKind kind = UopKind::Const;
+    AluFunc alu = AluFunc::Add;
+    BrFunc br = BrFunc::NT;
+    RId dst = 0;
+    RId src1 = 0;
+    RId src2 = 0;
+    Word imm = 0;
+    Word link = 0;
+};
+
+// Straight-line run of instructions starting at start, lowered to micro-ops.
+// It stops after a control transfer, before an instruction it cannot lower
+// (CSR accesses, unsupported ones) and after maxInstructions.
+struct UopBlock
+{
+    static constexpr size_t maxInstructions = 64;
+
+    Word start = 0;
+    std::vector<Word> words;    // the block is stale once memory differs
+    std::vector<Uop> ops;
+    Word fallThrough = 0;       // ip after the block unless a terminator jumps
+    Word stopWord = 0;          // word at fallThrough if lowering stopped there
+    size_t lowered = 0;         // micro-ops before the passes
+
+    size_t Instructions() const
+    {
+        return words.size();
+    }
+
+    static UopBlock Lower(const Memory& mem, Word start)
+    {
+        UopBlock block;
+        block.start = start;
+        Instruction instr{};
+        for (Word ip = start; block.words.size() < maxInstructions; ip += 4)
+        {
+            Word word = mem.Request(ip);
+            Decoder::Decode(word, instr);
+            std::optional<Uop> op = LowerOne(instr, ip);
+            if (!op)
+            {
+                block.stopWord = word;
+                break;
+            }
+            block.words.push_back(word);
+            block.ops.push_back(op.value());
+            if (op->kind >= UopKind::Branch)
+                break;
+        }
+        block.fallThrough = start + 4 * static_cast<Word>(block.words.size());
+        block.lowered = block.ops.size();
+        return block;
+    }
+
+private:
+    static std::optional<Uop> LowerOne(const Instruction& instr, Word ip)
+    {
+        Uop op;
+        op.alu = instr._aluFunc;
+        op.br = instr._brFunc;
+        op.dst = instr._dst.value_or(0);
+        op.src1 = instr._src1.value_or(0);
+        op.src2 = instr._src2.value_or(0);
+        op.imm = instr._imm.value_or(0);
+        op.link = ip + 4;
+        switch (instr._type)
+        {
+            case IType::Alu:
+                op.kind = instr._imm ? UopKind::AluImm : UopKind::Alu;
+                return op;
+            case IType::Auipc:
+                op.kind = UopKind::Const;
+                op.imm = ip + op.imm;
+                return op;
+            case IType::Ld:
+                op.kind = UopKind::Load;
+                return op;
+            case IType::St:
+                op.kind = UopKind::Store;
+                return op;
+            case IType::Br:
+                op.kind = UopKind::Branch;
+                op.imm = ip + op.imm;
+                return op;
+            case IType::J:
+                op.kind = UopKind::Jump;
+                op.imm = ip + op.imm;
+                return op;
+            case IType::Jr:
+                op.kind = UopKind::JumpReg;
+                return op;
+            default:
+                return std::nullopt;
+        }
+    }
+};
+
+// Optimisations on one block. The architectural state at the end of the
+// block is unchanged; state in the middle of it is not kept, so a block only
+// runs as a whole. Every register is live at the end of a block.
+namespace UopPasses
+{
+    inline bool WritesOnly(const Uop& op)
+    {
+        return op.kind == UopKind::Const || op.kind == UopKind::Alu || op.kind == UopKind::AluImm
+               || op.kind == UopKind::Load;
+    }
+
+    // Operations of instructions with rd = x0 (nop, loads into x0): the
+    // decoder leaves them without a destination, which LowerOne turns into
+    // dst 0, so they only cost a dispatch
+    inline void DropX0Writes(UopBlock& block)
+    {
+        auto& ops = block.ops;
+        ops.erase(std::remove_if(ops.begin(), ops.end(), [](const Uop& op) {
+            return WritesOnly(op) && op.dst == 0;
+        }), ops.end());
+    }
+
+    // Folds operations on registers of known value, starting from LUI, AUIPC
+    // and x0, into constants, immediate operands and absolute addresses.
+    // A branch on constants becomes a jump or falls through.
+    inline void PropagateConstants(UopBlock& block)
+    {
+        std::array<std::optional<Word>, 32> known;
+        known[0] = 0;
+        std::vector<Uop> ops;
+        for (Uop op : block.ops)
+        {
+            auto& src1 = known[op.src1];
+            auto& src2 = known[op.src2];
+            switch (op.kind)
+            {
+                case UopKind::Alu:
+                    if (src2)
+                    {
+                        op.kind = UopKind::AluImm;
+                        op.imm = src2.value();
+                    }
+                    else
+                    {
+                        break;
+                    }
+                    [[fallthrough]];
+                case UopKind::AluImm:
+                    if (src1)
+                    {
+                        op.kind = UopKind::Const;
+                        op.imm = Executor::Alu(op.alu, src1.value(), op.imm);
+                    }
+                    break;
+                case UopKind::Load:
+                case UopKind::Store:
+                    if (src1 && op.src1 != 0)
+                    {
+                        op.imm += src1.value();
+                        op.src1 = 0;
+                    }
+                    break;
+                case UopKind::Branch:
+                    if (src1 && src2)
+                    {
+                        if (!Executor::Taken(op.br, src1.value(), src2.value()))
+                            continue;
+                        op.kind = UopKind::Jump;
+                        op.dst = 0;
+                    }
+                    break;
+                case UopKind::JumpReg:
+                    if (src1)
+                    {
+                        op.kind = UopKind::Jump;
+                        op.imm += src1.value();
+                    }
+                    break;
+                default:
+                    break;
+            }
+            if (op.dst)
+                known[op.dst] = op.kind == UopKind::Const ? std::optional<Word>(op.imm) : std::nullopt;
+            ops.push_back(op);
+        }
+        block.ops = std::move(ops);
+    }
+
+    // Redundant address computation: a load or store whose base register
+    // was set to `reg + k` earlier in the block uses reg directly, as long
+    // as reg still holds the same value
+    inline void FoldAddresses(UopBlock& block)
+    {
+        struct Offset
+        {
+            RId base;
+            Word offset;
+        };
+        std::array<std::optional<Offset>, 32> offsets;
+        for (Uop& op : block.ops)
+        {
+            if ((op.kind == UopKind::Load || op.kind == UopKind::Store) && offsets[op.src1])
+            {
+                op.imm += offsets[op.src1]->offset;
+                op.src1 = offsets[op.src1]->base;
+            }
+            if (!op.dst)
+                continue;
+            for (auto& offset : offsets)
+                if (offset && offset->base == op.dst)
+                    offset.reset();
+            if (op.kind == UopKind::AluImm && op.alu == AluFunc::Add && op.src1 != op.dst)
+                offsets[op.dst] = offsets[op.src1] ? Offset{offsets[op.src1]->base, offsets[op.src1]->offset + op.imm}
+                                                   : Offset{op.src1, op.imm};
+            else
+                offsets[op.dst].reset();
+        }
+    }
+
+    // Writes overwritten later in the block before being read
+    inline void DropDeadWrites(UopBlock& block)
+    {
+        std::bitset<32> live;
+        live.set();
+        std::vector<Uop> ops;
+        for (auto it = block.ops.rbegin(); it != block.ops.rend(); ++it)
+        {
+            const Uop& op = *it;
+            if (WritesOnly(op) && !live[op.dst])
+                continue;
+            if (op.dst)
+                live[op.dst] = false;
+            switch (op.kind)
+            {
+                case UopKind::Alu:
+                case UopKind::Store:
+                case UopKind::Branch:
+                    live[op.src1] = live[op.src2] = true;
+                    break;
+                case UopKind::AluImm:
+                case UopKind::Load:
+                case UopKind::JumpReg:
+                    live[op.src1] = true;
+                    break;
+                default:
+                    break;
+            }
+            ops.push_back(op);
+        }
+        block.ops.assign(ops.rbegin(), ops.rend());
+    }
+
+    inline void Run(UopBlock& block)
+    {
+        DropX0Writes(block);
+        PropagateConstants(block);
+        FoldAddresses(block);
+        DropDeadWrites(block);
+    }
+}
+
+// Compiles the block starting at an ip the first time it is reached and
+// runs its micro-ops with a switch per op, in place of the decode, register
+// read, execute and write-back of every instruction. A block is checked
+// against memory on every entry and compiled again if it changed; stores
+// into the block that is running take effect at its next entry.
+class UopEngine
+{
+public:
+    // Runs the block at ip if its instructions fit in budget; false if the
+    // Cpu has to take this instruction. A taken terminator is recorded in
+    // coverage like the Executor records it.
+    bool Run(Word& ip, RegisterFile& rf, Memory& mem, CsrFile& csrf, uint64_t budget,
+             EdgeCoverage* coverage = nullptr)
+    {
+        UopBlock& block = Get(ip, mem);
+        if (!block.Instructions() || block.Instructions() > budget)
+            return false;
+
+        Word nextIp = block.fallThrough;
+        bool taken = false;
+        for (const Uop& op : block.ops)
+        {
+            switch (op.kind)
+            {
+                case UopKind::Const:
+                    rf.Set(op.dst, op.imm);
+                    break;
+                case UopKind::Alu:
+                    rf.Set(op.dst, Executor::Alu(op.alu, rf.Get(op.src1), rf.Get(op.src2)));
+                    break;
+                case UopKind::AluImm:
+                    rf.Set(op.dst, Executor::Alu(op.alu, rf.Get(op.src1), op.imm));
+                    break;
+                case UopKind::Load:
+                    rf.Set(op.dst, mem.Request(rf.Get(op.src1) + op.imm));
+                    break;
+                case UopKind::Store:
+                    mem.Store(rf.Get(op.src1) + op.imm, rf.Get(op.src2));
+                    break;
+                case UopKind::Branch:
+                    if (Executor::Taken(op.br, rf.Get(op.src1), rf.Get(op.src2)))
+                    {
+                        nextIp = op.imm;
+                        taken = true;
+                    }
+                    break;
+                case UopKind::Jump:
+                    nextIp = op.imm;
+                    taken = true;
+                    if (op.dst)
+                        rf.Set(op.dst, op.link);
+                    break;
+                case UopKind::JumpReg:
+                    nextIp = rf.Get(op.src1) + op.imm;
+                    taken = true;
+                    if (op.dst)
+                        rf.Set(op.dst, op.link);
+                    break;
+            }
+        }
+        // Terminators are the last instruction of the block
+        if (taken && coverage)
+            coverage->Edge(block.start + 4 * Word(block.Instructions() - 1), nextIp);
+        csrf.Retire(block.Instructions());
+        ip = nextIp;
+        executed++;
+        retired += block.Instructions();
+        return true;
+    }
+
+    void Clear()
+    {
+        _blocks.clear();
+    }
+
+    size_t Blocks() const
+    {
+        return _blocks.size();
+    }
+
+    void Report(std::ostream& out) const
+    {
+        size_t instructions = 0;
+        size_t lowered = 0;
+        size_t ops = 0;
+        for (const auto& [ip, block] : _blocks)
+        {
+            instructions += block.Instructions();
+            lowered += block.lowered;
+            ops += block.ops.size();
+        }
+        out << "uop-blocks: blocks=" << _blocks.size() << " instructions=" << instructions
+            << " uops=" << lowered << " optimized-uops=" << ops << " executed=" << executed
+            << " retired=" << retired << " recompiled=" << recompiled << std::endl;
+    }
+
+    uint64_t executed = 0;
+    uint64_t retired = 0;       // instructions retired by blocks
+    uint64_t recompiled = 0;    // blocks found changed in memory
+
+private:
+    UopBlock& Get(Word ip, const Memory& mem)
+    {
+        auto [it, inserted] = _blocks.try_emplace(ip);
+        UopBlock& block = it->second;
+        if (!inserted && Current(block, mem))
+            return block;
+        if (!inserted)
+            recompiled++;
+        block = UopBlock::Lower(mem, ip);
+        UopPasses::Run(block);
+        return block;
+    }
+
+    static bool Current(const UopBlock& block, const Memory& mem)
+    {
+        // An empty block is kept until its first instruction changes
+        if (block.words.empty())
+            return mem.Request(block.start) == block.stopWord;
+        for (size_t i = 0; i < block.words.size(); i++)
+            if (mem.Request(block.start + 4 * static_cast<Word>(i)) != block.words[i])
+                return false;
+        return true;
+    }
+
+    std::unordered_map<Word, UopBlock> _blocks;
+};
+
+#endif //RISCV_SIM_MICROOPS_H
@@ -0,0 +1,288 @@
+#ifndef RISCV_SIM_OPTIONS_H
+#define RISCV_SIM_OPTIONS_H
+
+#include <charconv>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+
+// Command line of riscv_sim: riscv_sim [options] [elf-file]
+// Without arguments it runs the file "program" in the current directory.
+struct Options
+{
+    std::string program = "program";
+    std::optional<std::string> traceFile;
+    std::optional<std::string> timingConfig;
+    bool profile = false;
+    size_t profileTop = 20;
+    uint64_t samplePeriod = 0;
+    std::string foldedFile = "profile.folded";
+    std::optional<std::string> callgraphFile;
+    bool hostCounters = false;
+    bool roi = false;
+    uint64_t smartsPeriod = 0;
+    uint64_t smartsUnit = 1000;
+    uint64_t smartsWarmup = 2000;
+    std::optional<std::string> bbvFile;
+    uint64_t bbvInterval = 100000;
+    size_t simpoints = 0;
+    std::optional<std::string> checkpointFile;
+    uint64_t checkpointAt = 0;
+    std::optional<std::string> restoreFile;
+    uint64_t timeParallel = 0;
+    uint64_t timeParallelWarmup = 10000;
+    unsigned threads = 0;
+    std::optional<std::string> fuzzCorpus;
+    uint64_t fuzzRuns = 0;
+    uint64_t fuzzTimeout = 1000000;
+    std::optional<std::string> fuzzCrashes;
+    bool coverage = false;
+    bool predecode = false;
+    bool fuse = false;
+    bool uops = false;
+    bool decodeAhead = false;
+    std::optional<std::string> spmdInputs;
+    std::optional<size_t> decodeCache;
+
+    static void Usage(std::ostream& out)
+    {
+        out << "usage: riscv_sim [options] [elf-file]\n"
+            << "  --trace <file>      record a retired instruction trace for riscv_replay\n"
+            << "  --timing <config>   attach a timing model, e.g. \"icache.size=8K bpred.bht=512\"\n"
+            << "  --profile           count executed instructions and print a hot-spot table\n"
+            << "  --profile-top <n>   number of hot-spot rows to print (default 20)\n"
+            << "  --sample <n>        sample the guest call stack every n instructions\n"
+            << "  --folded <file>     folded stacks output for --sample (default profile.folded)\n"
+            << "  --callgraph <file>  write a callgrind-format call-graph profile\n"
+            << "  --host-counters     report host cycles, branch and cache misses per guest instruction\n"
+            << "  --roi               run functionally outside ROI_BEGIN/ROI_END, detailed inside\n"
+            << "  --smarts <k>        sampled timing: measure one unit every k units, warm caches in between\n"
+            << "  --smarts-unit <n>   instructions per measured unit (default 1000)\n"
+            << "  --smarts-warmup <n> detailed warm-up instructions before each unit (default 2000)\n"
+            << "  --bbv <file>        write basic-block vectors in SimPoint .bb format\n"
+            << "  --bbv-interval <n>  instructions per basic-block vector (default 100000)\n"
+            << "  --simpoints <k>     cluster the vectors into at most k phases, write <file>.simpoints/.weights\n"
+            << "  --checkpoint <file> save the Cpu and dirty Memory pages after --checkpoint-at instructions\n"
+            << "  --checkpoint-at <n> instruction count of the checkpoint (default 0, before the first one)\n"
+            << "  --restore <file>    start from a checkpoint instead of the ELF entry point\n"
+            << "  --time-parallel <n> functional pass with a checkpoint every n instructions, then the\n"
+            << "                      intervals run the --timing model in parallel (other instruments are ignored)\n"
+            << "  --tp-warmup <n>     cache and predictor warm-up before each interval (default 10000)\n"
+            << "  --threads <n>       host threads for --time-parallel (default: all)\n"
+            << "  --fuzz <dir>        persistent fuzzing: snapshot at FUZZ_INPUT, run every file in dir as input\n"
+            << "  --fuzz-runs <n>     random mutations of the corpus to run afterwards\n"
+            << "  --fuzz-timeout <n>  instruction limit of one fuzzing run (default 1000000)\n"
+            << "  --fuzz-crashes <dir> save inputs that fail or time out\n"
+            << "  --coverage          AFL-style edge coverage map (shared memory under afl-fuzz),\n"
+            << "                      guides the --fuzz mutations\n"
+            << "  --predecode         decode the executable ELF segments once at load time\n"
+            << "  --fuse              run common instruction pairs (lui+addi, auipc+jalr, auipc+lw,\n"
+            << "                      ALU op + branch) as one step, implies --predecode\n"
+            << "  --uops              compile basic blocks to optimised micro-ops and run those\n"
+            << "  --decode-ahead      fetch and decode along the predicted path on a helper thread,\n"
+            << "                      off with --predecode or a single host thread\n"
+            << "  --spmd <dir>        run the program on every file in dir as input (see --fuzz), 8 inputs\n"
+            << "                      at a time in lockstep SIMD lanes; --fuzz-timeout bounds every run\n"
+            << "  --decode-cache <n>  entries of the decoder memo, rounded up to a power of two (0 disables,\n"
+            << "                      default 1024), reports its hit rate\n"
+            << "  --help              show this message\n";
+    }
+
+    bool NeedSymbols() const
+    {
+        return samplePeriod || callgraphFile;
+    }
+
+    // Parses the value of option arg into out; false if it is missing (the
+    // error is already printed) or not a number
+    template<typename T>
+    static bool ParseNumber(const std::string& arg, const std::optional<std::string>& value, T& out)
+    {
+        if (!value)
+            return false;
+        const char* end = value->data() + value->size();
+        auto [ptr, error] = std::from_chars(value->data(), end, out);
+        if (error != std::errc() || ptr != end || value->empty())
+        {
+            std::cerr << "ERROR: option " << arg << " expects a number" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Returns false if the command line is malformed or help was requested
+    bool Parse(int argc, char** argv)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::optional<std::string> {
+                if (i + 1 >= argc)
+                {
+                    std::cerr << "ERROR: option " << arg << " requires a value" << std::endl;
+                    return std::nullopt;
+                }
+                return std::string(argv[++i]);
+            };
+
+            if (arg == "--help" || arg == "-h")
+            {
+                Usage(std::cerr);
+                return false;
+            }
+            else if (arg == "--trace")
+            {
+                if (!(traceFile = value()))
+                    return false;
+            }
+            else if (arg == "--timing")
+            {
+                if (!(timingConfig = value()))
+                    return false;
+            }
+            else if (arg == "--profile")
+            {
+                profile = true;
+            }
+            else if (arg == "--profile-top")
+            {
+                if (!ParseNumber(arg, value(), profileTop))
+                    return false;
+                profile = true;
+            }
+            else if (arg == "--sample")
+            {
+                if (!ParseNumber(arg, value(), samplePeriod))
+                    return false;
+            }
+            else if (arg == "--folded")
+            {
+                auto file = value();
+                if (!file)
+                    return false;
+                foldedFile = file.value();
+            }
+            else if (arg == "--callgraph")
+            {
+                if (!(callgraphFile = value()))
+                    return false;
+            }
+            else if (arg == "--host-counters")
+            {
+                hostCounters = true;
+            }
+            else if (arg == "--roi")
+            {
+                roi = true;
+            }
+            else if (arg == "--smarts" || arg == "--smarts-unit" || arg == "--smarts-warmup")
+            {
+                uint64_t& target = arg == "--smarts" ? smartsPeriod : arg == "--smarts-unit" ? smartsUnit : smartsWarmup;
+                if (!ParseNumber(arg, value(), target))
+                    return false;
+            }
+            else if (arg == "--bbv")
+            {
+                if (!(bbvFile = value()))
+                    return false;
+            }
+            else if (arg == "--bbv-interval" || arg == "--simpoints")
+            {
+                bool parsed = arg == "--bbv-interval" ? ParseNumber(arg, value(), bbvInterval)
+                                                      : ParseNumber(arg, value(), simpoints);
+                if (!parsed)
+                    return false;
+            }
+            else if (arg == "--checkpoint")
+            {
+                if (!(checkpointFile = value()))
+                    return false;
+            }
+            else if (arg == "--checkpoint-at")
+            {
+                if (!ParseNumber(arg, value(), checkpointAt))
+                    return false;
+            }
+            else if (arg == "--restore")
+            {
+                if (!(restoreFile = value()))
+                    return false;
+            }
+            else if (arg == "--time-parallel" || arg == "--tp-warmup" || arg == "--threads")
+            {
+                bool parsed = arg == "--time-parallel" ? ParseNumber(arg, value(), timeParallel)
+                              : arg == "--tp-warmup"   ? ParseNumber(arg, value(), timeParallelWarmup)
+                                                       : ParseNumber(arg, value(), threads);
+                if (!parsed)
+                    return false;
+            }
+            else if (arg == "--fuzz")
+            {
+                if (!(fuzzCorpus = value()))
+                    return false;
+            }
+            else if (arg == "--coverage")
+            {
+                coverage = true;
+            }
+            else if (arg == "--predecode")
+            {
+                predecode = true;
+            }
+            else if (arg == "--fuse")
+            {
+                predecode = true;
+                fuse = true;
+            }
+            else if (arg == "--uops")
+            {
+                uops = true;
+            }
+            else if (arg == "--decode-ahead")
+            {
+                decodeAhead = true;
+            }
+            else if (arg == "--spmd")
+            {
+                if (!(spmdInputs = value()))
+                    return false;
+            }
+            else if (arg == "--decode-cache")
+            {
+                size_t entries = 0;
+                if (!ParseNumber(arg, value(), entries))
+                    return false;
+                decodeCache = entries;
+            }
+            else if (arg == "--fuzz-crashes")
+            {
+                if (!(fuzzCrashes = value()))
+                    return false;
+            }
+            else if (arg == "--fuzz-runs" || arg == "--fuzz-timeout")
+            {
+                if (!ParseNumber(arg, value(), arg == "--fuzz-runs" ? fuzzRuns : fuzzTimeout))
+                    return false;
+            }
+            else if (arg.rfind("--", 0) == 0)
+            {
+                std::cerr << "ERROR: unknown option " << arg << std::endl;
+                Usage(std::cerr);
+                return false;
+            }
+            else
+            {
+                program = arg;
+            }
+        }
+        if (simpoints && !bbvFile)
+        {
+            std::cerr << "ERROR: --simpoints requires --bbv" << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif //RISCV_SIM_OPTIONS_H
@@ -0,0 +1,103 @@
+#ifndef RISCV_SIM_PARALLEL_H
+#define RISCV_SIM_PARALLEL_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs func(i) for i in [0, count) on up to `threads` host threads.
+// Work is strided, so neighbouring indices go to different threads.
+// The first exception thrown by any worker is rethrown to the caller.
+template<typename Func>
+void ParallelFor(size_t count, unsigned threads, Func func)
+{
+    if (threads <= 1 || count <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            func(i);
+        return;
+    }
+
+    std::exception_ptr error;
+    std::mutex errorLock;
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads && t < count; t++)
+    {
+        workers.emplace_back([&, t]() {
+            try
+            {
+                for (size_t i = t; i < count; i += threads)
+                    func(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(errorLock);
+                if (!error)
+                    error = std::current_exception();
+            }
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// Lock-free ring for one producer and one consumer thread, holding up to
+// Capacity - 1 items. Only the consumer reads and pops, only the producer
+// pushes.
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+public:
+    bool Push(const T& item)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) % Capacity;
+        if (next == _head.load(std::memory_order_acquire))
+            return false;
+        _items[tail] = item;
+        _tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Oldest item, nullptr if there is none
+    T* Front()
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire))
+            return nullptr;
+        return &_items[head];
+    }
+
+    void Pop()
+    {
+        _head.store((_head.load(std::memory_order_relaxed) + 1) % Capacity, std::memory_order_release);
+    }
+
+    size_t Size() const
+    {
+        size_t head = _head.load(std::memory_order_acquire);
+        size_t tail = _tail.load(std::memory_order_acquire);
+        return (tail + Capacity - head) % Capacity;
+    }
+
+private:
+    // On separate cache lines, each is written by one side only
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _tail{0};
+    std::array<T, Capacity> _items;
+};
+
+inline unsigned HostThreads()
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    return threads ? threads : 1;
+}
+
+#endif //RISCV_SIM_PARALLEL_H
@@ -116,7 +116,9 @@ public:
         return allocator.deallocate(ptr, size);
     }
 private:
-    static PoolAllocator<T> allocator;
+    // One pool per host thread: chunks are never returned to malloc, so a
+    // chunk freed on another thread simply migrates to that thread's pool.
+    static thread_local PoolAllocator<T> allocator;
 };
 
 #endif //RISCV_SIM_POOLALLOCATOR_H
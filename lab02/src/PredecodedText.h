@@ -0,0 +1,285 @@
+#ifndef RISCV_SIM_PREDECODEDTEXT_H
+#define RISCV_SIM_PREDECODEDTEXT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+#include "BatchDecoder.h"
+#include "Memory.h"
+
+// Side table with the decoded fields of every word of the executable
+// segments, built in one BatchDecoder pass after LoadElf. Every entry keeps
+// the word it was decoded from: a fetch returning a different word (self
+// modifying code, host writes) falls back to the Decoder, so the table
+// never has to be invalidated.
+//
+// The same pass finds the basic blocks statically: segment starts, the
+// targets of Br and J, and the instructions after Br, J and Jr lead a block.
+// Jr targets are not known, so the blocks are a lower bound on what runs.
+//
+// With fusion enabled it also pairs adjacent instructions into macro-ops
+// the Cpu runs in one step: lui+addi, auipc+jalr, auipc+lw and an ALU
+// result tested by the next branch. A pair is keyed by the address of its
+// first instruction, so a jump to the second one runs that one alone.
+class PredecodedText
+{
+public:
+    enum class Fusion : uint8_t
+    {
+        None,
+        LuiAddi,    // rd = imm; rd2 = rd + offset
+        AuipcJalr,  // rd = ip + imm; rd2 = ip + 8, jump to rd + offset
+        AuipcLw,    // rd = ip + imm; rd2 = [rd + offset]
+        AluBranch,  // rd = src1 op src2/imm; branch on brSrc1, brSrc2 to ip + 4 + offset
+    };
+
+    struct FusedPair
+    {
+        Fusion kind = Fusion::None;
+        Word second = 0;            // word at ip + 4 the pair was made from
+        RId rd = 0;                 // written by the first instruction, never x0
+        RId rd2 = 0;                // written by the second one, x0 if dropped
+        Word imm = 0;               // of the first instruction
+        Word offset = 0;            // immediate of the second instruction
+        AluFunc alu = AluFunc::Add;
+        RId src1 = 0;
+        std::optional<RId> src2;    // imm is the operand if empty
+        BrFunc br = BrFunc::NT;
+        RId brSrc1 = 0;
+        RId brSrc2 = 0;
+    };
+
+    // Takes effect at the next Build()
+    void EnableFusion(bool enable)
+    {
+        _fusion = enable;
+    }
+
+    bool FusionEnabled() const
+    {
+        return _fusion;
+    }
+
+    void Build(const Memory& mem, BatchDecoder::Isa isa = BatchDecoder::Best())
+    {
+        _segments.clear();
+        _targets.clear();
+        _blocks = 0;
+        _pairs = 0;
+        for (const auto& text : mem.TextSegments())
+        {
+            Segment segment;
+            segment.base = text.addr & ~3u;
+            size_t count = (text.addr + text.bytes - segment.base + 3) / 4;
+            for (size_t i = 0; i < count; i++)
+                segment.words.push_back(mem.Request(segment.base + 4 * static_cast<Word>(i)));
+            BatchDecoder::Decode(segment.words.data(), count, segment.decoded, isa);
+            segment.leaders.assign(count, false);
+            if (count)
+                segment.leaders[0] = true;
+            _segments.push_back(std::move(segment));
+        }
+        for (auto& segment : _segments)
+        {
+            FindLeaders(segment);
+            if (_fusion)
+                FindPairs(segment);
+        }
+        for (const auto& segment : _segments)
+            _blocks += std::count(segment.leaders.begin(), segment.leaders.end(), true);
+
+        std::sort(_targets.begin(), _targets.end());
+        _targets.erase(std::unique(_targets.begin(), _targets.end()), _targets.end());
+    }
+
+    // The instruction at ip, given the word the Cpu fetched from there
+    InstructionPtr Decode(Word ip, Word word)
+    {
+        auto instr = std::make_unique<Instruction>();
+        const Segment* segment = Find(ip);
+        size_t i = segment ? (ip - segment->base) / 4 : 0;
+        if (segment && segment->words[i] == word)
+        {
+            segment->decoded.Expand(i, *instr);
+            hits++;
+        }
+        else
+        {
+            Decoder::Decode(word, *instr);
+            misses++;
+        }
+        return instr;
+    }
+
+    // The pair starting at ip if both of its words are still those it was
+    // made from, nullptr otherwise
+    const FusedPair* Fused(Word ip, Word word, const Memory& mem)
+    {
+        const Segment* segment = Find(ip);
+        if (!segment || segment->pairs.empty())
+            return nullptr;
+        size_t i = (ip - segment->base) / 4;
+        const FusedPair& pair = segment->pairs[i];
+        if (pair.kind == Fusion::None || segment->words[i] != word || mem.Request(ip + 4) != pair.second)
+            return nullptr;
+        fused++;
+        return &pair;
+    }
+
+    bool Contains(Word ip) const
+    {
+        return Find(ip) != nullptr;
+    }
+
+    bool Leader(Word ip) const
+    {
+        const Segment* segment = Find(ip);
+        return segment && segment->leaders[(ip - segment->base) / 4];
+    }
+
+    // Static Br and J targets inside the segments, sorted
+    const std::vector<Word>& BranchTargets() const
+    {
+        return _targets;
+    }
+
+    size_t Blocks() const
+    {
+        return _blocks;
+    }
+
+    size_t Words() const
+    {
+        size_t words = 0;
+        for (const auto& segment : _segments)
+            words += segment.words.size();
+        return words;
+    }
+
+    void Report(std::ostream& out) const
+    {
+        out << "predecode: segments=" << _segments.size() << " words=" << Words()
+            << " blocks=" << _blocks << " branch-targets=" << _targets.size()
+            << " hits=" << hits << " misses=" << misses;
+        if (_fusion)
+            out << " fused-pairs=" << _pairs << " fused=" << fused;
+        out << std::endl;
+    }
+
+    // Pairs found by Build()
+    size_t FusedPairs() const
+    {
+        return _pairs;
+    }
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;    // outside the segments or changed since Build()
+    uint64_t fused = 0;     // pairs run as one step
+
+private:
+    struct Segment
+    {
+        Word base;
+        std::vector<Word> words;
+        DecodedWords decoded;
+        std::vector<bool> leaders;
+        std::vector<FusedPair> pairs;   // by first instruction, empty without fusion
+    };
+
+    const Segment* Find(Word ip) const
+    {
+        for (const auto& segment : _segments)
+            if (ip - segment.base < 4 * segment.words.size() && ip % 4 == 0)
+                return &segment;
+        return nullptr;
+    }
+
+    // Marks the blocks starting after the control transfers of segment and
+    // at their static targets
+    void FindLeaders(Segment& segment)
+    {
+        size_t count = segment.words.size();
+        Instruction instr{};
+        for (size_t i = 0; i < count; i++)
+        {
+            segment.decoded.Expand(i, instr);
+            if (instr._type != IType::Br && instr._type != IType::J && instr._type != IType::Jr)
+                continue;
+            if (i + 1 < count)
+                segment.leaders[i + 1] = true;
+            if (instr._type == IType::Jr)
+                continue;
+
+            Word target = segment.base + 4 * static_cast<Word>(i) + instr._imm.value();
+            for (auto& other : _segments)
+            {
+                if (target - other.base < 4 * other.words.size() && target % 4 == 0)
+                {
+                    other.leaders[(target - other.base) / 4] = true;
+                    _targets.push_back(target);
+                }
+            }
+        }
+    }
+
+    void FindPairs(Segment& segment)
+    {
+        size_t count = segment.words.size();
+        segment.pairs.assign(count, FusedPair{});
+        for (size_t i = 0; i + 1 < count; i++)
+        {
+            Instruction first{};
+            Instruction second{};
+            segment.decoded.Expand(i, first);
+            segment.decoded.Expand(i + 1, second);
+            FusedPair& pair = segment.pairs[i];
+            pair.kind = Match(static_cast<Opcode>(segment.decoded.opcode[i]),
+                              static_cast<Opcode>(segment.decoded.opcode[i + 1]), first, second);
+            if (pair.kind == Fusion::None)
+                continue;
+
+            pair.second = segment.words[i + 1];
+            pair.rd = first._dst.value();
+            pair.rd2 = second._dst.value_or(0);
+            pair.imm = first._imm.value_or(0);
+            pair.offset = second._imm.value_or(0);
+            pair.alu = first._aluFunc;
+            pair.src1 = first._src1.value_or(0);
+            pair.src2 = first._src2;
+            pair.br = second._brFunc;
+            pair.brSrc1 = second._src1.value_or(0);
+            pair.brSrc2 = second._src2.value_or(0);
+            _pairs++;
+        }
+    }
+
+    // The second instruction must read the register the first one writes
+    static Fusion Match(Opcode op1, Opcode op2, const Instruction& first, const Instruction& second)
+    {
+        if (!first._dst)
+            return Fusion::None;
+        RId rd = first._dst.value();
+        bool reads = second._src1 == rd || second._src2 == rd;
+        if (op1 == Opcode::Lui && op2 == Opcode::OpImm && second._aluFunc == AluFunc::Add && second._src1 == rd)
+            return Fusion::LuiAddi;
+        if (op1 == Opcode::Auipc && second._type == IType::Jr && second._src1 == rd)
+            return Fusion::AuipcJalr;
+        if (op1 == Opcode::Auipc && second._type == IType::Ld && second._src1 == rd)
+            return Fusion::AuipcLw;
+        if ((op1 == Opcode::OpImm || op1 == Opcode::Op) && first._type == IType::Alu
+            && second._type == IType::Br && reads)
+            return Fusion::AluBranch;
+        return Fusion::None;
+    }
+
+    std::vector<Segment> _segments;
+    std::vector<Word> _targets;
+    size_t _blocks = 0;
+    size_t _pairs = 0;
+    bool _fusion = false;
+};
+
+#endif //RISCV_SIM_PREDECODEDTEXT_H
@@ -0,0 +1,122 @@
+#ifndef RISCV_SIM_PROFILER_H
+#define RISCV_SIM_PROFILER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+#include "Disassembler.h"
+#include "Memory.h"
+#include "RetireListener.h"
+
+// Flat execution profile: instruction counts per Opcode, IType, AluFunc,
+// BrFunc and per instruction slot. All counters are dense arrays, so the
+// per-instruction cost is a handful of increments.
+class Profiler : public RetireListener
+{
+public:
+    Profiler()
+        : _pcCounts(Memory::WordCount(), 0)
+    {
+    }
+
+    void OnRetire(const Instruction& instr, Word ip, Word word) override
+    {
+        _pcCounts[Memory::Slot(ip)]++;
+        _opcodeCounts[word & 0x7fu]++;
+        _itypeCounts[static_cast<size_t>(instr._type)]++;
+        if (instr._type == IType::Alu)
+            _aluCounts[static_cast<size_t>(instr._aluFunc)]++;
+        else if (instr._type == IType::Br || instr._type == IType::J || instr._type == IType::Jr)
+            _brCounts[static_cast<size_t>(instr._brFunc)]++;
+        _total++;
+    }
+
+    uint64_t Total() const
+    {
+        return _total;
+    }
+
+    uint64_t Count(Word ip) const
+    {
+        return _pcCounts[Memory::Slot(ip)];
+    }
+
+    // mem is only used to fetch the encodings for the disassembly column
+    void Report(std::ostream& out, Memory& mem, size_t top) const
+    {
+        out << "profile: " << _total << " instructions" << std::endl;
+
+        out << "  by Opcode:" << std::endl;
+        for (size_t i = 0; i < _opcodeCounts.size(); i++)
+        {
+            const char* name = Disassembler::ToString(static_cast<Opcode>(i));
+            if (_opcodeCounts[i])
+                Line(out, name ? name : "unknown", _opcodeCounts[i]);
+        }
+
+        out << "  by IType:" << std::endl;
+        for (size_t i = 0; i < _itypeCounts.size(); i++)
+            if (_itypeCounts[i])
+                Line(out, Disassembler::ToString(static_cast<IType>(i)), _itypeCounts[i]);
+
+        out << "  by AluFunc:" << std::endl;
+        for (size_t i = 0; i < _aluCounts.size(); i++)
+            if (_aluCounts[i])
+                Line(out, Disassembler::ToString(static_cast<AluFunc>(i)), _aluCounts[i]);
+
+        out << "  by BrFunc:" << std::endl;
+        for (size_t i = 0; i < _brCounts.size(); i++)
+            if (_brCounts[i])
+                Line(out, Disassembler::ToString(static_cast<BrFunc>(i)), _brCounts[i]);
+
+        std::vector<size_t> slots;
+        for (size_t slot = 0; slot < _pcCounts.size(); slot++)
+            if (_pcCounts[slot])
+                slots.push_back(slot);
+        std::stable_sort(slots.begin(), slots.end(),
+                         [this](size_t a, size_t b) { return _pcCounts[a] > _pcCounts[b]; });
+
+        out << "  hot spots (top " << std::min(top, slots.size()) << " of " << slots.size() << " pcs):" << std::endl;
+        out << "  " << std::setw(12) << "count" << std::setw(8) << "%" << "  " << std::setw(8) << "pc"
+            << "  " << std::setw(8) << "word" << "  disassembly" << std::endl;
+        for (size_t i = 0; i < slots.size() && i < top; i++)
+        {
+            Word ip = static_cast<Word>(slots[i] * 4);
+            Word word = mem.Request(ip);
+            out << "  " << std::setw(12) << _pcCounts[slots[i]]
+                << std::setw(7) << std::fixed << std::setprecision(2) << Percent(_pcCounts[slots[i]]) << "%"
+                << "  " << std::hex << std::setfill('0') << std::setw(8) << ip
+                << "  " << std::setw(8) << word << std::dec << std::setfill(' ')
+                << "  " << Disassembler::Disassemble(word, ip) << std::endl;
+        }
+    }
+
+private:
+    static constexpr size_t itypeCount = static_cast<size_t>(IType::Auipc) + 1;
+    static constexpr size_t aluFuncCount = static_cast<size_t>(AluFunc::None) + 1;
+    static constexpr size_t brFuncCount = static_cast<size_t>(BrFunc::NT) + 1;
+
+    double Percent(uint64_t count) const
+    {
+        return _total ? 100.0 * count / _total : 0.0;
+    }
+
+    void Line(std::ostream& out, const char* name, uint64_t count) const
+    {
+        out << "    " << std::left << std::setw(12) << name << std::right << std::setw(12) << count
+            << std::setw(7) << std::fixed << std::setprecision(2) << Percent(count) << "%" << std::endl;
+    }
+
+    std::vector<uint64_t> _pcCounts;
+    std::array<uint64_t, 128> _opcodeCounts{};
+    std::array<uint64_t, itypeCount> _itypeCounts{};
+    std::array<uint64_t, aluFuncCount> _aluCounts{};
+    std::array<uint64_t, brFuncCount> _brCounts{};
+    uint64_t _total = 0;
+};
+
+#endif //RISCV_SIM_PROFILER_H
@@ -4,6 +4,8 @@
 
 #include "Instruction.h"
 
+#include <array>
+
 class RegisterFile
 {
 public:
@@ -25,6 +27,18 @@ public:
         if (instr->_dst)
             _r.at(instr->_dst.value()) = instr->_data;
     }
+
+    Word Get(RId idx) const
+    {
+        return _r.at(idx);
+    }
+
+    // Writes to x0 are ignored
+    void Set(RId idx, Word value)
+    {
+        if (idx != 0)
+            _r.at(idx) = value;
+    }
 private:
     std::array<Word, 32> _r;
 };
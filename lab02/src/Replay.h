@@ -0,0 +1,67 @@
+#ifndef RISCV_SIM_REPLAY_H
+#define RISCV_SIM_REPLAY_H
+
+#include <algorithm>
+#include <vector>
+
+#include "Decoder.h"
+#include "Parallel.h"
+#include "TimingModel.h"
+#include "Trace.h"
+
+// Feeds a recorded trace into any number of timing models without
+// functional execution. Trace blocks are decompressed and decoded in
+// parallel, then every model consumes the batch on its own thread.
+class ReplayEngine
+{
+public:
+    ReplayEngine(const TraceReader& reader, unsigned threads = HostThreads())
+        : _reader(reader), _threads(threads ? threads : 1)
+    {
+    }
+
+    void Run(std::vector<TimingModel>& models)
+    {
+        size_t batch = _threads * 2;
+        std::vector<std::vector<TraceRecord>> records;
+        std::vector<std::vector<TimingEvent>> events;
+
+        for (size_t first = 0; first < _reader.BlockCount(); first += batch)
+        {
+            size_t count = std::min(batch, _reader.BlockCount() - first);
+            records.resize(count);
+            events.resize(count);
+
+            ParallelFor(count, _threads, [&](size_t i) {
+                _reader.DecodeBlock(first + i, records[i]);
+                ToEvents(records[i], events[i]);
+            });
+
+            ParallelFor(models.size(), _threads, [&](size_t m) {
+                for (const auto& blockEvents : events)
+                    for (const auto& event : blockEvents)
+                        models[m].Process(event);
+            });
+        }
+    }
+
+    static void ToEvents(const std::vector<TraceRecord>& records, std::vector<TimingEvent>& events)
+    {
+        Decoder decoder;
+        events.resize(records.size());
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            const TraceRecord& record = records[i];
+            auto instr = decoder.Decode(record.word);
+            instr->_nextIp = record.nextIp;
+            instr->_addr = record.addr;
+            events[i] = TimingEvent::FromInstruction(*instr, record.ip);
+        }
+    }
+
+private:
+    const TraceReader& _reader;
+    unsigned _threads;
+};
+
+#endif //RISCV_SIM_REPLAY_H
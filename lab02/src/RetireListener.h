@@ -0,0 +1,16 @@
+#ifndef RISCV_SIM_RETIRELISTENER_H
+#define RISCV_SIM_RETIRELISTENER_H
+
+#include "Instruction.h"
+
+// Observer notified by Cpu after every executed instruction.
+// ip is the address of the instruction, word is its raw encoding.
+class RetireListener
+{
+public:
+    virtual ~RetireListener() = default;
+
+    virtual void OnRetire(const Instruction& instr, Word ip, Word word) = 0;
+};
+
+#endif //RISCV_SIM_RETIRELISTENER_H
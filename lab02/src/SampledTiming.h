@@ -0,0 +1,177 @@
+#ifndef RISCV_SIM_SAMPLEDTIMING_H
+#define RISCV_SIM_SAMPLEDTIMING_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+
+#include "RetireListener.h"
+#include "TimingModel.h"
+
+struct SamplingConfig
+{
+    uint64_t unit = 1000;       // instructions in one measured sampling unit
+    uint64_t warmup = 2000;     // detailed instructions before each unit, not measured
+    uint64_t period = 100;      // one unit is measured every `period` units
+    double confidence = 0.997;  // two-sided confidence level of the reported interval
+};
+
+// SMARTS-style systematic sampling of a TimingModel. Most instructions
+// only warm the caches and predictor (functional warming); every
+// `period * unit` instructions a short window runs the detailed model:
+// `warmup` instructions to settle the pipeline state, then `unit`
+// measured instructions. The whole-program CPI is estimated from the
+// per-unit CPIs with a confidence interval.
+class SampledTiming : public RetireListener
+{
+public:
+    SampledTiming(TimingModel& model, const SamplingConfig& config = SamplingConfig())
+        : _model(model),
+          _config(config)
+    {
+        if (config.unit == 0 || config.period == 0)
+            throw std::invalid_argument("sampling: unit and period must be positive");
+        _periodLength = std::max(config.unit * config.period, config.unit + config.warmup);
+        _detailedStart = _periodLength - config.unit - config.warmup;
+        _measureStart = _periodLength - config.unit;
+    }
+
+    void Process(const TimingEvent& event)
+    {
+        if (_pos < _detailedStart)
+        {
+            _model.Warm(event);
+        }
+        else
+        {
+            if (_pos == _measureStart)
+                _unitStart = _model.cycles;
+            _model.Process(event);
+            _detailed++;
+        }
+
+        total++;
+        if (++_pos == _periodLength)
+        {
+            AddSample(double(_model.cycles - _unitStart) / _config.unit);
+            _pos = 0;
+        }
+    }
+
+    void OnRetire(const Instruction& instr, Word ip, Word /*word*/) override
+    {
+        Process(TimingEvent::FromInstruction(instr, ip));
+    }
+
+    uint64_t Samples() const
+    {
+        return _samples;
+    }
+
+    double Cpi() const
+    {
+        return _samples ? _sum / _samples : 0.0;
+    }
+
+    double StdDev() const
+    {
+        if (_samples < 2)
+            return 0.0;
+        double mean = Cpi();
+        return std::sqrt(std::max(0.0, (_sumSq - _samples * mean * mean) / (_samples - 1)));
+    }
+
+    // Half-width of the confidence interval around Cpi()
+    double Interval() const
+    {
+        if (_samples < 2)
+            return 0.0;
+        return Z(_config.confidence) * StdDev() / std::sqrt(double(_samples));
+    }
+
+    // Sampling units needed for a relative error of `error` at the
+    // configured confidence, from the variation observed so far
+    uint64_t RequiredSamples(double error) const
+    {
+        double mean = Cpi();
+        if (mean <= 0 || error <= 0)
+            return 0;
+        double n = Z(_config.confidence) * StdDev() / (mean * error);
+        return static_cast<uint64_t>(std::ceil(n * n));
+    }
+
+    void Report(std::ostream& out) const
+    {
+        double cpi = Cpi();
+        double interval = Interval();
+        out << "sampling[" << _model.GetConfig().name << "]:"
+            << " instructions=" << total
+            << " detailed=" << _detailed
+            << " samples=" << _samples
+            << std::fixed << std::setprecision(4)
+            << " cpi=" << cpi << " +- " << interval
+            << std::setprecision(1)
+            << " (" << _config.confidence * 100 << "%, +-" << (cpi > 0 ? interval / cpi * 100 : 0.0) << "%)"
+            << std::setprecision(0)
+            << " cycles~" << cpi * total
+            << std::defaultfloat;
+        if (_samples < 2)
+            out << " (too few samples for an interval, lower the period)";
+        else
+            out << " samples-for-3%=" << RequiredSamples(0.03);
+        out << std::endl;
+    }
+
+    uint64_t total = 0;
+
+private:
+    void AddSample(double cpi)
+    {
+        _samples++;
+        _sum += cpi;
+        _sumSq += cpi * cpi;
+    }
+
+    // Two-sided standard normal quantile; the unit count is large enough
+    // in practice for the normal approximation of the sample mean
+    static double Z(double confidence)
+    {
+        // Acklam's rational approximation of the inverse normal CDF
+        double p = 1.0 - (1.0 - confidence) / 2.0;
+        static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                                   1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+        static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                                   6.680131188771972e+01, -1.328068155288572e+01};
+        static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                                   -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+        static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                                   3.754408661907416e+00};
+        if (p > 0.97575)
+        {
+            double q = std::sqrt(-2 * std::log(1 - p));
+            return -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5])
+                   / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+        }
+        double q = p - 0.5;
+        double r = q * q;
+        return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q
+               / (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+    }
+
+    TimingModel& _model;
+    SamplingConfig _config;
+    uint64_t _periodLength;
+    uint64_t _detailedStart;
+    uint64_t _measureStart;
+    uint64_t _pos = 0;
+    uint64_t _unitStart = 0;
+    uint64_t _detailed = 0;
+    uint64_t _samples = 0;
+    double _sum = 0;
+    double _sumSq = 0;
+};
+
+#endif //RISCV_SIM_SAMPLEDTIMING_H
@@ -0,0 +1,85 @@
+#ifndef RISCV_SIM_SAMPLINGPROFILER_H
+#define RISCV_SIM_SAMPLINGPROFILER_H
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "RetireListener.h"
+#include "ShadowStack.h"
+#include "Symbols.h"
+
+// Takes the guest call stack every `period` instructions and writes the
+// samples as folded stacks ("root;caller;callee count"), the input format
+// of flamegraph.pl and compatible viewers.
+class SamplingProfiler : public RetireListener
+{
+public:
+    SamplingProfiler(const SymbolTable& symbols, Word entry, uint64_t period)
+        : _symbols(symbols), _period(period ? period : 1), _countdown(_period)
+    {
+        _stack.Reset(entry);
+    }
+
+    void OnRetire(const Instruction& instr, Word ip, Word /*word*/) override
+    {
+        if (--_countdown == 0)
+        {
+            _countdown = _period;
+            Sample(ip);
+        }
+        _stack.Update(instr, ip);
+    }
+
+    uint64_t Samples() const
+    {
+        return _samples;
+    }
+
+    void WriteFolded(std::ostream& out) const
+    {
+        std::map<std::string, uint64_t> folded;
+        for (const auto& [stack, count] : _stacks)
+        {
+            std::string line;
+            for (size_t i = 0; i < stack.size(); i++)
+            {
+                if (i)
+                    line += ';';
+                line += _symbols.Name(stack[i]);
+            }
+            folded[line] += count;
+        }
+        for (const auto& [line, count] : folded)
+            out << line << ' ' << count << '\n';
+    }
+
+private:
+    void Sample(Word ip)
+    {
+        _key.clear();
+        for (const auto& frame : _stack.Frames())
+            _key.push_back(frame.function);
+
+        // The leaf is the symbol containing ip, unless that is the frame itself
+        const Symbol* leaf = _symbols.Find(ip);
+        Word leafAddr = leaf ? leaf->addr : ip;
+        if (_key.back() != leafAddr)
+            _key.push_back(leafAddr);
+
+        _stacks[_key]++;
+        _samples++;
+    }
+
+    const SymbolTable& _symbols;
+    uint64_t _period;
+    uint64_t _countdown;
+    uint64_t _samples = 0;
+    ShadowStack _stack;
+    std::vector<Word> _key;
+    std::map<std::vector<Word>, uint64_t> _stacks;
+};
+
+#endif //RISCV_SIM_SAMPLINGPROFILER_H
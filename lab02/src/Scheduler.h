@@ -0,0 +1,224 @@
+#ifndef RISCV_SIM_SCHEDULER_H
+#define RISCV_SIM_SCHEDULER_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Cpu.h"
+#include "Memory.h"
+
+// A guest program that can be suspended and resumed: its Cpu and Memory
+// are the whole state, so unlike a thread it needs no stack of its own.
+class SimTask
+{
+public:
+    enum class State
+    {
+        Ready,
+        Waiting,    // for the host, until Scheduler::Wake()
+        Exited,
+        Faulted,    // unsupported instruction
+    };
+
+    SimTask(const Memory& image, Word entry)
+        : _mem(std::make_unique<Memory>(image)),
+          _cpu(std::make_unique<Cpu>(*_mem))
+    {
+        _cpu->Reset(entry);
+    }
+
+    Cpu& GetCpu()
+    {
+        return *_cpu;
+    }
+
+    Memory& GetMemory()
+    {
+        return *_mem;
+    }
+
+    State GetState() const
+    {
+        return _state;
+    }
+
+    std::optional<int> ExitCode() const
+    {
+        return _exitCode;
+    }
+
+    // PrintChar and PrintInt messages
+    const std::string& Output() const
+    {
+        return _output;
+    }
+
+private:
+    friend class Scheduler;
+
+    std::unique_ptr<Memory> _mem;
+    std::unique_ptr<Cpu> _cpu;
+    State _state = State::Ready;
+    std::optional<int> _exitCode;
+    std::string _output;
+    int32_t _printInt = 0;
+};
+
+// Multiplexes many SimTasks on the calling thread. Ready tasks run round
+// robin for up to `quantum` instructions; a task is also suspended at each
+// of its tohost messages. Exit codes and console output are handled here,
+// any other message (ROI and phase markers, FuzzInput) goes to the
+// handler, which decides whether the task goes on or waits until Wake(),
+// e.g. for its input to arrive.
+class Scheduler
+{
+public:
+    using TaskId = size_t;
+    // Returns false to leave the task Waiting; the handler may also Wake()
+    // it before returning
+    using MessageHandler = std::function<bool(TaskId, SimTask&, CpuToHostData)>;
+
+    explicit Scheduler(uint64_t quantum = 10000)
+        : _quantum(quantum)
+    {
+    }
+
+    TaskId Spawn(std::unique_ptr<SimTask> task)
+    {
+        _tasks.push_back(std::move(task));
+        _ready.push_back(_tasks.size() - 1);
+        return _tasks.size() - 1;
+    }
+
+    // Without a handler FuzzInput gets an empty input, like in Simulation,
+    // and other messages are ignored
+    void SetHandler(MessageHandler handler)
+    {
+        _handler = std::move(handler);
+    }
+
+    SimTask& Task(TaskId id)
+    {
+        return *_tasks.at(id);
+    }
+
+    size_t Tasks() const
+    {
+        return _tasks.size();
+    }
+
+    void Wake(TaskId id)
+    {
+        SimTask& task = Task(id);
+        if (task._state != SimTask::State::Waiting)
+            return;
+        task._state = SimTask::State::Ready;
+        _ready.push_back(id);
+    }
+
+    // Runs until no task is ready; returns the number of tasks Waiting
+    size_t Run()
+    {
+        while (!_ready.empty())
+        {
+            TaskId id = _ready.front();
+            _ready.pop_front();
+            Resume(id);
+            switches++;
+        }
+        size_t waiting = 0;
+        for (const auto& task : _tasks)
+            waiting += task->_state == SimTask::State::Waiting;
+        return waiting;
+    }
+
+    void Report(std::ostream& out) const
+    {
+        uint64_t instructions = 0;
+        size_t exited = 0;
+        for (const auto& task : _tasks)
+        {
+            instructions += task->_cpu->InstructionsRetired();
+            exited += task->_state == SimTask::State::Exited;
+        }
+        out << "scheduler: tasks=" << _tasks.size() << " exited=" << exited << " instructions=" << instructions
+            << " switches=" << switches << " messages=" << messages << std::endl;
+    }
+
+    uint64_t switches = 0;
+    uint64_t messages = 0;
+
+private:
+    void Resume(TaskId id)
+    {
+        SimTask& task = *_tasks[id];
+        uint64_t budget = _quantum;
+        std::optional<CpuToHostData> msg;
+        try
+        {
+            msg = task._cpu->RunFor(budget);
+        }
+        catch (const std::out_of_range&)
+        {
+            // Executor tables have no entry for unsupported instructions
+            task._state = SimTask::State::Faulted;
+            return;
+        }
+
+        if (msg && !HandleMessage(id, task, msg.value()))
+            return;
+        _ready.push_back(id);
+    }
+
+    // Returns whether the task stays ready
+    bool HandleMessage(TaskId id, SimTask& task, CpuToHostData msg)
+    {
+        messages++;
+        auto data = msg.unpacked.data;
+        switch (msg.unpacked.type)
+        {
+            case CpuToHostType::ExitCode:
+                task._exitCode = data;
+                task._state = SimTask::State::Exited;
+                return false;
+            case CpuToHostType::PrintChar:
+                task._output += static_cast<char>(data);
+                return true;
+            case CpuToHostType::PrintIntLow:
+                task._printInt = data;
+                return true;
+            case CpuToHostType::PrintIntHigh:
+                task._output += std::to_string(static_cast<int32_t>(uint32_t(task._printInt) | uint32_t(data) << 16));
+                return true;
+            default:
+                break;
+        }
+        if (_handler)
+        {
+            // Waiting already while the handler runs, so it can Wake() the
+            // task itself; that queues it, and it must not be queued twice
+            task._state = SimTask::State::Waiting;
+            if (!_handler(id, task, msg) || task._state != SimTask::State::Waiting)
+                return false;
+            task._state = SimTask::State::Ready;
+            return true;
+        }
+        if (msg.unpacked.type == CpuToHostType::FuzzInput)
+            task._cpu->Registers().Set(11, 0);
+        return true;
+    }
+
+    uint64_t _quantum;
+    std::vector<std::unique_ptr<SimTask>> _tasks;
+    std::deque<TaskId> _ready;
+    MessageHandler _handler;
+};
+
+#endif //RISCV_SIM_SCHEDULER_H
@@ -0,0 +1,87 @@
+#ifndef RISCV_SIM_SHADOWSTACK_H
+#define RISCV_SIM_SHADOWSTACK_H
+
+#include <vector>
+
+#include "Instruction.h"
+
+// Guest call stack reconstructed from jal/jalr using the link register
+// hints of the RISC-V spec: a jump writing ra (or t0) is a call, a jalr
+// through ra (or t0) that does not write a link register is a return.
+class ShadowStack
+{
+public:
+    struct Frame
+    {
+        Word function;  // entry address of the callee
+        Word returnIp;  // where the matching return lands
+    };
+
+    enum class Event
+    {
+        None,
+        Call,
+        Return,
+    };
+
+    void Reset(Word entry)
+    {
+        _frames.clear();
+        _frames.push_back(Frame{entry, 0});
+    }
+
+    // Must be called with every retired instruction, after execution
+    Event Update(const Instruction& instr, Word ip)
+    {
+        if (instr._type != IType::J && instr._type != IType::Jr)
+            return Event::None;
+
+        RId dst = instr._dst.value_or(0);
+        RId src = instr._src1.value_or(0);
+
+        if (instr._type == IType::Jr && IsLink(src) && !IsLink(dst))
+        {
+            if (_frames.size() <= 1)
+                return Event::None;
+            // Unwind to the frame this return belongs to; a return that
+            // matches nothing (longjmp, hand-written asm) drops one frame
+            size_t depth = _frames.size() - 1;
+            while (depth > 1 && _frames[depth].returnIp != instr._nextIp)
+                depth--;
+            if (_frames[depth].returnIp != instr._nextIp)
+                depth = _frames.size() - 1;
+            _popped = _frames.size() - depth;
+            _frames.resize(depth);
+            return Event::Return;
+        }
+
+        if (IsLink(dst))
+        {
+            _frames.push_back(Frame{instr._nextIp, ip + 4});
+            return Event::Call;
+        }
+        return Event::None;
+    }
+
+    const std::vector<Frame>& Frames() const
+    {
+        return _frames;
+    }
+
+    // Number of frames removed by the last Event::Return
+    size_t Popped() const
+    {
+        return _popped;
+    }
+
+private:
+    static bool IsLink(RId reg)
+    {
+        return reg == 1 || reg == 5;
+    }
+
+    std::vector<Frame> _frames;
+    size_t _popped = 0;
+};
+
+#endif //RISCV_SIM_SHADOWSTACK_H
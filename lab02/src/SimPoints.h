@@ -0,0 +1,272 @@
+#ifndef RISCV_SIM_SIMPOINTS_H
+#define RISCV_SIM_SIMPOINTS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <random>
+#include <vector>
+
+#include "BbvProfiler.h"
+
+struct SimPoint
+{
+    size_t interval;    // index of the representative interval
+    size_t cluster;
+    double weight;      // share of all instructions its cluster stands for
+};
+
+// Picks representative intervals from basic-block vectors the way SimPoint
+// does: vectors are normalised to frequencies, randomly projected to a few
+// dimensions and clustered with k-means for k = 1..maxK. The smallest k
+// whose BIC score reaches 90% of the best one wins; each cluster is
+// represented by the interval closest to its centroid.
+class SimPoints
+{
+public:
+    static constexpr size_t dims = 15;
+    using Point = std::vector<double>;
+
+    static std::vector<SimPoint> Select(const std::vector<BbvProfiler::Vector>& intervals,
+                                        const std::vector<uint64_t>& lengths, size_t maxK, uint32_t seed = 1)
+    {
+        std::vector<SimPoint> result;
+        if (intervals.empty())
+            return result;
+
+        std::vector<Point> points = Project(intervals, seed);
+        maxK = std::max<size_t>(1, std::min(maxK, points.size()));
+
+        // Spread below 0.1% of the single-cluster variance counts as noise,
+        // otherwise nearly identical intervals get clusters of their own
+        double minVariance = 1e-3 * Variance(points, KMeans(points, 1, seed));
+
+        std::vector<Clustering> candidates;
+        for (size_t k = 1; k <= maxK; k++)
+            candidates.push_back(BestOf(points, k, seed, 5, minVariance));
+
+        double best = -std::numeric_limits<double>::infinity();
+        double worst = std::numeric_limits<double>::infinity();
+        for (const auto& c : candidates)
+        {
+            best = std::max(best, c.bic);
+            worst = std::min(worst, c.bic);
+        }
+        const Clustering* chosen = &candidates.back();
+        for (const auto& c : candidates)
+        {
+            if (c.bic >= worst + 0.9 * (best - worst))
+            {
+                chosen = &c;
+                break;
+            }
+        }
+
+        uint64_t total = 0;
+        for (uint64_t length : lengths)
+            total += length;
+
+        size_t k = chosen->centroids.size();
+        std::vector<uint64_t> weights(k, 0);
+        std::vector<size_t> closest(k, points.size());
+        std::vector<double> closestDistance(k, std::numeric_limits<double>::infinity());
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            size_t cluster = chosen->assignment[i];
+            weights[cluster] += lengths[i];
+            double distance = Distance(points[i], chosen->centroids[cluster]);
+            if (distance < closestDistance[cluster])
+            {
+                closestDistance[cluster] = distance;
+                closest[cluster] = i;
+            }
+        }
+
+        for (size_t cluster = 0; cluster < k; cluster++)
+            if (closest[cluster] != points.size())
+                result.push_back(SimPoint{closest[cluster], cluster, total ? double(weights[cluster]) / total : 0.0});
+        std::sort(result.begin(), result.end(),
+                  [](const SimPoint& a, const SimPoint& b) { return a.interval < b.interval; });
+        return result;
+    }
+
+    // SimPoint .simpoints and .weights files: "<interval> <cluster>" and
+    // "<weight> <cluster>" per line
+    static void Write(const std::vector<SimPoint>& simpoints, std::ostream& points, std::ostream& weights)
+    {
+        for (const auto& simpoint : simpoints)
+        {
+            points << simpoint.interval << ' ' << simpoint.cluster << '\n';
+            weights << simpoint.weight << ' ' << simpoint.cluster << '\n';
+        }
+    }
+
+    // Frequency vectors times a random [-1, 1] matrix, one row per block
+    static std::vector<Point> Project(const std::vector<BbvProfiler::Vector>& intervals, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+        std::vector<Point> matrix;
+
+        std::vector<Point> points;
+        points.reserve(intervals.size());
+        for (const auto& vector : intervals)
+        {
+            uint64_t total = 0;
+            for (const auto& entry : vector)
+                total += entry.second;
+
+            Point point(dims, 0.0);
+            for (const auto& [id, count] : vector)
+            {
+                while (matrix.size() <= id)
+                {
+                    matrix.emplace_back(dims);
+                    for (double& value : matrix.back())
+                        value = uniform(rng);
+                }
+                double frequency = double(count) / total;
+                for (size_t d = 0; d < dims; d++)
+                    point[d] += frequency * matrix[id][d];
+            }
+            points.push_back(std::move(point));
+        }
+        return points;
+    }
+
+private:
+    struct Clustering
+    {
+        std::vector<Point> centroids;
+        std::vector<size_t> assignment;
+        double sse = 0;
+        double bic = 0;
+    };
+
+    static double Distance(const Point& a, const Point& b)
+    {
+        double sum = 0;
+        for (size_t d = 0; d < a.size(); d++)
+            sum += (a[d] - b[d]) * (a[d] - b[d]);
+        return sum;
+    }
+
+    static Clustering BestOf(const std::vector<Point>& points, size_t k, uint32_t seed, int runs, double minVariance)
+    {
+        Clustering best;
+        best.sse = std::numeric_limits<double>::infinity();
+        for (int run = 0; run < runs; run++)
+        {
+            Clustering c = KMeans(points, k, seed * 7919 + uint32_t(k) * 31 + run);
+            if (c.sse < best.sse)
+                best = std::move(c);
+        }
+        best.bic = Bic(points, best, minVariance);
+        return best;
+    }
+
+    // Lloyd's iterations from a k-means++ seeding
+    static Clustering KMeans(const std::vector<Point>& points, size_t k, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        Clustering c;
+        c.centroids.push_back(points[rng() % points.size()]);
+        std::vector<double> nearest(points.size());
+        while (c.centroids.size() < k)
+        {
+            for (size_t i = 0; i < points.size(); i++)
+            {
+                nearest[i] = std::numeric_limits<double>::infinity();
+                for (const auto& centroid : c.centroids)
+                    nearest[i] = std::min(nearest[i], Distance(points[i], centroid));
+            }
+            // All points already coincide with a centroid
+            if (*std::max_element(nearest.begin(), nearest.end()) == 0)
+            {
+                c.centroids.push_back(points[rng() % points.size()]);
+                continue;
+            }
+            std::discrete_distribution<size_t> pick(nearest.begin(), nearest.end());
+            c.centroids.push_back(points[pick(rng)]);
+        }
+
+        c.assignment.assign(points.size(), 0);
+        for (int iteration = 0; iteration < 100; iteration++)
+        {
+            bool changed = iteration == 0;
+            c.sse = 0;
+            for (size_t i = 0; i < points.size(); i++)
+            {
+                size_t bestCluster = 0;
+                double bestDistance = std::numeric_limits<double>::infinity();
+                for (size_t cluster = 0; cluster < k; cluster++)
+                {
+                    double distance = Distance(points[i], c.centroids[cluster]);
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        bestCluster = cluster;
+                    }
+                }
+                changed |= c.assignment[i] != bestCluster;
+                c.assignment[i] = bestCluster;
+                c.sse += bestDistance;
+            }
+            if (!changed)
+                break;
+
+            std::vector<Point> sums(k, Point(points[0].size(), 0.0));
+            std::vector<size_t> sizes(k, 0);
+            for (size_t i = 0; i < points.size(); i++)
+            {
+                sizes[c.assignment[i]]++;
+                for (size_t d = 0; d < points[i].size(); d++)
+                    sums[c.assignment[i]][d] += points[i][d];
+            }
+            for (size_t cluster = 0; cluster < k; cluster++)
+                if (sizes[cluster])
+                    for (size_t d = 0; d < sums[cluster].size(); d++)
+                        c.centroids[cluster][d] = sums[cluster][d] / sizes[cluster];
+        }
+        return c;
+    }
+
+    // Maximum likelihood estimate of the per-dimension variance
+    static double Variance(const std::vector<Point>& points, const Clustering& c)
+    {
+        double r = double(points.size());
+        double k = double(c.centroids.size());
+        return r > k ? c.sse / (double(points[0].size()) * (r - k)) : 0.0;
+    }
+
+    // Bayesian information criterion of a spherical Gaussian mixture
+    // (Pelleg and Moore, X-means)
+    static double Bic(const std::vector<Point>& points, const Clustering& c, double minVariance)
+    {
+        double r = double(points.size());
+        double k = double(c.centroids.size());
+        double m = double(points[0].size());
+        double variance = std::max({Variance(points, c), minVariance, 1e-12});
+
+        std::vector<size_t> sizes(c.centroids.size(), 0);
+        for (size_t cluster : c.assignment)
+            sizes[cluster]++;
+
+        double likelihood = 0;
+        for (size_t size : sizes)
+        {
+            if (!size)
+                continue;
+            double rn = double(size);
+            likelihood += rn * std::log(rn) - rn * std::log(r)
+                          - rn * m / 2 * std::log(2 * M_PI * variance)
+                          - (rn - 1) * m / 2;
+        }
+        double parameters = (k - 1) + m * k + 1;
+        return likelihood - parameters / 2 * std::log(r);
+    }
+};
+
+#endif //RISCV_SIM_SIMPOINTS_H
@@ -0,0 +1,297 @@
+#ifndef RISCV_SIM_SIMULATION_H
+#define RISCV_SIM_SIMULATION_H
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Cpu.h"
+#include "HostCounters.h"
+#include "TimingModel.h"
+
+// Runs a Cpu until the guest reports its exit code and serves the tohost
+// messages on the way. Instruments (timing models, profilers, tracers) are
+// only attached while the detailed engine is selected; the fast engine is
+// the bare functional Cpu.
+//
+// In ROI mode the program starts on the fast engine and switches to the
+// detailed one between RoiBegin and RoiEnd. Phase markers split the
+// statistics into named phases in either mode.
+class Simulation
+{
+public:
+    enum class Engine
+    {
+        Fast,
+        Detailed,
+    };
+
+    struct PhaseStats
+    {
+        std::string name;
+        uint64_t entries = 0;
+        uint64_t instructions = 0;
+        uint64_t cycles = 0;
+    };
+
+    Simulation(Cpu& cpu)
+        : _cpu(cpu)
+    {
+    }
+
+    void AddInstrument(RetireListener* listener)
+    {
+        _instruments.push_back(listener);
+        if (_engine == Engine::Detailed)
+            _cpu.AddListener(listener);
+    }
+
+    // Used for per-phase cycle counts
+    void SetTiming(const TimingModel* timing)
+    {
+        _timing = timing;
+    }
+
+    void SetHostCounters(HostCounters* host)
+    {
+        _host = host;
+    }
+
+    void SetRoiMode(bool roi)
+    {
+        _roiMode = roi;
+        SwitchEngine(roi ? Engine::Fast : Engine::Detailed);
+    }
+
+    void SwitchEngine(Engine engine)
+    {
+        if (engine == _engine)
+            return;
+        _engine = engine;
+        for (auto listener : _instruments)
+        {
+            if (engine == Engine::Detailed)
+                _cpu.AddListener(listener);
+            else
+                _cpu.RemoveListener(listener);
+        }
+        if (_host && _hostStarted)
+            _host->Begin(EngineName(), _cpu.InstructionsRetired());
+    }
+
+    // Calls hook between instructions once `first` instructions have been
+    // retired, then every `period` instructions (never again if period is 0)
+    void SetCheckpointHook(uint64_t first, uint64_t period, std::function<void()> hook)
+    {
+        _nextHook = first;
+        _hookPeriod = period;
+        _hook = std::move(hook);
+    }
+
+    Engine CurrentEngine() const
+    {
+        return _engine;
+    }
+
+    // Host counter region name; the detailed engine without instruments
+    // is still the plain functional Cpu
+    const char* EngineName() const
+    {
+        return _engine == Engine::Detailed && !_instruments.empty() ? "detailed" : "functional";
+    }
+
+    // Returns the guest exit code
+    int Run()
+    {
+        if (_host)
+        {
+            _host->Begin(EngineName(), _cpu.InstructionsRetired());
+            _hostStarted = true;
+        }
+
+        std::optional<int> exitCode;
+        while (!exitCode)
+            exitCode = RunUntil(~uint64_t(0));
+
+        EndPhase();
+        if (_host)
+            _host->End(_cpu.InstructionsRetired());
+        return exitCode.value();
+    }
+
+    // Runs until the guest exits, returning its exit code, or until
+    // `retired` instructions have been retired in total
+    std::optional<int> RunUntil(uint64_t retired)
+    {
+        std::optional<int> exitCode;
+        CheckHook();
+        while (!exitCode && _cpu.InstructionsRetired() < retired)
+        {
+            // Returns at every message and at the checkpoint hook
+            uint64_t budget = StepBudget(retired);
+            std::optional<CpuToHostData> msg = _cpu.RunFor(budget);
+            if (msg)
+                exitCode = HandleMessage(msg.value());
+            if (!exitCode)
+                CheckHook();
+        }
+        return exitCode;
+    }
+
+    // Called when the guest asks for a fuzzing input; without a hook the
+    // guest gets an empty one
+    void SetInputHook(std::function<void()> hook)
+    {
+        _inputHook = std::move(hook);
+    }
+
+    // Drops guest console output and the exit message, e.g. for the
+    // interval workers of a time-parallel run
+    void SetQuiet(bool quiet)
+    {
+        _quiet = quiet;
+    }
+
+    const std::vector<PhaseStats>& Phases() const
+    {
+        return _phases;
+    }
+
+    void ReportPhases(std::ostream& out) const
+    {
+        for (const auto& phase : _phases)
+        {
+            out << "phase[" << phase.name << "]: entries=" << phase.entries
+                << " instructions=" << phase.instructions;
+            if (_timing)
+                out << " cycles=" << phase.cycles << " cpi=" << std::setprecision(4)
+                    << (phase.instructions ? double(phase.cycles) / phase.instructions : 0.0)
+                    << std::defaultfloat;
+            out << std::endl;
+        }
+    }
+
+private:
+    // Returns the exit code once the guest asks to stop
+    std::optional<int> HandleMessage(CpuToHostData msg)
+    {
+        auto type = msg.unpacked.type;
+        auto data = msg.unpacked.data;
+
+        if(_quiet && type <= CpuToHostType::PrintIntHigh) {
+            if(type == CpuToHostType::ExitCode)
+                return data;
+        } else if(type == CpuToHostType::ExitCode) {
+            if(data == 0) {
+                fprintf(stderr, "PASSED\n");
+            } else {
+                fprintf(stderr, "FAILED: exit code = %d\n", data);
+            }
+            return data;
+        } else if(type == CpuToHostType::PrintChar) {
+            fprintf(stderr, "%c", (char)data);
+        } else if(type == CpuToHostType::PrintIntLow) {
+            _printInt = uint32_t(data);
+        } else if(type == CpuToHostType::PrintIntHigh) {
+            _printInt |= uint32_t(data) << 16;
+            fprintf(stderr, "%d", _printInt);
+        } else if(type == CpuToHostType::RoiBegin) {
+            BeginPhase(_phaseName.empty() ? "roi" : _phaseName);
+            if (_roiMode)
+                SwitchEngine(Engine::Detailed);
+        } else if(type == CpuToHostType::RoiEnd) {
+            EndPhase();
+            if (_roiMode)
+                SwitchEngine(Engine::Fast);
+        } else if(type == CpuToHostType::Phase) {
+            BeginPhase(_phaseName.empty() ? "phase" + std::to_string(data) : _phaseName);
+        } else if(type == CpuToHostType::PhaseNameChar) {
+            _phaseName += (char)data;
+        } else if(type == CpuToHostType::FuzzInput) {
+            if (_inputHook)
+                _inputHook();
+            else
+                _cpu.Registers().Set(11, 0);
+        }
+        return std::nullopt;
+    }
+
+    // Instructions the Cpu may retire in one step (fused pairs) without
+    // passing the retire limit or the checkpoint hook
+    uint64_t StepBudget(uint64_t retired) const
+    {
+        uint64_t now = _cpu.InstructionsRetired();
+        uint64_t limit = _hook && _nextHook > now ? std::min(retired, _nextHook) : retired;
+        return limit - now;
+    }
+
+    void CheckHook()
+    {
+        if (_hook && _cpu.InstructionsRetired() == _nextHook)
+        {
+            _hook();
+            if (_hookPeriod)
+                _nextHook += _hookPeriod;
+            else
+                _hook = nullptr;
+        }
+    }
+
+    void BeginPhase(const std::string& name)
+    {
+        EndPhase();
+        auto it = _phaseIdx.find(name);
+        if (it == _phaseIdx.end())
+        {
+            it = _phaseIdx.emplace(name, _phases.size()).first;
+            _phases.push_back(PhaseStats{name});
+        }
+        _current = it->second;
+        _phases[_current].entries++;
+        _phaseStartInstr = _cpu.InstructionsRetired();
+        _phaseStartCycles = _timing ? _timing->cycles : 0;
+        _phaseName.clear();
+    }
+
+    void EndPhase()
+    {
+        if (_current == noPhase)
+            return;
+        PhaseStats& phase = _phases[_current];
+        phase.instructions += _cpu.InstructionsRetired() - _phaseStartInstr;
+        if (_timing)
+            phase.cycles += _timing->cycles - _phaseStartCycles;
+        _current = noPhase;
+    }
+
+    static constexpr size_t noPhase = ~size_t(0);
+
+    Cpu& _cpu;
+    std::vector<RetireListener*> _instruments;
+    const TimingModel* _timing = nullptr;
+    HostCounters* _host = nullptr;
+    bool _hostStarted = false;
+    bool _roiMode = false;
+    bool _quiet = false;
+    Engine _engine = Engine::Detailed;
+    std::function<void()> _hook;
+    std::function<void()> _inputHook;
+    uint64_t _nextHook = 0;
+    uint64_t _hookPeriod = 0;
+
+    std::vector<PhaseStats> _phases;
+    std::map<std::string, size_t> _phaseIdx;
+    size_t _current = noPhase;
+    uint64_t _phaseStartInstr = 0;
+    uint64_t _phaseStartCycles = 0;
+    std::string _phaseName;
+    int32_t _printInt = 0;
+};
+
+#endif //RISCV_SIM_SIMULATION_H
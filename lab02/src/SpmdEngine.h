@@ -0,0 +1,388 @@
+#ifndef RISCV_SIM_SPMDENGINE_H
+#define RISCV_SIM_SPMDENGINE_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "BatchDecoder.h"
+#include "CsrFile.h"
+#include "Decoder.h"
+#include "Memory.h"
+
+// Runs up to `lanes` instances of one program in lockstep, e.g. on
+// different inputs. Every instance has its own Memory and CSRs; the
+// registers and ips are stored by register, one SIMD vector of all the
+// lanes each, so an ALU instruction is one vector operation for every lane
+// running it.
+//
+// Every step runs the instruction at the lowest ip of the lanes still
+// running, on the lanes at that ip: lanes that took a different way at a
+// branch wait until the others reach their ip, which reconverges them
+// after if/else and loops. Loads, stores, indirect jumps and CSR
+// accesses go lane by lane.
+class SpmdEngine
+{
+public:
+    static constexpr size_t lanes = 8;
+
+    struct Lane
+    {
+        std::optional<int> exitCode;
+        bool faulted = false;           // unsupported instruction
+        bool consumedInput = false;
+        std::string output;             // PrintChar and PrintInt messages
+        uint64_t instructions = 0;
+    };
+
+    // `active` lanes start from copies of image at ip
+    SpmdEngine(const Memory& image, Word ip, size_t active = lanes)
+        : _active(std::min(active, lanes))
+    {
+        for (size_t l = 0; l < _active; l++)
+        {
+            _mems[l] = std::make_unique<Memory>(image);
+            _csrs[l].Reset();
+        }
+        for (auto& reg : _regs)
+            reg = Words{};
+        _ips = Words{} + ip;
+    }
+
+    size_t Active() const
+    {
+        return _active;
+    }
+
+    Memory& LaneMemory(size_t lane)
+    {
+        return *_mems[lane];
+    }
+
+    Word Get(size_t lane, RId reg) const
+    {
+        return _regs[reg][lane];
+    }
+
+    void Set(size_t lane, RId reg, Word value)
+    {
+        if (reg)
+            _regs[reg][lane] = value;
+    }
+
+    Word Ip(size_t lane) const
+    {
+        return _ips[lane];
+    }
+
+    const CsrFile& Csrs(size_t lane) const
+    {
+        return _csrs[lane];
+    }
+
+    const Lane& Result(size_t lane) const
+    {
+        return _lanes[lane];
+    }
+
+    // Served when the lane asks for a fuzzing input (a0 = buffer, a1 =
+    // capacity), as FuzzSession does for a single Cpu
+    void SetInput(size_t lane, std::vector<uint8_t> input)
+    {
+        _inputs[lane] = std::move(input);
+    }
+
+    // Runs until every lane has exited, faulted or retired maxInstructions
+    void Run(uint64_t maxInstructions)
+    {
+        while (Step(maxInstructions))
+            ;
+    }
+
+    // One instruction on the lanes at the lowest ip; false once no lane runs
+    bool Step(uint64_t maxInstructions)
+    {
+        std::optional<Word> ip;
+        for (size_t l = 0; l < _active; l++)
+            if (Running(l, maxInstructions) && (!ip || _ips[l] < ip.value()))
+                ip = _ips[l];
+        if (!ip)
+            return false;
+
+        // Lanes whose code differs at ip run it in a later step
+        std::optional<Word> word;
+        Words mask{};
+        unsigned count = 0;
+        for (size_t l = 0; l < _active; l++)
+        {
+            if (!Running(l, maxInstructions) || _ips[l] != ip.value())
+                continue;
+            Word laneWord = _mems[l]->Request(ip.value());
+            if (word && laneWord != word.value())
+                continue;
+            word = laneWord;
+            mask[l] = ~0u;
+            count++;
+        }
+
+        InstructionPtr instr = _decoder.Decode(word.value());
+        Execute(*instr, ip.value(), mask);
+        steps++;
+        laneSteps += count;
+        for (size_t l = 0; l < _active; l++)
+        {
+            if (!mask[l] || _lanes[l].faulted)
+                continue;
+            _csrs[l].Retire();
+            _lanes[l].instructions++;
+        }
+        return true;
+    }
+
+    // Share of the vector lanes doing work over all steps
+    double Utilization() const
+    {
+        return steps ? double(laneSteps) / (steps * lanes) : 0.0;
+    }
+
+    void Report(std::ostream& out) const
+    {
+        out << "spmd: lanes=" << _active << " steps=" << steps << " instructions=" << laneSteps
+            << " utilization=" << 100 * Utilization() << "% divergent-branches=" << divergentBranches
+            << " isa=" << BatchDecoder::Name(_isa) << std::endl;
+    }
+
+    uint64_t steps = 0;
+    uint64_t laneSteps = 0;             // instructions retired over all lanes
+    uint64_t divergentBranches = 0;     // branches taken by only some of the lanes running them
+
+private:
+    typedef Word Words __attribute__((vector_size(lanes * sizeof(Word))));
+    typedef int32_t Ints __attribute__((vector_size(lanes * sizeof(Word))));
+
+    bool Running(size_t lane, uint64_t maxInstructions) const
+    {
+        const Lane& state = _lanes[lane];
+        return !state.exitCode && !state.faulted && state.instructions < maxInstructions;
+    }
+
+    void Execute(const Instruction& instr, Word ip, const Words& mask)
+    {
+        switch (instr._type)
+        {
+            case IType::Alu:
+            case IType::Br:
+#ifdef RISCV_SIM_BATCH_X86
+                if (_isa == BatchDecoder::Isa::Avx2)
+                    VectorAvx2(instr, ip, mask);
+                else
+#endif
+                    VectorDefault(instr, ip, mask);
+                return;
+            case IType::Auipc:
+                Write(instr, mask, Words{} + (ip + instr._imm.value()));
+                Blend(mask, Words{} + (ip + 4), _ips);
+                return;
+            case IType::J:
+                Write(instr, mask, Words{} + (ip + 4));
+                Blend(mask, Words{} + (ip + instr._imm.value()), _ips);
+                return;
+            default:
+                break;
+        }
+
+        for (size_t l = 0; l < _active; l++)
+            if (mask[l])
+                ExecuteLane(instr, ip, l);
+    }
+
+    // Alu and Br on every lane of the mask; inlined into the wrappers below,
+    // which compile it for their instruction set
+    __attribute__((always_inline)) void ExecuteVector(const Instruction& instr, Word ip, const Words& mask)
+    {
+        Words a = _regs[instr._src1.value_or(0)];
+        // The immediate of a branch is its offset
+        bool useImm = instr._imm && instr._type == IType::Alu;
+        Words b = useImm ? Words{} + instr._imm.value() : _regs[instr._src2.value_or(0)];
+        if (instr._type == IType::Br)
+        {
+            Words taken;
+            Compare(instr._brFunc, a, b, taken);
+            taken &= mask;
+            bool any = false;
+            bool all = true;
+            for (size_t l = 0; l < lanes; l++)
+            {
+                any = any || taken[l];
+                all = all && (taken[l] || !mask[l]);
+            }
+            divergentBranches += any && !all;
+            Words next = Words{} + (ip + 4);
+            Blend(taken, Words{} + (ip + instr._imm.value()), next);
+            Blend(mask, next, _ips);
+            return;
+        }
+
+        Words res;
+        switch (instr._aluFunc)
+        {
+            case AluFunc::Add: res = a + b; break;
+            case AluFunc::Sub: res = a - b; break;
+            case AluFunc::And: res = a & b; break;
+            case AluFunc::Or: res = a | b; break;
+            case AluFunc::Xor: res = a ^ b; break;
+            case AluFunc::Slt: res = reinterpret_cast<Words>(reinterpret_cast<Ints>(a) < reinterpret_cast<Ints>(b)) & 1u; break;
+            case AluFunc::Sltu: res = reinterpret_cast<Words>(a < b) & 1u; break;
+            case AluFunc::Sll: res = a << (b & 31u); break;
+            case AluFunc::Srl: res = a >> (b & 31u); break;
+            case AluFunc::Sra: res = reinterpret_cast<Words>(reinterpret_cast<Ints>(a) >> reinterpret_cast<Ints>(b & 31u)); break;
+            default: res = Words{}; break;
+        }
+        Write(instr, mask, res);
+        Blend(mask, Words{} + (ip + 4), _ips);
+    }
+
+#ifdef RISCV_SIM_BATCH_X86
+    __attribute__((target("avx2"))) void VectorAvx2(const Instruction& instr, Word ip, const Words& mask)
+    {
+        ExecuteVector(instr, ip, mask);
+    }
+#endif
+
+    void VectorDefault(const Instruction& instr, Word ip, const Words& mask)
+    {
+        ExecuteVector(instr, ip, mask);
+    }
+
+    // Vectors are passed by reference and results stored through one: a
+    // 32-byte vector value in a signature has a different ABI with AVX
+
+    // All ones in the lanes where the branch is taken
+    __attribute__((always_inline)) static void Compare(BrFunc func, const Words& a, const Words& b, Words& taken)
+    {
+        Ints sa = reinterpret_cast<Ints>(a);
+        Ints sb = reinterpret_cast<Ints>(b);
+        switch (func)
+        {
+            case BrFunc::Eq: taken = reinterpret_cast<Words>(a == b); break;
+            case BrFunc::Neq: taken = reinterpret_cast<Words>(a != b); break;
+            case BrFunc::Lt: taken = reinterpret_cast<Words>(sa < sb); break;
+            case BrFunc::Ltu: taken = reinterpret_cast<Words>(a < b); break;
+            case BrFunc::Ge: taken = reinterpret_cast<Words>(sa >= sb); break;
+            case BrFunc::Geu: taken = reinterpret_cast<Words>(a >= b); break;
+            case BrFunc::AT: taken = Words{} + ~0u; break;
+            default: taken = Words{}; break;
+        }
+    }
+
+    // dst = value in the lanes of mask
+    __attribute__((always_inline)) static void Blend(const Words& mask, const Words& value, Words& dst)
+    {
+        dst = (value & mask) | (dst & ~mask);
+    }
+
+    __attribute__((always_inline)) void Write(const Instruction& instr, const Words& mask, const Words& value)
+    {
+        if (instr._dst)
+            Blend(mask, value, _regs[instr._dst.value()]);
+    }
+
+    void ExecuteLane(const Instruction& instr, Word ip, size_t l)
+    {
+        Memory& mem = *_mems[l];
+        Word src1 = _regs[instr._src1.value_or(0)][l];
+        Word src2 = _regs[instr._src2.value_or(0)][l];
+        Word next = ip + 4;
+        std::optional<Word> data;
+        switch (instr._type)
+        {
+            case IType::Ld:
+                data = mem.Request(src1 + instr._imm.value());
+                break;
+            case IType::St:
+                mem.Store(src1 + instr._imm.value(), src2);
+                break;
+            case IType::Jr:
+                next = src1 + instr._imm.value();
+                data = ip + 4;
+                break;
+            case IType::Csrr:
+            case IType::Csrw:
+            {
+                auto csrInstr = std::make_unique<Instruction>(instr);
+                csrInstr->_src1Val = src1;
+                _csrs[l].Read(csrInstr);
+                csrInstr->_data = instr._type == IType::Csrr ? csrInstr->_csrVal : src1;
+                _csrs[l].Write(csrInstr);
+                data = csrInstr->_data;
+                break;
+            }
+            default:
+                _lanes[l].faulted = true;
+                return;
+        }
+        if (data && instr._dst)
+            _regs[instr._dst.value()][l] = data.value();
+        _ips[l] = next;
+        if (auto msg = _csrs[l].GetMessage())
+            HandleMessage(l, msg.value());
+    }
+
+    // As Simulation does for a single Cpu; phases and ROI markers are ignored
+    void HandleMessage(size_t l, CpuToHostData msg)
+    {
+        Lane& lane = _lanes[l];
+        auto data = msg.unpacked.data;
+        switch (msg.unpacked.type)
+        {
+            case CpuToHostType::ExitCode:
+                lane.exitCode = data;
+                break;
+            case CpuToHostType::PrintChar:
+                lane.output += static_cast<char>(data);
+                break;
+            case CpuToHostType::PrintIntLow:
+                _printInt[l] = data;
+                break;
+            case CpuToHostType::PrintIntHigh:
+                lane.output += std::to_string(static_cast<int32_t>(_printInt[l] | uint32_t(data) << 16));
+                break;
+            case CpuToHostType::FuzzInput:
+                Inject(l);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void Inject(size_t l)
+    {
+        constexpr size_t memBytes = Memory::WordCount() * sizeof(Word);
+        const std::vector<uint8_t>& input = _inputs[l];
+        Word buffer = _regs[10][l];
+        size_t count = std::min<size_t>(input.size(), _regs[11][l]);
+        count = buffer < memBytes ? std::min(count, memBytes - buffer) : 0;
+        if (count)
+            _mems[l]->StoreBytes(buffer, input.data(), count);
+        _regs[11][l] = static_cast<Word>(count);
+        _lanes[l].consumedInput = true;
+    }
+
+    size_t _active;
+    Words _regs[32];
+    Words _ips;
+    std::array<std::unique_ptr<Memory>, lanes> _mems;
+    std::array<CsrFile, lanes> _csrs;
+    std::array<Lane, lanes> _lanes;
+    std::array<std::vector<uint8_t>, lanes> _inputs;
+    std::array<uint32_t, lanes> _printInt{};
+    Decoder _decoder;
+    BatchDecoder::Isa _isa = BatchDecoder::Best();
+};
+
+#endif //RISCV_SIM_SPMDENGINE_H
@@ -1,10 +1,14 @@
 #ifndef RISCV_SIM_SWITCHMAKER_H
 #define RISCV_SIM_SWITCHMAKER_H
 
-#include <unordered_map>
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <optional>
 #include <stdexcept>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 // namespace Creator
 // {
@@ -15,6 +19,27 @@
 //     }
 // }
 
+// Number of slots SwitchMaker indexes directly for a key type, 0 if the
+// keys have to be hashed. One-byte enums and integers (Opcode, ...) get a
+// slot per value; specialise it for other small key types.
+template<typename SwitchType, typename = void>
+struct SwitchKeyRange
+{
+    static constexpr size_t size = 0;
+};
+
+template<typename SwitchType>
+struct SwitchKeyRange<SwitchType, std::enable_if_t<(std::is_enum_v<SwitchType> || std::is_integral_v<SwitchType>)
+                                                   && sizeof(SwitchType) == 1>>
+{
+    static constexpr size_t size = 256;
+};
+
+// Dispatches on a key to the Compare registered for it, or to the default
+// one. Keys with a SwitchKeyRange are looked up in a flat array, others in
+// an open-addressing table with linear probing, kept at most half full so a
+// lookup is one or two probes on average. The simulator itself no longer
+// dispatches through it since the decoder became table-driven.
 template<typename SwitchType, typename Compare>
 class SwitchMaker
 {
@@ -24,45 +49,181 @@ class SwitchMaker
         void AddCompare(Compare comp)
         {
             SwitchType type = comp->GetSwitchType();
-            operation[type] = move(comp);
+            if constexpr (dense)
+            {
+                slots[Index(type)] = std::move(comp);
+            }
+            else
+            {
+                if (Compare* existing = Find(type))
+                {
+                    *existing = std::move(comp);
+                    return;
+                }
+                if (2 * (count + 1) > table.size())
+                    Grow();
+                Place(Entry{type, std::move(comp)});
+                count++;
+            }
         }
 
         void DeleteCompare(SwitchType type)
         {
-            operation.erase(type);
+            if constexpr (dense)
+            {
+                slots[Index(type)].reset();
+            }
+            else
+            {
+                if (table.empty())
+                    return;
+                size_t mask = table.size() - 1;
+                size_t hole = Home(type);
+                while (table[hole] && !(table[hole]->type == type))
+                    hole = (hole + 1) & mask;
+                if (!table[hole])
+                    return;
+                table[hole].reset();
+                count--;
+
+                // Backward shift: move up every later entry of the run whose
+                // home is not between the hole and its slot, so no probe
+                // sequence crosses an empty slot
+                for (size_t next = (hole + 1) & mask; table[next]; next = (next + 1) & mask)
+                {
+                    size_t home = Home(table[next]->type);
+                    if (((next - home) & mask) >= ((next - hole) & mask))
+                    {
+                        table[hole] = std::move(table[next]);
+                        table[next].reset();
+                        hole = next;
+                    }
+                }
+            }
         }
 
         template<typename... Args>
         auto DoOperation(SwitchType type, Args&&... args)
         {
-            if(operation.count(type) != 0)
-                return (*operation[type])(std::forward<Args>(args)...);
-            else if(defaultComp)
-                return (**defaultComp)(std::forward<Args>(args)...);
-            else
-                throw std::invalid_argument("Unknown type");
+            Compare* comp = Find(type);
+            if (!comp)
+            {
+                if (!defaultComp)
+                    throw std::invalid_argument("Unknown type");
+                comp = &*defaultComp;
+            }
+            return (**comp)(std::forward<Args>(args)...);
         }
 
         void AddDefault(Compare comp)
         {
-            defaultComp.emplace(move(comp));
+            defaultComp.emplace(std::move(comp));
         }
 
-        Compare& GetCompare(SwitchType type) const
+        Compare& GetCompare(SwitchType type)
         {
-            return operation.at(type);
+            if (Compare* comp = Find(type))
+                return *comp;
+            throw std::out_of_range("Unknown type");
         }
 
-        Compare& GetDefaultCompare() const
+        const Compare& GetCompare(SwitchType type) const
+        {
+            return const_cast<SwitchMaker*>(this)->GetCompare(type);
+        }
+
+        Compare& GetDefaultCompare()
         {
             return *defaultComp;
         }
 
+        const Compare& GetDefaultCompare() const
+        {
+            return *defaultComp;
+        }
 
     private:
-        std::unordered_map<SwitchType, Compare> operation;
+        static constexpr size_t range = SwitchKeyRange<SwitchType>::size;
+        static constexpr bool dense = range != 0;
+
+        struct Entry
+        {
+            SwitchType type;
+            Compare comp;
+        };
+
+        static constexpr size_t Index(SwitchType type)
+        {
+            if constexpr (std::is_enum_v<SwitchType>)
+                return static_cast<std::make_unsigned_t<std::underlying_type_t<SwitchType>>>(type) % range;
+            else
+                return static_cast<std::make_unsigned_t<SwitchType>>(type) % range;
+        }
+
+        static uint64_t Key(const SwitchType& type)
+        {
+            if constexpr (std::is_enum_v<SwitchType>)
+                return static_cast<uint64_t>(type);
+            else if constexpr (std::is_integral_v<SwitchType>)
+                return static_cast<uint64_t>(type);
+            else
+                return std::hash<SwitchType>()(type);
+        }
+
+        // Multiplicative hash; the top `bits` bits of the product
+        size_t Home(const SwitchType& type) const
+        {
+            return bits ? static_cast<size_t>((Key(type) * 0x9e3779b97f4a7c15ull) >> (64u - bits)) : 0;
+        }
+
+        Compare* Find(SwitchType type)
+        {
+            if constexpr (dense)
+            {
+                auto& slot = slots[Index(type)];
+                return slot ? &*slot : nullptr;
+            }
+            else
+            {
+                if (table.empty())
+                    return nullptr;
+                size_t mask = table.size() - 1;
+                for (size_t slot = Home(type); table[slot]; slot = (slot + 1) & mask)
+                    if (table[slot]->type == type)
+                        return &table[slot]->comp;
+                return nullptr;
+            }
+        }
+
+        // Into the first free slot from the key's home; the table has one
+        void Place(Entry entry)
+        {
+            size_t mask = table.size() - 1;
+            size_t slot = Home(entry.type);
+            while (table[slot])
+                slot = (slot + 1) & mask;
+            table[slot].emplace(std::move(entry));
+        }
+
+        void Grow()
+        {
+            std::vector<std::optional<Entry>> old = std::move(table);
+            bits = old.empty() ? 3 : bits + 1;
+            table.clear();
+            table.resize(size_t(1) << bits);
+            for (auto& entry : old)
+                if (entry)
+                    Place(std::move(*entry));
+        }
+
+        // Only one of the two is used, depending on `dense`
+        std::array<std::optional<Compare>, dense ? range : 0> slots;
+        std::vector<std::optional<Entry>> table;
+        size_t count = 0;
+        unsigned bits = 0;
+
         std::optional<Compare> defaultComp;
 };
 
 
-#endif // RISCV_SIM_SWITCHMAKER_H
\ No newline at end of file
+#endif // RISCV_SIM_SWITCHMAKER_H
@@ -0,0 +1,85 @@
+#ifndef RISCV_SIM_SYMBOLS_H
+#define RISCV_SIM_SYMBOLS_H
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "BaseTypes.h"
+
+struct Symbol
+{
+    Word addr;
+    Word size;
+    std::string name;
+    int priority;   // higher wins when several symbols share an address
+};
+
+// Code symbols of the loaded program, filled by Memory::LoadElf
+class SymbolTable
+{
+public:
+    void Add(Word addr, Word size, const std::string& name, int priority = 0)
+    {
+        _symbols.push_back(Symbol{addr, size, name, priority});
+        _sorted = false;
+    }
+
+    // Nearest symbol at or below addr, nullptr if there is none
+    const Symbol* Find(Word addr) const
+    {
+        Sort();
+        auto it = std::upper_bound(_symbols.begin(), _symbols.end(), addr,
+                                   [](Word a, const Symbol& s) { return a < s.addr; });
+        if (it == _symbols.begin())
+            return nullptr;
+        return &*(it - 1);
+    }
+
+    // "name" for an exact match, "name+0x10" inside a symbol, "0x..." otherwise
+    std::string Name(Word addr) const
+    {
+        const Symbol* symbol = Find(addr);
+        char buf[32];
+        if (!symbol)
+        {
+            std::snprintf(buf, sizeof(buf), "0x%x", addr);
+            return buf;
+        }
+        if (symbol->addr == addr)
+            return symbol->name;
+        std::snprintf(buf, sizeof(buf), "+0x%x", addr - symbol->addr);
+        return symbol->name + buf;
+    }
+
+    bool Empty() const
+    {
+        return _symbols.empty();
+    }
+
+    const std::vector<Symbol>& Symbols() const
+    {
+        Sort();
+        return _symbols;
+    }
+
+private:
+    void Sort() const
+    {
+        if (_sorted)
+            return;
+        std::stable_sort(_symbols.begin(), _symbols.end(), [](const Symbol& a, const Symbol& b) {
+            return a.addr < b.addr || (a.addr == b.addr && a.priority > b.priority);
+        });
+        _symbols.erase(std::unique(_symbols.begin(), _symbols.end(),
+                                   [](const Symbol& a, const Symbol& b) { return a.addr == b.addr; }),
+                       _symbols.end());
+        _sorted = true;
+    }
+
+    mutable std::vector<Symbol> _symbols;
+    mutable bool _sorted = true;
+};
+
+#endif //RISCV_SIM_SYMBOLS_H
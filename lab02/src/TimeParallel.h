@@ -0,0 +1,144 @@
+#ifndef RISCV_SIM_TIMEPARALLEL_H
+#define RISCV_SIM_TIMEPARALLEL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include "Checkpoint.h"
+#include "Parallel.h"
+#include "RetireListener.h"
+#include "Simulation.h"
+#include "TimingModel.h"
+
+// Time-parallel detailed simulation. A functional pass captures an
+// in-memory checkpoint every `interval` instructions; then every interval
+// is simulated with its own TimingModel on a host thread. An interval
+// restores the previous checkpoint and warms the caches and predictor
+// over the last `warmup` instructions before its start, so the stitched
+// counters stay close to a sequential detailed run.
+class TimeParallelRun
+{
+public:
+    TimeParallelRun(const TimingConfig& config, uint64_t interval, uint64_t warmup, unsigned threads = HostThreads())
+        : _config(config),
+          _interval(interval),
+          _warmup(std::min(warmup, interval)),
+          _threads(threads ? threads : 1),
+          _total(config)
+    {
+        if (interval == 0)
+            throw std::invalid_argument("time-parallel: interval must be positive");
+    }
+
+    // Runs the program from the current state of cpu; returns its exit code
+    int Run(Cpu& cpu, Memory& mem)
+    {
+        std::vector<Checkpoint> checkpoints;
+        bool loaded = true;
+        Simulation fast{cpu};
+        fast.SetCheckpointHook(cpu.InstructionsRetired(), _interval, [&]() {
+            checkpoints.emplace_back();
+            loaded &= checkpoints.back().Load(Checkpoint::Capture(cpu, mem));
+        });
+        int exitCode = fast.Run();
+        if (!loaded)
+            throw std::runtime_error("time-parallel: failed to load a checkpoint");
+        _end = cpu.InstructionsRetired();
+
+        _models.assign(checkpoints.size(), TimingModel(_config));
+        _starts.resize(checkpoints.size());
+        ParallelFor(checkpoints.size(), _threads, [&](size_t i) {
+            _starts[i] = checkpoints[i].InstructionsRetired();
+            RunInterval(i ? &checkpoints[i - 1] : nullptr, checkpoints[i], _models[i]);
+        });
+
+        for (const auto& model : _models)
+            _total.AddStats(model);
+        return exitCode;
+    }
+
+    void Report(std::ostream& out) const
+    {
+        out << "time-parallel: intervals=" << _models.size() << " interval=" << _interval
+            << " warmup=" << _warmup << " threads=" << _threads << std::endl;
+        for (size_t i = 0; i < _models.size(); i++)
+        {
+            const TimingModel& model = _models[i];
+            out << "  interval[" << i << "]: start=" << _starts[i]
+                << " instructions=" << model.instructions
+                << " cycles=" << model.cycles
+                << " cpi=" << (model.instructions ? double(model.cycles) / model.instructions : 0.0)
+                << std::endl;
+        }
+        _total.Report(out);
+    }
+
+    // Stitched counters of all intervals
+    const TimingModel& Total() const
+    {
+        return _total;
+    }
+
+    const std::vector<TimingModel>& Intervals() const
+    {
+        return _models;
+    }
+
+private:
+    struct Warmer : RetireListener
+    {
+        TimingModel& model;
+
+        Warmer(TimingModel& model)
+            : model(model)
+        {
+        }
+
+        void OnRetire(const Instruction& instr, Word ip, Word /*word*/) override
+        {
+            model.Warm(TimingEvent::FromInstruction(instr, ip));
+        }
+    };
+
+    void RunInterval(const Checkpoint* previous, const Checkpoint& start, TimingModel& model) const
+    {
+        auto mem = std::make_unique<Memory>();
+        Cpu cpu{*mem};
+        Simulation sim{cpu};
+        sim.SetQuiet(true);
+
+        uint64_t begin = start.InstructionsRetired();
+        if (previous && _warmup)
+        {
+            previous->Restore(cpu, *mem);
+            sim.RunUntil(begin - _warmup);
+            Warmer warmer(model);
+            cpu.AddListener(&warmer);
+            sim.RunUntil(begin);
+            cpu.RemoveListener(&warmer);
+        }
+        else
+        {
+            start.Restore(cpu, *mem);
+        }
+
+        cpu.AddListener(&model);
+        sim.RunUntil(std::min(begin + _interval, _end));
+        cpu.RemoveListener(&model);
+    }
+
+    TimingConfig _config;
+    uint64_t _interval;
+    uint64_t _warmup;
+    unsigned _threads;
+    uint64_t _end = 0;
+    std::vector<TimingModel> _models;
+    std::vector<uint64_t> _starts;
+    TimingModel _total;
+};
+
+#endif //RISCV_SIM_TIMEPARALLEL_H
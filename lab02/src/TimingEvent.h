@@ -0,0 +1,53 @@
+#ifndef RISCV_SIM_TIMINGEVENT_H
+#define RISCV_SIM_TIMINGEVENT_H
+
+#include "Instruction.h"
+
+// Everything the timing models need to know about a retired instruction.
+// Built either from a live Instruction or from a replayed trace record.
+struct TimingEvent
+{
+    Word ip;
+    Word nextIp;
+    Word addr;
+    IType type;
+    RId dst;    // 0 means no destination
+    RId src1;   // 0 means no (or x0) source
+    RId src2;
+
+    static TimingEvent FromInstruction(const Instruction& instr, Word ip)
+    {
+        TimingEvent event;
+        event.ip = ip;
+        event.nextIp = instr._nextIp;
+        event.addr = instr._addr;
+        event.type = instr._type;
+        event.dst = instr._dst.value_or(0);
+        event.src1 = instr._src1.value_or(0);
+        event.src2 = instr._src2.value_or(0);
+        return event;
+    }
+
+    bool IsControl() const
+    {
+        return type == IType::Br || type == IType::J || type == IType::Jr;
+    }
+
+    bool IsTaken() const
+    {
+        return nextIp != ip + 4;
+    }
+
+    // Standard RISC-V calling convention hints (x1 = ra)
+    bool IsCall() const
+    {
+        return (type == IType::J || type == IType::Jr) && dst == 1;
+    }
+
+    bool IsReturn() const
+    {
+        return type == IType::Jr && dst == 0 && src1 == 1;
+    }
+};
+
+#endif //RISCV_SIM_TIMINGEVENT_H
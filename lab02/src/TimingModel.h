@@ -0,0 +1,243 @@
+#ifndef RISCV_SIM_TIMINGMODEL_H
+#define RISCV_SIM_TIMINGMODEL_H
+
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "BranchPredictor.h"
+#include "Cache.h"
+#include "CsrFile.h"
+#include "RetireListener.h"
+#include "TimingEvent.h"
+
+struct TimingConfig
+{
+    std::string name = "default";
+    CacheConfig icache;
+    CacheConfig dcache;
+    BranchPredictorConfig bpred;
+    Word mispredictPenalty = 2;
+    Word loadUsePenalty = 1;
+
+    // Parses whitespace separated key=value pairs, e.g.
+    // "name=big icache.size=8192 icache.ways=2 dcache.line=64 bpred.bht=1024"
+    // Sizes accept K/M suffixes. Unknown keys, malformed numbers and cache
+    // geometries the model cannot index (ways or line not a power of two)
+    // throw std::invalid_argument.
+    static TimingConfig Parse(const std::string& line)
+    {
+        TimingConfig config;
+        std::istringstream tokens(line);
+        std::string token;
+        while (tokens >> token)
+        {
+            auto eq = token.find('=');
+            if (eq == std::string::npos)
+                throw std::invalid_argument("timing config: expected key=value, got \"" + token + "\"");
+            config.Set(token.substr(0, eq), token.substr(eq + 1));
+        }
+        config.Validate("icache", config.icache);
+        config.Validate("dcache", config.dcache);
+        return config;
+    }
+
+    void Set(const std::string& key, const std::string& value)
+    {
+        if (key == "name") name = value;
+        else if (key == "icache.size") icache.sizeBytes = ParseSize(value);
+        else if (key == "icache.ways") icache.ways = ParseSize(value);
+        else if (key == "icache.line") icache.lineBytes = ParseSize(value);
+        else if (key == "icache.penalty") icache.missPenalty = ParseSize(value);
+        else if (key == "dcache.size") dcache.sizeBytes = ParseSize(value);
+        else if (key == "dcache.ways") dcache.ways = ParseSize(value);
+        else if (key == "dcache.line") dcache.lineBytes = ParseSize(value);
+        else if (key == "dcache.penalty") dcache.missPenalty = ParseSize(value);
+        else if (key == "bpred.bht") bpred.bhtEntries = ParseSize(value);
+        else if (key == "bpred.btb") bpred.btbEntries = ParseSize(value);
+        else if (key == "bpred.ras") bpred.rasDepth = ParseSize(value);
+        else if (key == "mispredict.penalty") mispredictPenalty = ParseSize(value);
+        else if (key == "loaduse.penalty") loadUsePenalty = ParseSize(value);
+        else throw std::invalid_argument("timing config: unknown key \"" + key + "\"");
+    }
+
+private:
+    static void Validate(const std::string& cache, const CacheConfig& config)
+    {
+        auto powerOfTwo = [](Word value) { return value != 0 && (value & (value - 1)) == 0; };
+        if (!powerOfTwo(config.ways))
+            throw std::invalid_argument("timing config: " + cache + ".ways must be a power of two");
+        if (!powerOfTwo(config.lineBytes))
+            throw std::invalid_argument("timing config: " + cache + ".line must be a power of two");
+    }
+
+    static Word ParseSize(const std::string& value)
+    {
+        size_t pos = 0;
+        unsigned long number = 0;
+        try
+        {
+            number = std::stoul(value, &pos, 0);
+        }
+        catch (const std::logic_error&)
+        {
+            pos = 0;
+        }
+        if (pos < value.size() && (value[pos] == 'K' || value[pos] == 'k'))
+        {
+            number *= 1024;
+            pos++;
+        }
+        else if (pos < value.size() && (value[pos] == 'M' || value[pos] == 'm'))
+        {
+            number *= 1024 * 1024;
+            pos++;
+        }
+        if (pos == 0 || pos != value.size() || value[0] == '-')
+            throw std::invalid_argument("timing config: bad number \"" + value + "\"");
+        return static_cast<Word>(number);
+    }
+};
+
+// In-order 5-stage pipeline approximation: one cycle per instruction plus
+// cache miss, branch mispredict and load-use stall penalties.
+class TimingModel : public RetireListener
+{
+public:
+    TimingModel(const TimingConfig& config = TimingConfig())
+        : _config(config),
+          _icache(config.icache),
+          _dcache(config.dcache),
+          _bpred(config.bpred)
+    {
+    }
+
+    void Process(const TimingEvent& event)
+    {
+        uint64_t cost = 1;
+
+        if (!_icache.Access(event.ip))
+        {
+            cost += _config.icache.missPenalty;
+            Count(HpmEvent::ICacheMisses);
+        }
+
+        if (event.type == IType::Ld || event.type == IType::St)
+        {
+            if (!_dcache.Access(event.addr))
+            {
+                cost += _config.dcache.missPenalty;
+                Count(HpmEvent::DCacheMisses);
+            }
+        }
+
+        if (event.IsControl() && _bpred.Process(event))
+        {
+            cost += _config.mispredictPenalty;
+            Count(HpmEvent::Mispredicts);
+        }
+
+        if (_loadDst != 0 && (event.src1 == _loadDst || event.src2 == _loadDst))
+        {
+            cost += _config.loadUsePenalty;
+            loadUseStalls++;
+            Count(HpmEvent::LoadUseStalls);
+        }
+        _loadDst = event.type == IType::Ld ? event.dst : 0;
+
+        instructions++;
+        cycles += cost;
+        if (_csrf)
+            _csrf->AddCycles(cost - 1);
+    }
+
+    // Functional warming: updates caches, predictor and load-use tracking
+    // like Process() but charges no cycles and counts nothing
+    void Warm(const TimingEvent& event)
+    {
+        _icache.Touch(event.ip);
+        if (event.type == IType::Ld || event.type == IType::St)
+            _dcache.Touch(event.addr);
+        if (event.IsControl())
+            _bpred.Warm(event);
+        _loadDst = event.type == IType::Ld ? event.dst : 0;
+    }
+
+    void OnRetire(const Instruction& instr, Word ip, Word /*word*/) override
+    {
+        Process(TimingEvent::FromInstruction(instr, ip));
+    }
+
+    // Makes the model drive the guest-visible cycle counter and the
+    // cache/predictor events of the mhpmcounter bank
+    void AttachCounters(CsrFile* csrf)
+    {
+        _csrf = csrf;
+    }
+
+    // Keeps the warmed cache and predictor state, clears the counters
+    void ResetStats()
+    {
+        _icache.ResetStats();
+        _dcache.ResetStats();
+        _bpred.ResetStats();
+        instructions = 0;
+        cycles = 0;
+        loadUseStalls = 0;
+    }
+
+    // Adds the counters of a model with the same configuration, e.g. one
+    // that simulated another interval of the same run
+    void AddStats(const TimingModel& other)
+    {
+        _icache.hits += other._icache.hits;
+        _icache.misses += other._icache.misses;
+        _dcache.hits += other._dcache.hits;
+        _dcache.misses += other._dcache.misses;
+        _bpred.predictions += other._bpred.predictions;
+        _bpred.mispredicts += other._bpred.mispredicts;
+        instructions += other.instructions;
+        cycles += other.cycles;
+        loadUseStalls += other.loadUseStalls;
+    }
+
+    void Report(std::ostream& out) const
+    {
+        out << "timing[" << _config.name << "]:"
+            << " instructions=" << instructions
+            << " cycles=" << cycles
+            << " cpi=" << (instructions ? double(cycles) / instructions : 0.0)
+            << " icache.miss=" << _icache.misses << "/" << _icache.hits + _icache.misses
+            << " dcache.miss=" << _dcache.misses << "/" << _dcache.hits + _dcache.misses
+            << " bpred.miss=" << _bpred.mispredicts << "/" << _bpred.predictions
+            << " loaduse=" << loadUseStalls
+            << std::endl;
+    }
+
+    const TimingConfig& GetConfig() const { return _config; }
+    const Cache& GetICache() const { return _icache; }
+    const Cache& GetDCache() const { return _dcache; }
+    const BranchPredictor& GetPredictor() const { return _bpred; }
+
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    uint64_t loadUseStalls = 0;
+
+private:
+    TimingConfig _config;
+    Cache _icache;
+    Cache _dcache;
+    BranchPredictor _bpred;
+    RId _loadDst = 0;
+    CsrFile* _csrf = nullptr;
+
+    void Count(HpmEvent event)
+    {
+        if (_csrf)
+            _csrf->CountEvent(event);
+    }
+};
+
+#endif //RISCV_SIM_TIMINGMODEL_H
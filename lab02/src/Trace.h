@@ -0,0 +1,323 @@
+#ifndef RISCV_SIM_TRACE_H
+#define RISCV_SIM_TRACE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Parallel.h"
+#include "RetireListener.h"
+
+// Retired instruction trace.
+//
+// File layout: TraceHeader, then a sequence of blocks. Every block is
+// {uint32 records, uint32 bytes, payload} and is encoded independently of
+// the others, so blocks can be decompressed in parallel.
+//
+// Record encoding inside a block: a flags byte, then
+//   ip      - zigzag varint delta from the previous nextIp (if not sequential)
+//   word    - raw 4 bytes
+//   nextIp  - zigzag varint delta from ip (if not ip + 4)
+//   addr    - zigzag varint delta from the previous addr (loads and stores)
+
+struct TraceRecord
+{
+    Word ip;
+    Word word;
+    Word nextIp;
+    Word addr;
+};
+
+struct TraceHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t blockRecords;
+};
+
+namespace TraceFormat
+{
+    constexpr char magic[8] = {'R', 'V', 'T', 'R', 'A', 'C', 'E', '1'};
+    constexpr uint32_t version = 1;
+    constexpr uint32_t defaultBlockRecords = 1u << 14;
+
+    constexpr uint8_t flagIp = 1u << 0;
+    constexpr uint8_t flagNextIp = 1u << 1;
+    constexpr uint8_t flagAddr = 1u << 2;
+
+    inline void PutVarint(std::vector<uint8_t>& out, SignedWord value)
+    {
+        uint32_t zigzag = (static_cast<uint32_t>(value) << 1u) ^ static_cast<uint32_t>(value >> 31);
+        while (zigzag >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(zigzag | 0x80));
+            zigzag >>= 7u;
+        }
+        out.push_back(static_cast<uint8_t>(zigzag));
+    }
+
+    inline SignedWord GetVarint(const uint8_t*& in, const uint8_t* end)
+    {
+        uint32_t zigzag = 0;
+        for (unsigned shift = 0; ; shift += 7)
+        {
+            if (in == end || shift > 28)
+                throw std::runtime_error("trace: corrupted varint");
+            uint8_t byte = *in++;
+            zigzag |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        return static_cast<SignedWord>((zigzag >> 1u) ^ -(zigzag & 1u));
+    }
+}
+
+class TraceWriter : public RetireListener
+{
+public:
+    TraceWriter(uint32_t blockRecords = TraceFormat::defaultBlockRecords)
+        : _blockRecords(blockRecords)
+    {
+    }
+
+    ~TraceWriter() override
+    {
+        Close();
+    }
+
+    bool Open(const std::string& filename)
+    {
+        _file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!_file.is_open())
+        {
+            std::cerr << "ERROR: trace: failed opening file \"" << filename << "\"" << std::endl;
+            return false;
+        }
+
+        TraceHeader header{};
+        std::memcpy(header.magic, TraceFormat::magic, sizeof(header.magic));
+        header.version = TraceFormat::version;
+        header.blockRecords = _blockRecords;
+        _file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ResetBlock();
+        return true;
+    }
+
+    void OnRetire(const Instruction& instr, Word ip, Word word) override
+    {
+        bool hasAddr = instr._type == IType::Ld || instr._type == IType::St;
+        Add(TraceRecord{ip, word, instr._nextIp, hasAddr ? instr._addr : 0}, hasAddr);
+    }
+
+    void Add(const TraceRecord& record, bool hasAddr)
+    {
+        uint8_t flags = 0;
+        if (record.ip != _prevNextIp)
+            flags |= TraceFormat::flagIp;
+        if (record.nextIp != record.ip + 4)
+            flags |= TraceFormat::flagNextIp;
+        if (hasAddr)
+            flags |= TraceFormat::flagAddr;
+
+        _block.push_back(flags);
+        if (flags & TraceFormat::flagIp)
+            TraceFormat::PutVarint(_block, record.ip - _prevNextIp);
+        for (unsigned i = 0; i < sizeof(Word); i++)
+            _block.push_back(static_cast<uint8_t>(record.word >> (8 * i)));
+        if (flags & TraceFormat::flagNextIp)
+            TraceFormat::PutVarint(_block, record.nextIp - record.ip);
+        if (flags & TraceFormat::flagAddr)
+        {
+            TraceFormat::PutVarint(_block, record.addr - _prevAddr);
+            _prevAddr = record.addr;
+        }
+
+        _prevNextIp = record.nextIp;
+        if (++_records == _blockRecords)
+            Flush();
+    }
+
+    void Close()
+    {
+        if (!_file.is_open())
+            return;
+        Flush();
+        _file.close();
+    }
+
+private:
+    void Flush()
+    {
+        if (_records == 0)
+            return;
+        uint32_t sizes[2] = {_records, static_cast<uint32_t>(_block.size() - 2 * sizeof(uint32_t))};
+        std::memcpy(_block.data(), sizes, sizeof(sizes));
+        _file.write(reinterpret_cast<const char*>(_block.data()), _block.size());
+        ResetBlock();
+    }
+
+    void ResetBlock()
+    {
+        _block.assign(2 * sizeof(uint32_t), 0);
+        _records = 0;
+        _prevNextIp = 0;
+        _prevAddr = 0;
+    }
+
+    std::ofstream _file;
+    std::vector<uint8_t> _block;
+    uint32_t _blockRecords;
+    uint32_t _records = 0;
+    Word _prevNextIp = 0;
+    Word _prevAddr = 0;
+};
+
+// Maps the whole trace file and indexes its blocks; decoding is const and
+// may be called from several threads at once.
+class TraceReader
+{
+public:
+    TraceReader() = default;
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    ~TraceReader()
+    {
+        if (_data)
+            munmap(const_cast<uint8_t*>(_data), _size);
+    }
+
+    bool Open(const std::string& filename)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            std::cerr << "ERROR: trace: failed opening file \"" << filename << "\"" << std::endl;
+            return false;
+        }
+
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(TraceHeader))
+        {
+            std::cerr << "ERROR: trace: file too small to be a trace" << std::endl;
+            close(fd);
+            return false;
+        }
+
+        _size = st.st_size;
+        void* mapped = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            std::cerr << "ERROR: trace: mmap failed" << std::endl;
+            return false;
+        }
+        _data = static_cast<const uint8_t*>(mapped);
+        madvise(mapped, _size, MADV_SEQUENTIAL);
+
+        TraceHeader header;
+        std::memcpy(&header, _data, sizeof(header));
+        if (std::memcmp(header.magic, TraceFormat::magic, sizeof(header.magic)) != 0
+            || header.version != TraceFormat::version)
+        {
+            std::cerr << "ERROR: trace: unknown file format" << std::endl;
+            return false;
+        }
+
+        size_t offset = sizeof(TraceHeader);
+        while (offset + 2 * sizeof(uint32_t) <= _size)
+        {
+            uint32_t sizes[2];
+            std::memcpy(sizes, _data + offset, sizeof(sizes));
+            offset += sizeof(sizes);
+            if (offset + sizes[1] > _size)
+            {
+                std::cerr << "ERROR: trace: truncated block" << std::endl;
+                return false;
+            }
+            _blocks.push_back(Block{offset, sizes[0], sizes[1]});
+            _records += sizes[0];
+            offset += sizes[1];
+        }
+        return true;
+    }
+
+    size_t BlockCount() const
+    {
+        return _blocks.size();
+    }
+
+    uint64_t RecordCount() const
+    {
+        return _records;
+    }
+
+    void DecodeBlock(size_t idx, std::vector<TraceRecord>& out) const
+    {
+        const Block& block = _blocks.at(idx);
+        const uint8_t* in = _data + block.offset;
+        const uint8_t* end = in + block.bytes;
+        Word prevNextIp = 0;
+        Word prevAddr = 0;
+
+        out.resize(block.records);
+        for (auto& record : out)
+        {
+            if (in == end)
+                throw std::runtime_error("trace: corrupted block");
+            uint8_t flags = *in++;
+
+            record.ip = prevNextIp;
+            if (flags & TraceFormat::flagIp)
+                record.ip += TraceFormat::GetVarint(in, end);
+
+            if (end - in < static_cast<ptrdiff_t>(sizeof(Word)))
+                throw std::runtime_error("trace: corrupted block");
+            record.word = 0;
+            for (unsigned i = 0; i < sizeof(Word); i++)
+                record.word |= static_cast<Word>(*in++) << (8 * i);
+
+            record.nextIp = record.ip + 4;
+            if (flags & TraceFormat::flagNextIp)
+                record.nextIp = record.ip + TraceFormat::GetVarint(in, end);
+
+            record.addr = 0;
+            if (flags & TraceFormat::flagAddr)
+            {
+                prevAddr += TraceFormat::GetVarint(in, end);
+                record.addr = prevAddr;
+            }
+            prevNextIp = record.nextIp;
+        }
+    }
+
+    // Decodes blocks [first, first + out.size()) spreading them over threads
+    void DecodeBlocks(size_t first, std::vector<std::vector<TraceRecord>>& out, unsigned threads) const
+    {
+        ParallelFor(out.size(), threads, [&](size_t i) { DecodeBlock(first + i, out[i]); });
+    }
+
+private:
+    struct Block
+    {
+        size_t offset;
+        uint32_t records;
+        uint32_t bytes;
+    };
+
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+    uint64_t _records = 0;
+    std::vector<Block> _blocks;
+};
+
+#endif //RISCV_SIM_TRACE_H
@@ -1,43 +1,400 @@
+#include "BbvProfiler.h"
+#include "CallGraphProfiler.h"
+#include "Fuzzer.h"
+#include "Checkpoint.h"
+#include "Coverage.h"
 #include "Cpu.h"
+#include "HostCounters.h"
 #include "Memory.h"
 #include "BaseTypes.h"
+#include "Options.h"
+#include "Profiler.h"
+#include "SamplingProfiler.h"
+#include "SampledTiming.h"
+#include "SimPoints.h"
+#include "Simulation.h"
+#include "SpmdEngine.h"
+#include "TimeParallel.h"
+#include "TimingModel.h"
+#include "Trace.h"
 
-#include <optional>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
 
-int main()
+static bool ReadFile(const std::filesystem::path& path, std::vector<uint8_t>& data)
 {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "ERROR: failed opening file \"" << path.string() << "\"" << std::endl;
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Runs every corpus file, then --fuzz-runs random mutations of them;
+// with --coverage, mutants reaching new edges join the corpus. ahead is the
+// running decode-ahead helper, if any
+static int Fuzz(const Options& options, Cpu& cpu, Memory& mem, DecodeAhead* ahead)
+{
+    std::vector<std::vector<uint8_t>> corpus;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(options.fuzzCorpus.value(), error))
+    {
+        if (!entry.is_regular_file())
+            continue;
+        corpus.emplace_back();
+        if (!ReadFile(entry.path(), corpus.back()))
+            return 1;
+    }
+    if (error)
+    {
+        std::cerr << "ERROR: fuzz: " << options.fuzzCorpus.value() << ": " << error.message() << std::endl;
+        return 1;
+    }
+    if (corpus.empty())
+        corpus.emplace_back();
+
+    FuzzSession session(cpu, mem, options.fuzzTimeout);
+    if (ahead)
+        session.SetDecodeAhead(ahead);
+    std::unique_ptr<EdgeCoverage> coverage;
+    if (options.coverage)
+    {
+        coverage = std::make_unique<EdgeCoverage>();
+        session.SetCoverage(coverage.get());
+    }
+    std::mt19937 rng(1);
+    constexpr size_t maxInputSize = 64 * 1024;
+    size_t seeds = corpus.size();
+    for (uint64_t run = 0; run < seeds + options.fuzzRuns; run++)
+    {
+        std::vector<uint8_t> input = run < seeds
+                ? corpus[run] : FuzzSession::Mutate(corpus[rng() % corpus.size()], rng, maxInputSize);
+        auto result = session.Run(input);
+        if (!result.consumedInput)
+        {
+            std::cerr << "ERROR: fuzz: the program did not ask for an input (FUZZ_INPUT)" << std::endl;
+            return 1;
+        }
+        if (result.newCoverage && run >= seeds)
+            corpus.push_back(input);
+        if (options.fuzzCrashes && result.exitCode.value_or(1) != 0)
+        {
+            auto path = std::filesystem::path(options.fuzzCrashes.value()) / ("crash-" + std::to_string(run));
+            std::ofstream out(path, std::ios::out | std::ios::binary);
+            out.write(reinterpret_cast<const char*>(input.data()), input.size());
+        }
+    }
+    session.Report(std::cout);
+    if (ahead)
+        ahead->Report(std::cout);
+    return 0;
+}
+
+// Runs the program on every file of the --spmd directory, a batch of
+// SpmdEngine::lanes inputs at a time
+static int Spmd(const Options& options, const Memory& mem, Word entry)
+{
+    std::vector<std::filesystem::path> files;
+    std::error_code error;
+    for (const auto& file : std::filesystem::directory_iterator(options.spmdInputs.value(), error))
+        if (file.is_regular_file())
+            files.push_back(file.path());
+    if (error)
+    {
+        std::cerr << "ERROR: spmd: " << options.spmdInputs.value() << ": " << error.message() << std::endl;
+        return 1;
+    }
+    std::sort(files.begin(), files.end());
+
+    for (size_t first = 0; first < files.size(); first += SpmdEngine::lanes)
+    {
+        SpmdEngine spmd(mem, entry, std::min(SpmdEngine::lanes, files.size() - first));
+        for (size_t l = 0; l < spmd.Active(); l++)
+        {
+            std::vector<uint8_t> input;
+            if (!ReadFile(files[first + l], input))
+                return 1;
+            spmd.SetInput(l, std::move(input));
+        }
+        spmd.Run(options.fuzzTimeout);
+        for (size_t l = 0; l < spmd.Active(); l++)
+        {
+            const auto& lane = spmd.Result(l);
+            std::cout << "spmd: " << files[first + l].filename().string() << " instructions=" << lane.instructions;
+            if (lane.exitCode)
+                std::cout << " exit=" << lane.exitCode.value();
+            else
+                std::cout << (lane.faulted ? " unsupported instruction" : " timeout");
+            std::cout << std::endl;
+        }
+        spmd.Report(std::cout);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!options.Parse(argc, argv))
+        return 1;
+
+    Word entry = 0x200;
+
     Memory mem;
-    mem.LoadElf("program");
+    SymbolTable symbols;
+    if (!options.restoreFile || options.NeedSymbols() || options.predecode)
+    {
+        if (!mem.LoadElf(options.program, options.NeedSymbols() ? &symbols : nullptr))
+            return 1;
+    }
     Cpu cpu{mem};
-    cpu.Reset(0x200);
+    cpu.Reset(entry);
+
+    if (options.decodeCache)
+        cpu.GetDecoder().SetCacheEntries(options.decodeCache.value());
 
-    int32_t print_int = 0;
-    while (true)
+    PredecodedText predecoded;
+    if (options.predecode)
     {
-        cpu.ProcessInstruction();
-        std::optional<CpuToHostData> msg = cpu.GetMessage();
-        if (!msg)
-            continue;
+        predecoded.EnableFusion(options.fuse);
+        predecoded.Build(mem);
+        cpu.SetPredecoded(&predecoded);
+    }
+
+    UopEngine uops;
+    if (options.uops)
+        cpu.SetUopEngine(&uops);
+
+    if (options.restoreFile)
+    {
+        Checkpoint checkpoint;
+        if (!checkpoint.Open(options.restoreFile.value()))
+            return 1;
+        checkpoint.Restore(cpu, mem);
+        entry = cpu.Ip();
+    }
+
+    // The predecoded table already has every instruction of the text, and
+    // on a single host thread the helper only takes time from the Cpu. It
+    // starts after the restore, which writes the memory it reads
+    DecodeAhead ahead{mem};
+    bool decodeAhead = options.decodeAhead && !options.predecode && HostThreads() > 1;
+    if (decodeAhead)
+    {
+        ahead.Start();
+        cpu.SetDecodeAhead(&ahead);
+    }
+
+    if (options.fuzzCorpus)
+        return Fuzz(options, cpu, mem, decodeAhead ? &ahead : nullptr);
+    if (options.spmdInputs)
+        return Spmd(options, mem, entry);
+
+    if (options.timeParallel)
+    {
+        try
+        {
+            TimeParallelRun run(TimingConfig::Parse(options.timingConfig.value_or("")), options.timeParallel,
+                                options.timeParallelWarmup, options.threads ? options.threads : HostThreads());
+            int exitCode = run.Run(cpu, mem);
+            run.Report(std::cout);
+            return exitCode;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    Simulation sim{cpu};
+    std::optional<bool> checkpointSaved;
+    if (options.checkpointFile)
+    {
+        sim.SetCheckpointHook(options.checkpointAt, 0, [&]() {
+            checkpointSaved = Checkpoint::Save(options.checkpointFile.value(), cpu, mem);
+        });
+    }
+
+    TraceWriter trace;
+    if (options.traceFile)
+    {
+        if (!trace.Open(options.traceFile.value()))
+            return 1;
+        sim.AddInstrument(&trace);
+    }
+
+    std::unique_ptr<TimingModel> timing;
+    std::unique_ptr<SampledTiming> sampled;
+    if (options.timingConfig || options.smartsPeriod)
+    {
+        try
+        {
+            timing = std::make_unique<TimingModel>(TimingConfig::Parse(options.timingConfig.value_or("")));
+            if (options.smartsPeriod)
+                sampled = std::make_unique<SampledTiming>(
+                        *timing, SamplingConfig{options.smartsUnit, options.smartsWarmup, options.smartsPeriod});
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return 1;
+        }
+        if (sampled)
+        {
+            // Cycles of a sampled model do not describe the whole run
+            sim.AddInstrument(sampled.get());
+        }
+        else
+        {
+            timing->AttachCounters(&cpu.Csrs());
+            sim.SetTiming(timing.get());
+            sim.AddInstrument(timing.get());
+        }
+    }
+
+    std::unique_ptr<Profiler> profiler;
+    if (options.profile)
+    {
+        profiler = std::make_unique<Profiler>();
+        sim.AddInstrument(profiler.get());
+    }
+
+    std::unique_ptr<SamplingProfiler> sampler;
+    if (options.samplePeriod)
+    {
+        sampler = std::make_unique<SamplingProfiler>(symbols, entry, options.samplePeriod);
+        sim.AddInstrument(sampler.get());
+    }
 
-        auto type = msg.value().unpacked.type;
-        auto data = msg.value().unpacked.data;
+    // Registered after the timing model so it sees this instruction's cycles
+    std::unique_ptr<CallGraphProfiler> callgraph;
+    if (options.callgraphFile)
+    {
+        callgraph = std::make_unique<CallGraphProfiler>(symbols, entry, sampled ? nullptr : timing.get());
+        sim.AddInstrument(callgraph.get());
+    }
+
+    std::unique_ptr<BbvProfiler> bbv;
+    if (options.bbvFile)
+    {
+        bbv = std::make_unique<BbvProfiler>(options.bbvInterval);
+        sim.AddInstrument(bbv.get());
+    }
+
+    std::unique_ptr<EdgeCoverage> coverage;
+    if (options.coverage)
+    {
+        coverage = std::make_unique<EdgeCoverage>();
+        cpu.SetCoverage(coverage.get());
+    }
+
+    std::unique_ptr<HostCounters> host;
+    if (options.hostCounters)
+    {
+        host = std::make_unique<HostCounters>();
+        sim.SetHostCounters(host.get());
+    }
+
+    sim.SetRoiMode(options.roi);
+    int exitCode = sim.Run();
+    if (options.checkpointFile && !checkpointSaved)
+        std::cerr << "ERROR: checkpoint: program exited before instruction " << options.checkpointAt << std::endl;
+    if (options.checkpointFile && !checkpointSaved.value_or(false))
+        return 1;
+
+    trace.Close();
+    if (host)
+        host->Report(std::cout);
+    sim.ReportPhases(std::cout);
+    if (sampled)
+        sampled->Report(std::cout);
+    else if (timing)
+        timing->Report(std::cout);
+    if (profiler)
+        profiler->Report(std::cout, mem, options.profileTop);
+    if (sampler)
+    {
+        std::ofstream folded(options.foldedFile);
+        if (!folded.is_open())
+        {
+            std::cerr << "ERROR: failed opening file \"" << options.foldedFile << "\"" << std::endl;
+            return 1;
+        }
+        sampler->WriteFolded(folded);
+    }
+    if (callgraph)
+    {
+        std::ofstream out(options.callgraphFile.value());
+        if (!out.is_open())
+        {
+            std::cerr << "ERROR: failed opening file \"" << options.callgraphFile.value() << "\"" << std::endl;
+            return 1;
+        }
+        callgraph->WriteCallgrind(out, options.program);
+        callgraph->Report(std::cout, 20);
+    }
+    if (options.predecode)
+        predecoded.Report(std::cout);
+    if (options.fuse)
+    {
+        // Every fused pair saves one dispatch
+        uint64_t instructions = cpu.InstructionsRetired();
+        uint64_t dispatches = instructions - predecoded.fused;
+        std::cout << "fusion: instructions=" << instructions << " dispatches=" << dispatches
+                  << " dispatches-per-instruction=" << (instructions ? double(dispatches) / instructions : 0.0)
+                  << std::endl;
+    }
+    if (options.uops)
+        uops.Report(std::cout);
+    if (decodeAhead)
+        ahead.Report(std::cout);
+    else if (options.decodeAhead)
+        std::cout << "decode-ahead: off (" << (options.predecode ? "--predecode" : "single host thread") << ")"
+                  << std::endl;
+    if (options.decodeCache)
+    {
+        const Decoder& decoder = cpu.GetDecoder();
+        std::cout << "decode-cache: entries=" << decoder.CacheEntries() << " hits=" << decoder.cacheHits
+                  << " misses=" << decoder.cacheMisses << " hit-rate=" << 100 * decoder.CacheHitRate() << "%"
+                  << std::endl;
+    }
+    if (coverage)
+        std::cout << "coverage: edges=" << coverage->Edges() << (coverage->Shared() ? " (shared map)" : "") << std::endl;
+    if (bbv)
+    {
+        bbv->Finish();
+        const std::string& file = options.bbvFile.value();
+        std::ofstream out(file);
+        if (!out.is_open())
+        {
+            std::cerr << "ERROR: failed opening file \"" << file << "\"" << std::endl;
+            return 1;
+        }
+        bbv->WriteBbv(out);
+        std::cout << "bbv: " << bbv->Intervals().size() << " intervals, " << bbv->BlockCount() << " blocks" << std::endl;
 
-        if(type == CpuToHostType::ExitCode) {
-            if(data == 0) {
-                fprintf(stderr, "PASSED\n");
-                return 0;
-            } else {
-                fprintf(stderr, "FAILED: exit code = %d\n", data);
-                return data;
+        if (options.simpoints)
+        {
+            auto simpoints = SimPoints::Select(bbv->Intervals(), bbv->Lengths(), options.simpoints);
+            std::ofstream points(file + ".simpoints");
+            std::ofstream weights(file + ".weights");
+            if (!points.is_open() || !weights.is_open())
+            {
+                std::cerr << "ERROR: failed opening file \"" << file << ".simpoints\"" << std::endl;
+                return 1;
             }
-            break;
-        } else if(type == CpuToHostType::PrintChar) {
-            fprintf(stderr, "%c", (char)data);
-        } else if(type == CpuToHostType::PrintIntLow) {
-            print_int = uint32_t(data);
-        } else if(type == CpuToHostType::PrintIntHigh) {
-            print_int |= uint32_t(data) << 16;
-            fprintf(stderr, "%d", print_int);
+            SimPoints::Write(simpoints, points, weights);
+            for (const auto& simpoint : simpoints)
+                std::cout << "simpoint: interval=" << simpoint.interval << " start=" << simpoint.interval * options.bbvInterval
+                          << " weight=" << simpoint.weight << std::endl;
         }
     }
+    return exitCode;
 }
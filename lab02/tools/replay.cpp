@@ -0,0 +1,104 @@
+#include "Options.h"
+#include "Replay.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// riscv_replay: runs the timing models described in a config file (one
+// TimingConfig per line, '#' starts a comment) over a trace recorded with
+// riscv_sim --trace. Every configuration sees the same instruction stream.
+
+static void Usage()
+{
+    std::cerr << "usage: riscv_replay [--threads N] <trace-file> [config-file]" << std::endl;
+}
+
+static bool ReadConfigs(const std::string& filename, std::vector<TimingConfig>& configs)
+{
+    std::ifstream file(filename);
+    if (!file.is_open())
+    {
+        std::cerr << "ERROR: replay: failed opening config file \"" << filename << "\"" << std::endl;
+        return false;
+    }
+
+    std::string line;
+    for (unsigned lineNo = 1; std::getline(file, line); lineNo++)
+    {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        try
+        {
+            configs.push_back(TimingConfig::Parse(line));
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "ERROR: " << filename << ":" << lineNo << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = HostThreads();
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads")
+        {
+            std::optional<std::string> value;
+            if (i + 1 < argc)
+                value = argv[++i];
+            else
+                std::cerr << "ERROR: option " << arg << " requires a value" << std::endl;
+            if (!Options::ParseNumber(arg, value, threads))
+                return 1;
+        }
+        else if (arg.rfind("--", 0) == 0)
+        {
+            Usage();
+            return 1;
+        }
+        else
+            positional.push_back(arg);
+    }
+    if (positional.empty() || positional.size() > 2)
+    {
+        Usage();
+        return 1;
+    }
+
+    std::vector<TimingConfig> configs;
+    if (positional.size() == 2)
+    {
+        if (!ReadConfigs(positional[1], configs))
+            return 1;
+    }
+    else
+    {
+        configs.emplace_back();
+    }
+
+    TraceReader reader;
+    if (!reader.Open(positional[0]))
+        return 1;
+
+    std::vector<TimingModel> models(configs.begin(), configs.end());
+
+    auto start = std::chrono::steady_clock::now();
+    ReplayEngine(reader, threads).Run(models);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    for (const auto& model : models)
+        model.Report(std::cout);
+    std::cerr << "replayed " << reader.RecordCount() << " instructions x " << models.size()
+              << " configs in " << elapsed.count() << " s on " << threads << " threads" << std::endl;
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include "doctest.h"
+
+#include "Instructions.h"
+#include "BatchDecoder.h"
+#include "Cpu.h"
+#include "PredecodedText.h"
+
+#include <cstdio>
+#include <elf.h>
+#include <fstream>
+#include <random>
+#include <vector>
+
+static bool SameDecode(const Instruction& a, const Instruction& b)
+{
+    return a._type == b._type && a._aluFunc == b._aluFunc && a._brFunc == b._brFunc
+           && a._dst == b._dst && a._src1 == b._src1 && a._src2 == b._src2
+           && a._csr == b._csr && a._imm == b._imm;
+}
+
+// ELF32 image with code as its only, executable, segment at addr
+static std::vector<char> MakeElf(const std::vector<Word>& code, Word addr)
+{
+    constexpr size_t codeOffset = 0x100;
+    std::vector<char> image(codeOffset + code.size() * sizeof(Word), 0);
+
+    Elf32_Ehdr ehdr{};
+    std::memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS32;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_type = ET_EXEC;
+    ehdr.e_machine = EM_RISCV;
+    ehdr.e_entry = addr;
+    ehdr.e_phoff = sizeof(Elf32_Ehdr);
+    ehdr.e_phentsize = sizeof(Elf32_Phdr);
+    ehdr.e_phnum = 1;
+
+    Elf32_Phdr phdr{};
+    phdr.p_type = PT_LOAD;
+    phdr.p_offset = codeOffset;
+    phdr.p_vaddr = phdr.p_paddr = addr;
+    phdr.p_filesz = phdr.p_memsz = code.size() * sizeof(Word);
+    phdr.p_flags = PF_R | PF_X;
+
+    std::memcpy(image.data(), &ehdr, sizeof(ehdr));
+    std::memcpy(image.data() + sizeof(ehdr), &phdr, sizeof(phdr));
+    std::memcpy(image.data() + codeOffset, code.data(), code.size() * sizeof(Word));
+    return image;
+}
+
+TEST_SUITE("BatchDecoder"){
+    TEST_CASE("Matches the scalar decoder"){
+        std::vector<Word> words = {ADD, SUB, SRA, ANDI, SRAI, SRLI, SLLI, LW, SW, LUI, AUIPC,
+                                   BEQ, BLTU, JAL, JALR, 0x00008067, 0x78029073, 0xc0202573};
+        std::mt19937 rng(1);
+        while (words.size() < 1003)
+        {
+            // Random words with a real opcode most of the time
+            Word word = rng();
+            if (rng() % 4)
+                word = (word & ~0x7fu) | (0x03u + ((rng() % 32) << 2u));
+            words.push_back(word);
+        }
+
+        for (auto isa : {BatchDecoder::Isa::Scalar, BatchDecoder::Isa::Sse41, BatchDecoder::Isa::Avx2})
+        {
+            if (!BatchDecoder::Supported(isa))
+                continue;
+            CAPTURE(BatchDecoder::Name(isa));
+            DecodedWords decoded;
+            BatchDecoder::Decode(words.data(), words.size(), decoded, isa);
+            REQUIRE(decoded.Size() == words.size());
+
+            size_t mismatches = 0;
+            for (size_t i = 0; i < words.size(); i++)
+            {
+                Instruction batch{};
+                Instruction scalar{};
+                decoded.Expand(i, batch);
+                Decoder::Decode(words[i], scalar);
+                mismatches += !SameDecode(batch, scalar);
+            }
+            CHECK(mismatches == 0);
+        }
+    }
+
+    TEST_CASE("Predecoded text"){
+        std::vector<Word> code = {
+            0x00300393,     // li t2, 3
+            0x00130313,     // loop: addi t1, t1, 1
+            0xfff38393,     // addi t2, t2, -1
+            0xfe039ce3,     // bnez t2, loop
+            0x00000013,     // nop
+        };
+        const char* file = "batch_decoder_tests.elf";
+        auto image = MakeElf(code, 0x200);
+        std::ofstream(file, std::ios::binary).write(image.data(), image.size());
+
+        Memory mem;
+        REQUIRE(mem.LoadElf(file));
+        std::remove(file);
+        REQUIRE(mem.TextSegments().size() == 1);
+        CHECK(mem.TextSegments()[0].addr == 0x200);
+        CHECK(mem.TextSegments()[0].bytes == 5 * 4);
+
+        PredecodedText predecoded;
+        predecoded.Build(mem);
+        CHECK(predecoded.Words() == 5);
+        CHECK(predecoded.Blocks() == 3);
+        CHECK(predecoded.Leader(0x200));
+        CHECK(predecoded.Leader(0x204));
+        CHECK(!predecoded.Leader(0x208));
+        CHECK(predecoded.Leader(0x210));
+        CHECK(predecoded.BranchTargets() == std::vector<Word>{0x204});
+
+        Cpu cpu{mem};
+        cpu.SetPredecoded(&predecoded);
+        cpu.Reset(0x200);
+        for (int i = 0; i < 1 + 3 * 3; i++)
+            cpu.ProcessInstruction();
+        CHECK(cpu.Registers().Get(6) == 3);
+        CHECK(predecoded.hits == 10);
+
+        // The stale entry is decoded from memory again
+        mem.Store(0x204, 0x00230313);   // addi t1, t1, 2
+        cpu.Reset(0x200);
+        cpu.Registers().Set(6, 0);
+        for (int i = 0; i < 1 + 3 * 3; i++)
+            cpu.ProcessInstruction();
+        CHECK(cpu.Registers().Get(6) == 6);
+        CHECK(predecoded.misses == 3);
+    }
+
+    TEST_CASE("Fused pairs"){
+        std::vector<Word> code = {
+            0x12345537,     // lui a0, 0x12345
+            0x67850513,     // addi a0, a0, 0x678
+            0x00000297,     // auipc t0, 0
+            0x0242a303,     // lw t1, 0x24(t0)
+            0x00138393,     // loop: addi t2, t2, 1
+            0xfeb39ee3,     // bne t2, a1, loop
+            0x00000097,     // auipc ra, 0
+            0x00c080e7,     // jalr ra, 12(ra)
+            0x00000013,     // nop, jumped over
+            0x00258593,     // addi a1, a1, 2
+            0xfddff06f,     // j 0x204, into the lui+addi pair
+            0x0badf00d,     // data
+        };
+        const char* file = "batch_decoder_tests.elf";
+        auto image = MakeElf(code, 0x200);
+        std::ofstream(file, std::ios::binary).write(image.data(), image.size());
+
+        Memory mem;
+        REQUIRE(mem.LoadElf(file));
+        std::remove(file);
+
+        PredecodedText predecoded;
+        predecoded.EnableFusion(true);
+        predecoded.Build(mem);
+        CHECK(predecoded.FusedPairs() == 4);
+
+        // Same state as the plain Cpu whenever both retired as many instructions
+        Cpu fused{mem};
+        fused.SetPredecoded(&predecoded);
+        Cpu reference{mem};
+        for (Cpu* cpu : {&fused, &reference})
+        {
+            cpu->Reset(0x200);
+            cpu->Registers().Set(11, 3);
+        }
+        size_t mismatches = 0;
+        uint64_t steps = 0;
+        while (fused.InstructionsRetired() < 200)
+        {
+            fused.ProcessInstruction(2);
+            steps++;
+            while (reference.InstructionsRetired() < fused.InstructionsRetired())
+                reference.ProcessInstruction();
+            mismatches += fused.Ip() != reference.Ip();
+            for (RId r = 0; r < 32; r++)
+                mismatches += fused.Registers().Get(r) != reference.Registers().Get(r);
+        }
+        CHECK(mismatches == 0);
+        CHECK(fused.Registers().Get(6) == 0x0badf00d);
+        CHECK(predecoded.fused > 0);
+        CHECK(steps == fused.InstructionsRetired() - predecoded.fused);
+
+        // A budget of one never fuses
+        uint64_t pairs = predecoded.fused;
+        fused.SetIp(0x200);
+        fused.ProcessInstruction();
+        CHECK(predecoded.fused == pairs);
+        CHECK(fused.Ip() == 0x204);
+    }
+}
@@ -0,0 +1,71 @@
+#include "doctest.h"
+
+#include "CsrFile.h"
+#include "Decoder.h"
+#include "Disassembler.h"
+
+// csrr a0, <csr> / csrw <csr>, a0
+static Word Csrr(CsrIdx csr, unsigned n = 0) { return ((static_cast<Word>(csr) + n) << 20u) | (fnCSRRS << 12u) | (10u << 7u) | 0b1110011u; }
+static Word Csrw(CsrIdx csr, unsigned n = 0) { return ((static_cast<Word>(csr) + n) << 20u) | (10u << 15u) | (fnCSRRW << 12u) | 0b1110011u; }
+
+static Word ReadCsr(CsrFile& csrf, CsrIdx csr, unsigned n = 0)
+{
+    auto instr = Decoder().Decode(Csrr(csr, n));
+    csrf.Read(instr);
+    return instr->_csrVal;
+}
+
+static void WriteCsr(CsrFile& csrf, CsrIdx csr, Word value, unsigned n = 0)
+{
+    auto instr = Decoder().Decode(Csrw(csr, n));
+    instr->_data = value;
+    csrf.Write(instr);
+}
+
+static void Retire(CsrFile& csrf, Word word, Word ip, Word nextIp)
+{
+    auto instr = Decoder().Decode(word);
+    instr->_nextIp = nextIp;
+    csrf.InstructionExecuted(instr, ip);
+}
+
+TEST_SUITE("CsrFile"){
+    TEST_CASE("64-bit counters"){
+        CsrFile csrf;
+        csrf.Reset();
+        WriteCsr(csrf, CsrIdx::Minstret, 0xffffffff);
+        Retire(csrf, 0x00000013, 0x200, 0x204);
+        CHECK(ReadCsr(csrf, CsrIdx::Instret) == 0);
+        CHECK(ReadCsr(csrf, CsrIdx::Instreth) == 1);
+        CHECK(ReadCsr(csrf, CsrIdx::Cycle) == 1);
+        CHECK(csrf.InstructionsRetired() == 0x100000000ull);
+    }
+
+    TEST_CASE("Event counters"){
+        CsrFile csrf;
+        csrf.Reset();
+        WriteCsr(csrf, CsrIdx::Mhpmevent, static_cast<Word>(HpmEvent::Loads), 3);
+        WriteCsr(csrf, CsrIdx::Mhpmevent, static_cast<Word>(HpmEvent::TakenBranches), 4);
+        CHECK(ReadCsr(csrf, CsrIdx::Mhpmevent, 4) == static_cast<Word>(HpmEvent::TakenBranches));
+
+        Retire(csrf, 0x00012503, 0x200, 0x204);  // lw
+        Retire(csrf, 0x00012503, 0x204, 0x208);  // lw
+        Retire(csrf, 0x00b50463, 0x208, 0x210);  // beq, taken
+        Retire(csrf, 0x00b50463, 0x210, 0x214);  // beq, not taken
+
+        CHECK(ReadCsr(csrf, CsrIdx::Hpmcounter, 3) == 2);
+        CHECK(ReadCsr(csrf, CsrIdx::Mhpmcounter, 4) == 1);
+        CHECK(ReadCsr(csrf, CsrIdx::Hpmcounter, 5) == 0);
+
+        csrf.CountEvent(HpmEvent::DCacheMisses);  // not selected
+        WriteCsr(csrf, CsrIdx::Mhpmcounterh, 7, 3);
+        CHECK(ReadCsr(csrf, CsrIdx::Hpmcounterh, 3) == 7);
+        CHECK(ReadCsr(csrf, CsrIdx::Hpmcounter, 3) == 2);
+    }
+
+    TEST_CASE("Names"){
+        CHECK(Disassembler::Disassemble(Csrr(CsrIdx::Cycleh)) == "csrr a0, cycleh");
+        CHECK(Disassembler::Disassemble(Csrw(CsrIdx::Mhpmevent, 3)) == "csrw mhpmevent3, a0");
+        CHECK(Disassembler::Disassemble(Csrr(CsrIdx::Hpmcounterh, 31)) == "csrr a0, hpmcounter31h");
+    }
+}
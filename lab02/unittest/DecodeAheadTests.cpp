@@ -0,0 +1,166 @@
+#include "doctest.h"
+
+#include "Cpu.h"
+#include "DecodeAhead.h"
+#include "Fuzzer.h"
+#include "Parallel.h"
+#include "TestImages.h"
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+// The helper runs whenever the host schedules it
+static bool WaitQueued(const DecodeAhead& ahead, size_t count)
+{
+    for (int i = 0; i < 1000 && ahead.Queued() < count; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return ahead.Queued() >= count;
+}
+
+// Cpu at the entry point of MakeImage
+static std::unique_ptr<Cpu> StartCpu(Memory& mem)
+{
+    auto cpu = std::make_unique<Cpu>(mem);
+    cpu->Reset(0x200);
+    return cpu;
+}
+
+TEST_SUITE("DecodeAhead"){
+    TEST_CASE("Queue across threads"){
+        SpscQueue<uint32_t, 16> queue;
+        std::thread producer([&]() {
+            for (uint32_t i = 0; i < 10000; i++)
+                while (!queue.Push(i))
+                    std::this_thread::yield();
+        });
+        bool ordered = true;
+        for (uint32_t expected = 0; expected < 10000;)
+        {
+            if (uint32_t* item = queue.Front())
+            {
+                ordered = ordered && *item == expected++;
+                queue.Pop();
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+        producer.join();
+        CHECK(ordered);
+        CHECK(queue.Size() == 0);
+    }
+
+    TEST_CASE("Predicted path"){
+        auto mem = std::make_unique<Memory>();
+        StoreCode(*mem, 0x200, {
+            0x00500593,     // li a1, 5
+            0xfff58593,     // loop: addi a1, a1, -1
+            0xfe059ee3,     // bnez a1, loop
+            0x00008067,     // ret
+        });
+        DecodeAhead ahead{*mem};
+        ahead.Start();
+
+        // Nothing queued yet, the Cpu decodes and the helper starts
+        auto first = ahead.Decode(0x200, mem->Request(0x200));
+        CHECK(first->_type == IType::Alu);
+        CHECK(ahead.misses == 1);
+        REQUIRE(WaitQueued(ahead, 3));
+
+        // The backward branch is predicted taken
+        CHECK(ahead.Decode(0x204, mem->Request(0x204))->_type == IType::Alu);
+        CHECK(ahead.Decode(0x208, mem->Request(0x208))->_type == IType::Br);
+        CHECK(ahead.Decode(0x204, mem->Request(0x204))->_imm == Word(-1));
+        CHECK(ahead.hits == 3);
+
+        // The fall-through was not predicted
+        REQUIRE(WaitQueued(ahead, 1));
+        auto ret = ahead.Decode(0x20c, mem->Request(0x20c));
+        CHECK(ret->_type == IType::Jr);
+        CHECK(ahead.misses == 2);
+
+        // Entries decoded from an older word are not used
+        ahead.Decode(0x200, mem->Request(0x200));
+        REQUIRE(WaitQueued(ahead, 1));
+        mem->Store(0x204, 0x00158593);  // addi a1, a1, 1
+        CHECK(ahead.Decode(0x204, mem->Request(0x204))->_imm == Word(1));
+        CHECK(ahead.misses == 4);
+        ahead.Stop();
+    }
+
+    TEST_CASE("Same state as the Cpu"){
+        std::vector<Word> code = {
+            0x00a00593,     // li a1, 10
+            0x00000613,     // li a2, 0
+            0x00b60633,     // loop: add a2, a2, a1
+            0x008000ef,     // jal ra, 0x214
+            0xff9ff06f,     // j loop
+            0xfff58593,     // addi a1, a1, -1
+            0x00059463,     // bnez a1, 0x220, over the li
+            0x00a00593,     // li a1, 10
+            0x00008067,     // ret
+        };
+        auto mem = MakeImage(code);
+        auto referenceMem = MakeImage(code);
+        DecodeAhead ahead{*mem};
+        ahead.Start();
+        auto cpu = StartCpu(*mem);
+        cpu->SetDecodeAhead(&ahead);
+        auto reference = StartCpu(*referenceMem);
+
+        size_t mismatches = 0;
+        for (int i = 0; i < 2000; i++)
+        {
+            cpu->ProcessInstruction();
+            reference->ProcessInstruction();
+            mismatches += cpu->Ip() != reference->Ip();
+            for (RId r = 0; r < 32; r++)
+                mismatches += cpu->Registers().Get(r) != reference->Registers().Get(r);
+        }
+        CHECK(mismatches == 0);
+        CHECK(ahead.hits + ahead.misses == 2000);
+    }
+
+    TEST_CASE("Fuzz session"){
+        // Exits with 3 * the first input byte, counted in a loop; the session
+        // writes the input and resets the dirty pages while the helper decodes
+        auto mem = MakeImage({
+            0x00010537,     // lui a0, 0x10
+            0x01000593,     // li a1, 16
+            0x000802b7,     // lui t0, 0x80 (FuzzInput)
+            0x78029073,     // csrw mtohost, t0
+            0x00052283,     // lw t0, 0(a0)
+            0x0ff2f293,     // andi t0, t0, 0xff
+            0x00000613,     // li a2, 0
+            0x00028863,     // loop: beqz t0, done
+            0x00360613,     // addi a2, a2, 3
+            0xfff28293,     // addi t0, t0, -1
+            0xff5ff06f,     // j loop
+            0x0ff67613,     // done: andi a2, a2, 0xff
+            0x78061073,     // csrw mtohost, a2 (ExitCode)
+        });
+        DecodeAhead ahead{*mem};
+        ahead.Start();
+        auto cpu = StartCpu(*mem);
+        FuzzSession session(*cpu, *mem, 10000);
+        session.SetDecodeAhead(&ahead);
+
+        std::mt19937 rng(1);
+        size_t wrong = 0;
+        for (int run = 0; run < 200; run++)
+        {
+            std::vector<uint8_t> input(rng() % 4);
+            for (auto& byte : input)
+                byte = static_cast<uint8_t>(rng());
+            int expected = input.empty() ? 0 : 3 * input[0] & 0xff;
+            wrong += session.Run(input).exitCode != expected;
+        }
+        CHECK(wrong == 0);
+        CHECK(ahead.Running());
+        CHECK(ahead.hits > 0);
+    }
+}
@@ -231,6 +231,39 @@ TEST_SUITE("Decoder"){
             CHECK(instruction->_imm.value() == IMM_SB);
         }
     }
+
+    TEST_CASE("Decode cache"){
+        Decoder cached{4};
+        Decoder uncached{0};
+        for (Word word : {ADD, SRAI, ADD, LW, 0u, ADD, SW, LW})
+        {
+            auto a = cached.Decode(word);
+            auto b = uncached.Decode(word);
+            CHECK(a->_type == b->_type);
+            CHECK(a->_aluFunc == b->_aluFunc);
+            CHECK(a->_dst == b->_dst);
+            CHECK(a->_src1 == b->_src1);
+            CHECK(a->_src2 == b->_src2);
+            CHECK(a->_imm == b->_imm);
+        }
+        CHECK(cached.cacheHits + cached.cacheMisses == 8);
+        CHECK(cached.cacheHits >= 2);
+        CHECK(uncached.CacheEntries() == 0);
+        CHECK(uncached.cacheHits + uncached.cacheMisses == 0);
+
+        // A decoded copy is independent of the cached template
+        auto first = cached.Decode(ADD);
+        first->_dst.reset();
+        CHECK(cached.Decode(ADD)->_dst.value() == 15);
+
+        // Sizes are rounded up to the power of two the memo indexes
+        Decoder odd{1000};
+        CHECK(odd.CacheEntries() == 1024);
+        bool decoded = true;
+        for (Word word = 0; word < 4096; word++)
+            decoded = decoded && odd.Decode(word << 7u | 0x13u)->_type == IType::Alu;
+        CHECK(decoded);
+    }
 }
 
 void testBranch(InstructionPtr &instruction){
@@ -246,6 +246,34 @@ TEST_SUITE("Executor"){
             CHECK(instruction->_nextIp == IP + instruction->_imm.value());
         }
     }
+
+    TEST_CASE("Edge coverage"){
+        EdgeCoverage coverage;
+        Executor exe;
+        exe.SetCoverage(&coverage);
+
+        auto jal = _decoder.Decode(JAL);
+        exe.Execute(jal, IP);
+        exe.Execute(jal, IP);
+        CHECK(coverage.Edges() == 1);
+
+        // BEQ with different operands is not taken and is not an edge
+        auto beq = _decoder.Decode(BEQ);
+        beq->_src1Val = SRCVAL1;
+        beq->_src2Val = SRCVAL2;
+        exe.Execute(beq, IP);
+        CHECK(coverage.Edges() == 1);
+
+        beq->_src2Val = SRCVAL1;
+        exe.Execute(beq, IP);
+        CHECK(coverage.Edges() == 2);
+
+        std::vector<uint8_t> seen;
+        CHECK(coverage.MergeInto(seen));
+        CHECK_FALSE(coverage.MergeInto(seen));
+        coverage.Clear();
+        CHECK(coverage.Edges() == 0);
+    }
 }
 
 void testAlu(InstructionPtr &instruction, Executor &exe){
@@ -0,0 +1,161 @@
+#include "doctest.h"
+
+#include "Cpu.h"
+#include "MicroOps.h"
+#include "TestImages.h"
+
+#include <memory>
+#include <vector>
+
+TEST_SUITE("MicroOps"){
+    TEST_CASE("Passes"){
+        auto mem = std::make_unique<Memory>();
+        StoreCode(*mem, 0x200, {
+            0x12345537,     // lui a0, 0x12345
+            0x67850513,     // addi a0, a0, 0x678
+            0x00001017,     // auipc x0, 1
+            0x01010293,     // addi t0, sp, 16
+            0x0002a303,     // lw t1, 0(t0)
+            0x00130313,     // addi t1, t1, 1
+            0x0062a223,     // sw t1, 4(t0)
+            0x00008067,     // ret
+        });
+        UopBlock block = UopBlock::Lower(*mem, 0x200);
+        CHECK(block.Instructions() == 8);
+        CHECK(block.ops.size() == 8);
+
+        UopPasses::Run(block);
+        REQUIRE(block.ops.size() == 6);
+        const auto& ops = block.ops;
+        // The lui is folded into the constant and its write is dead
+        CHECK(ops[0].kind == UopKind::Const);
+        CHECK(ops[0].dst == 10);
+        CHECK(ops[0].imm == 0x12345678);
+        // t0 stays live at the end of the block, the accesses use sp
+        CHECK(ops[1].kind == UopKind::AluImm);
+        CHECK(ops[2].kind == UopKind::Load);
+        CHECK(ops[2].src1 == 2);
+        CHECK(ops[2].imm == 16);
+        CHECK(ops[4].kind == UopKind::Store);
+        CHECK(ops[4].src1 == 2);
+        CHECK(ops[4].imm == 20);
+        CHECK(ops[5].kind == UopKind::JumpReg);
+    }
+
+    TEST_CASE("Writes to x0"){
+        auto mem = std::make_unique<Memory>();
+        StoreCode(*mem, 0x200, {
+            0x00500013,     // addi x0, x0, 5
+            0x00012003,     // lw x0, 0(sp)
+            0x00008067,     // ret
+        });
+        UopBlock block = UopBlock::Lower(*mem, 0x200);
+        REQUIRE(block.ops.size() == 3);
+        CHECK(block.ops[0].dst == 0);
+        CHECK(block.ops[1].dst == 0);
+        UopPasses::Run(block);
+        REQUIRE(block.ops.size() == 1);
+        CHECK(block.ops[0].kind == UopKind::JumpReg);
+
+        RegisterFile rf;
+        rf.Set(0, 5);
+        CHECK(rf.Get(0) == 0);
+    }
+
+    TEST_CASE("Same state as the Cpu"){
+        std::vector<Word> code = {
+            0x00010137,     // lui sp, 0x10
+            0x00500593,     // li a1, 5
+            0x01010293,     // loop: addi t0, sp, 16
+            0x0002a303,     // lw t1, 0(t0)
+            0x00330313,     // addi t1, t1, 3
+            0x0062a223,     // sw t1, 4(t0)
+            0x00810113,     // addi sp, sp, 8
+            0xfff58593,     // addi a1, a1, -1
+            0xfe0594e3,     // bnez a1, loop
+            0xc0202673,     // csrr a2, instret
+            0xfd9ff06f,     // j 0x200
+        };
+        auto mem = std::make_unique<Memory>();
+        auto referenceMem = std::make_unique<Memory>();
+        StoreCode(*mem, 0x200, code);
+        StoreCode(*referenceMem, 0x200, code);
+
+        UopEngine uops;
+        Cpu cpu{*mem};
+        cpu.SetUopEngine(&uops);
+        cpu.Reset(0x200);
+        Cpu reference{*referenceMem};
+        reference.Reset(0x200);
+
+        size_t mismatches = 0;
+        while (cpu.InstructionsRetired() < 500)
+        {
+            cpu.ProcessInstruction(1000);
+            while (reference.InstructionsRetired() < cpu.InstructionsRetired())
+                reference.ProcessInstruction();
+            mismatches += cpu.Ip() != reference.Ip();
+            for (RId r = 0; r < 32; r++)
+                mismatches += cpu.Registers().Get(r) != reference.Registers().Get(r);
+        }
+        CHECK(mismatches == 0);
+        for (Word addr = 0x10000; addr < 0x10400; addr += 4)
+            mismatches += mem->Request(addr) != referenceMem->Request(addr);
+        CHECK(mismatches == 0);
+        CHECK(uops.executed > 0);
+        CHECK(uops.retired < cpu.InstructionsRetired());
+
+        // Changed code is compiled again
+        mem->Store(0x210, 0x00430313);  // addi t1, t1, 4
+        referenceMem->Store(0x210, 0x00430313);
+        uint64_t end = cpu.InstructionsRetired() + 100;
+        while (cpu.InstructionsRetired() < end)
+        {
+            cpu.ProcessInstruction(1000);
+            while (reference.InstructionsRetired() < cpu.InstructionsRetired())
+                reference.ProcessInstruction();
+            for (RId r = 0; r < 32; r++)
+                mismatches += cpu.Registers().Get(r) != reference.Registers().Get(r);
+        }
+        CHECK(mismatches == 0);
+        // Blocks at 0x200 and at the loop both contain it
+        CHECK(uops.recompiled == 2);
+    }
+
+    TEST_CASE("Coverage of compiled blocks"){
+        std::vector<Word> code = {
+            0x00500593,     // li a1, 5
+            0xfff58593,     // loop: addi a1, a1, -1
+            0xfe059ee3,     // bnez a1, loop
+            0xff5ff06f,     // j 0x200
+        };
+        auto mem = std::make_unique<Memory>();
+        auto referenceMem = std::make_unique<Memory>();
+        StoreCode(*mem, 0x200, code);
+        StoreCode(*referenceMem, 0x200, code);
+
+        EdgeCoverage coverage;
+        EdgeCoverage referenceCoverage;
+        UopEngine uops;
+        Cpu cpu{*mem};
+        cpu.SetUopEngine(&uops);
+        cpu.SetCoverage(&coverage);
+        cpu.Reset(0x200);
+        Cpu reference{*referenceMem};
+        reference.SetCoverage(&referenceCoverage);
+        reference.Reset(0x200);
+
+        while (cpu.InstructionsRetired() < 300)
+        {
+            cpu.ProcessInstruction(1000);
+            while (reference.InstructionsRetired() < cpu.InstructionsRetired())
+                reference.ProcessInstruction();
+        }
+        CHECK(uops.executed > 0);
+        CHECK(coverage.Edges() == 2);
+        size_t mismatches = 0;
+        for (size_t i = 0; i < coverage.Size(); i++)
+            mismatches += coverage.Map()[i] != referenceCoverage.Map()[i];
+        CHECK(mismatches == 0);
+    }
+}
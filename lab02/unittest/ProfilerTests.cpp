@@ -0,0 +1,177 @@
+#include "doctest.h"
+
+#include "Instructions.h"
+#include "BbvProfiler.h"
+#include "CallGraphProfiler.h"
+#include "Decoder.h"
+#include "Profiler.h"
+#include "ShadowStack.h"
+#include "SimPoints.h"
+#include "Symbols.h"
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+TEST_SUITE("Profiler"){
+    TEST_CASE("Disassembly"){
+        CHECK(Disassembler::Disassemble(ADD) == "add a5, ra, gp");
+        CHECK(Disassembler::Disassemble(SRAI) == "srai a5, ra, 3");
+        CHECK(Disassembler::Disassemble(LW) == "lw a5, 3(ra)");
+        CHECK(Disassembler::Disassemble(SW) == "sw a5, 12(a5)");
+        CHECK(Disassembler::Disassemble(BEQ, 0x200) == "beq a5, a5, 0x20c");
+        CHECK(Disassembler::Disassemble(JAL, 0x200) == "jal a5, 0x27a");
+        CHECK(Disassembler::Disassemble(0x00008067) == "ret");
+        CHECK(Disassembler::Disassemble(0xffffffff) == ".word 0xffffffff");
+    }
+
+    TEST_CASE("Counters"){
+        Decoder decoder;
+        Profiler profiler;
+        for (int i = 0; i < 3; i++)
+        {
+            auto instr = decoder.Decode(ADD);
+            profiler.OnRetire(*instr, 0x200, ADD);
+        }
+        auto instr = decoder.Decode(BEQ);
+        profiler.OnRetire(*instr, 0x204, BEQ);
+
+        CHECK(profiler.Total() == 4);
+        CHECK(profiler.Count(0x200) == 3);
+        CHECK(profiler.Count(0x204) == 1);
+        CHECK(profiler.Count(0x208) == 0);
+    }
+
+    TEST_CASE("Symbols"){
+        SymbolTable symbols;
+        symbols.Add(0x200, 0, "_start");
+        symbols.Add(0x300, 0, "label");
+        symbols.Add(0x300, 0, "func", 2);
+        CHECK(symbols.Name(0x200) == "_start");
+        CHECK(symbols.Name(0x210) == "_start+0x10");
+        CHECK(symbols.Name(0x300) == "func");
+        CHECK(symbols.Name(0x100) == "0x100");
+    }
+
+    TEST_CASE("Shadow stack"){
+        Decoder decoder;
+        ShadowStack stack;
+        stack.Reset(0x200);
+
+        // jal ra, +0x100
+        auto call = decoder.Decode(0x100000ef);
+        call->_nextIp = 0x300;
+        CHECK(stack.Update(*call, 0x200) == ShadowStack::Event::Call);
+        REQUIRE(stack.Frames().size() == 2);
+        CHECK(stack.Frames().back().function == 0x300);
+        CHECK(stack.Frames().back().returnIp == 0x204);
+
+        // ret
+        auto ret = decoder.Decode(0x00008067);
+        ret->_nextIp = 0x204;
+        CHECK(stack.Update(*ret, 0x310) == ShadowStack::Event::Return);
+        CHECK(stack.Frames().size() == 1);
+        CHECK(stack.Popped() == 1);
+
+        // unmatched return at the root is ignored
+        CHECK(stack.Update(*ret, 0x210) == ShadowStack::Event::None);
+    }
+
+    TEST_CASE("Call graph"){
+        SymbolTable symbols;
+        symbols.Add(0x200, 0, "main", 2);
+        symbols.Add(0x300, 0, "f", 2);
+        Decoder decoder;
+        CallGraphProfiler callgraph(symbols, 0x200);
+        auto retire = [&](Word ip, Word word, Word nextIp) {
+            auto instr = decoder.Decode(word);
+            instr->_nextIp = nextIp;
+            callgraph.OnRetire(*instr, ip, word);
+        };
+
+        // main calls f, which calls itself once
+        retire(0x200, ADD, 0x204);
+        retire(0x204, 0x100000ef, 0x300);   // jal ra, f
+        retire(0x300, ADD, 0x304);
+        retire(0x304, 0x100000ef, 0x300);   // jal ra, f
+        retire(0x300, ADD, 0x304);
+        retire(0x30c, 0x00008067, 0x308);   // ret
+        retire(0x308, ADD, 0x30c);
+        retire(0x30c, 0x00008067, 0x208);   // ret
+        retire(0x208, ADD, 0x20c);
+
+        std::ostringstream report;
+        callgraph.Report(report, 10);
+        std::istringstream lines(report.str());
+        std::string line;
+        std::getline(lines, line);
+        CHECK(line == "callgraph: 9 instructions, 2 call edges");
+        std::getline(lines, line);
+        std::map<std::string, std::vector<uint64_t>> rows;
+        uint64_t inclusive, self, calls;
+        std::string name;
+        while (lines >> inclusive >> self >> calls >> name)
+            rows[name] = {inclusive, self, calls};
+        CHECK(rows["main"] == std::vector<uint64_t>{9, 3, 0});
+        // The recursive activation is part of the outermost one
+        CHECK(rows["f"] == std::vector<uint64_t>{6, 6, 2});
+
+        std::ostringstream out;
+        callgraph.WriteCallgrind(out, "program");
+        std::string callgrind = out.str();
+        CHECK(callgrind.find("summary: 9\n") != std::string::npos);
+        CHECK(callgrind.find("fn=main\n0x200 1\n0x204 1\n0x208 1\ncfn=f\ncalls=1 0x300\n0x204 6\n")
+              != std::string::npos);
+        CHECK(callgrind.find("fn=f\n0x300 2\n0x304 1\n0x308 1\n0x30c 2\ncfn=f\ncalls=1 0x300\n0x304 2\n")
+              != std::string::npos);
+    }
+
+    TEST_CASE("Basic-block vectors"){
+        Decoder decoder;
+        auto add = decoder.Decode(ADD);
+        auto beq = decoder.Decode(BEQ);
+        BbvProfiler bbv(5);
+
+        // Block 0x200: add, add, beq; block 0x300: add, beq
+        for (int i = 0; i < 3; i++)
+        {
+            bbv.OnRetire(*add, 0x200, ADD);
+            bbv.OnRetire(*add, 0x204, ADD);
+            bbv.OnRetire(*beq, 0x208, BEQ);
+            bbv.OnRetire(*add, 0x300, ADD);
+            bbv.OnRetire(*beq, 0x304, BEQ);
+        }
+        bbv.OnRetire(*add, 0x200, ADD);
+        bbv.Finish();
+
+        CHECK(bbv.BlockCount() == 2);
+        CHECK(bbv.BlockIp(0) == 0x200);
+        CHECK(bbv.BlockIp(1) == 0x300);
+        REQUIRE(bbv.Intervals().size() == 4);
+        CHECK(bbv.Intervals()[0] == BbvProfiler::Vector{{0, 3}, {1, 2}});
+        CHECK(bbv.Intervals()[3] == BbvProfiler::Vector{{0, 1}});
+        CHECK(bbv.Lengths()[3] == 1);
+
+        std::ostringstream out;
+        bbv.WriteBbv(out);
+        CHECK(out.str().substr(0, 14) == "T:1:3 :2:2 \nT:");
+    }
+
+    TEST_CASE("SimPoints"){
+        // Two phases with disjoint blocks, the first three times longer
+        std::vector<BbvProfiler::Vector> intervals;
+        for (uint64_t i = 0; i < 30; i++)
+            intervals.push_back({{0, 60 + i % 3}, {1, 40 - i % 3}});
+        for (uint64_t i = 0; i < 10; i++)
+            intervals.push_back({{2, 90 + i % 2}, {3, 10 - i % 2}});
+        std::vector<uint64_t> lengths(intervals.size(), 100);
+
+        auto simpoints = SimPoints::Select(intervals, lengths, 5);
+        REQUIRE(simpoints.size() == 2);
+        CHECK(simpoints[0].interval < 30);
+        CHECK(simpoints[1].interval >= 30);
+        CHECK(simpoints[0].weight == doctest::Approx(0.75));
+        CHECK(simpoints[1].weight == doctest::Approx(0.25));
+    }
+}
@@ -0,0 +1,105 @@
+#include "doctest.h"
+
+#include "Scheduler.h"
+#include "TestImages.h"
+
+#include <memory>
+#include <vector>
+
+TEST_SUITE("Scheduler"){
+    TEST_CASE("Round robin"){
+        auto image = MakeImage({
+            0x3e800513,     // li a0, 1000
+            0xfff50513,     // loop: addi a0, a0, -1
+            0xfe051ee3,     // bnez a0, loop
+            0x000102b7,     // lui t0, 0x10 (PrintChar)
+            0x04128293,     // addi t0, t0, 'A'
+            0x78029073,     // csrw mtohost, t0
+            0x78001073,     // csrw mtohost, x0 (exit 0)
+        });
+        Scheduler scheduler(100);
+        for (int i = 0; i < 50; i++)
+            scheduler.Spawn(std::make_unique<SimTask>(*image, 0x200));
+        CHECK(scheduler.Run() == 0);
+
+        for (size_t id = 0; id < scheduler.Tasks(); id++)
+        {
+            CAPTURE(id);
+            SimTask& task = scheduler.Task(id);
+            CHECK(task.GetState() == SimTask::State::Exited);
+            CHECK(task.ExitCode() == 0);
+            CHECK(task.Output() == "A");
+            CHECK(task.GetCpu().InstructionsRetired() == 1 + 2 * 1000 + 4);
+        }
+        // Every task is suspended about 20 times by the quantum
+        CHECK(scheduler.switches > 50 * 20);
+        CHECK(scheduler.messages == 50 * 2);
+    }
+
+    TEST_CASE("Tasks wait for their input"){
+        auto image = MakeImage({
+            0x00001537,     // lui a0, 0x1
+            0x01000593,     // li a1, 16
+            0x000802b7,     // lui t0, 0x80 (FuzzInput)
+            0x78029073,     // csrw mtohost, t0
+            0x00052303,     // lw t1, 0(a0)
+            0x0ff37313,     // andi t1, t1, 0xff
+            0x78031073,     // csrw mtohost, t1 (ExitCode)
+        });
+        Scheduler scheduler;
+        std::vector<Scheduler::TaskId> waiting;
+        scheduler.SetHandler([&](Scheduler::TaskId id, SimTask&, CpuToHostData msg) {
+            CHECK(msg.unpacked.type == CpuToHostType::FuzzInput);
+            waiting.push_back(id);
+            return false;
+        });
+        for (int i = 0; i < 100; i++)
+            scheduler.Spawn(std::make_unique<SimTask>(*image, 0x200));
+        CHECK(scheduler.Run() == 100);
+        REQUIRE(waiting.size() == 100);
+
+        // Inputs arrive in reverse order
+        for (auto it = waiting.rbegin(); it != waiting.rend(); ++it)
+        {
+            SimTask& task = scheduler.Task(*it);
+            uint8_t input = static_cast<uint8_t>(*it);
+            task.GetMemory().StoreBytes(task.GetCpu().Registers().Get(10), &input, 1);
+            task.GetCpu().Registers().Set(11, 1);
+            scheduler.Wake(*it);
+        }
+        CHECK(scheduler.Run() == 0);
+        for (size_t id = 0; id < scheduler.Tasks(); id++)
+            CHECK(scheduler.Task(id).ExitCode() == static_cast<int>(id));
+    }
+
+    TEST_CASE("Handler wakes the task itself"){
+        auto image = MakeImage({
+            0x00001537,     // lui a0, 0x1
+            0x01000593,     // li a1, 16
+            0x000802b7,     // lui t0, 0x80 (FuzzInput)
+            0x78029073,     // csrw mtohost, t0
+            0x00052303,     // lw t1, 0(a0)
+            0x0ff37313,     // andi t1, t1, 0xff
+            0x78031073,     // csrw mtohost, t1 (ExitCode)
+        });
+        Scheduler scheduler;
+        scheduler.SetHandler([&](Scheduler::TaskId id, SimTask& task, CpuToHostData) {
+            uint8_t input = static_cast<uint8_t>(id + 1);
+            task.GetMemory().StoreBytes(task.GetCpu().Registers().Get(10), &input, 1);
+            task.GetCpu().Registers().Set(11, 1);
+            scheduler.Wake(id);
+            // Odd tasks also ask to go on; either way they run exactly once more
+            return id % 2 == 1;
+        });
+        for (int i = 0; i < 10; i++)
+            scheduler.Spawn(std::make_unique<SimTask>(*image, 0x200));
+        CHECK(scheduler.Run() == 0);
+        for (size_t id = 0; id < scheduler.Tasks(); id++)
+        {
+            CAPTURE(id);
+            CHECK(scheduler.Task(id).GetState() == SimTask::State::Exited);
+            CHECK(scheduler.Task(id).ExitCode() == static_cast<int>(id + 1));
+        }
+        CHECK(scheduler.switches == 10 * 2);
+    }
+}
@@ -0,0 +1,217 @@
+#include "doctest.h"
+
+#include "Checkpoint.h"
+#include "Fuzzer.h"
+#include "Simulation.h"
+#include "TestImages.h"
+#include "TimeParallel.h"
+
+#include <cstdio>
+#include <vector>
+
+// x5 = payload; csrw mtohost, x5
+static void ToHost(std::vector<Word>& code, Word payload)
+{
+    code.push_back((payload & 0xfffff000u) | (5u << 7u) | 0x37u);
+    code.push_back(((payload & 0x7ffu) << 20u) | (5u << 15u) | (5u << 7u) | 0x13u);
+    code.push_back((0x780u << 20u) | (5u << 15u) | (1u << 12u) | 0x73u);
+}
+
+// addi x6, x6, 1
+static void Work(std::vector<Word>& code, int count)
+{
+    for (int i = 0; i < count; i++)
+        code.push_back((1u << 20u) | (6u << 15u) | (6u << 7u) | 0x13u);
+}
+
+// Counts the instructions it is notified about
+struct RetireCounter : RetireListener
+{
+    uint64_t count = 0;
+
+    void OnRetire(const Instruction&, Word, Word) override
+    {
+        count++;
+    }
+};
+
+TEST_SUITE("Simulation"){
+    TEST_CASE("ROI and phases"){
+        std::vector<Word> code;
+        Work(code, 3);
+        ToHost(code, 0x40000);      // RoiBegin
+        Work(code, 4);
+        ToHost(code, 0x60001);      // Phase 1
+        Work(code, 5);
+        ToHost(code, 0x50000);      // RoiEnd
+        Work(code, 6);
+        ToHost(code, 0);            // ExitCode 0
+
+        Memory mem;
+        StoreCode(mem, 0x200, code);
+        Cpu cpu{mem};
+        cpu.Reset(0x200);
+
+        RetireCounter counter;
+        Simulation sim{cpu};
+        sim.AddInstrument(&counter);
+        sim.SetRoiMode(true);
+        CHECK(sim.CurrentEngine() == Simulation::Engine::Fast);
+
+        CHECK(sim.Run() == 0);
+        CHECK(sim.CurrentEngine() == Simulation::Engine::Fast);
+
+        // Instruments see everything after the csrw opening the region, up to
+        // and including the one closing it
+        CHECK(counter.count == 4 + 3 + 5 + 3);
+
+        REQUIRE(sim.Phases().size() == 2);
+        CHECK(sim.Phases()[0].name == "roi");
+        CHECK(sim.Phases()[0].instructions == 4 + 3);
+        CHECK(sim.Phases()[1].name == "phase1");
+        CHECK(sim.Phases()[1].instructions == 5 + 3);
+    }
+
+    TEST_CASE("Without ROI mode instruments see everything"){
+        std::vector<Word> code;
+        Work(code, 2);
+        ToHost(code, 0x40000);
+        ToHost(code, 0x50000);
+        ToHost(code, 0);
+
+        Memory mem;
+        StoreCode(mem, 0x200, code);
+        Cpu cpu{mem};
+        cpu.Reset(0x200);
+
+        RetireCounter counter;
+        Simulation sim{cpu};
+        sim.AddInstrument(&counter);
+
+        CHECK(sim.Run() == 0);
+        CHECK(counter.count == code.size());
+        REQUIRE(sim.Phases().size() == 1);
+        CHECK(sim.Phases()[0].entries == 1);
+    }
+
+    TEST_CASE("Functional Cpu configuration"){
+        std::vector<Word> code = {
+            0x0c800393,     // li t2, 200
+            0x00130313,     // loop: addi t1, t1, 1
+            0xfff38393,     // addi t2, t2, -1
+            0xfe039ce3,     // bnez t2, loop
+        };
+        ToHost(code, 0);
+
+        Memory mem;
+        StoreCode(mem, 0x200, code);
+        BasicCpu<FunctionalCpuConfig> cpu{mem};
+        cpu.Reset(0x200);
+        while (!cpu.GetMessage())
+            cpu.ProcessInstruction();
+
+        CHECK(cpu.Registers().Get(6) == 200);
+        CHECK(cpu.InstructionsRetired() == 1 + 3 * 200 + 3);
+        CHECK(cpu.Csrs().SaveCounters().cycles == cpu.InstructionsRetired());
+    }
+
+    TEST_CASE("Checkpoint round trip"){
+        const char* filename = "simulation_tests.ckpt";
+        std::vector<Word> code;
+        Work(code, 7);
+        ToHost(code, 0);
+
+        Memory mem;
+        StoreCode(mem, 0x200, code);
+        mem.Store(0x10000, 0x12345678);
+        Cpu cpu{mem};
+        cpu.Reset(0x200);
+        for (int i = 0; i < 3; i++)
+            cpu.ProcessInstruction();
+        REQUIRE(Checkpoint::Save(filename, cpu, mem));
+
+        // The target has a page of its own that must be cleared
+        Memory restoredMem;
+        restoredMem.Store(0x20000, 0xdeadbeef);
+        Cpu restored{restoredMem};
+        Checkpoint checkpoint;
+        REQUIRE(checkpoint.Open(filename));
+        CHECK(checkpoint.PageCount() == 2);
+        checkpoint.Restore(restored, restoredMem);
+
+        CHECK(restored.Ip() == 0x20c);
+        CHECK(restored.InstructionsRetired() == 3);
+        CHECK(restored.Registers().Get(6) == 3);
+        CHECK(restoredMem.Request(0x10000) == 0x12345678);
+        CHECK(restoredMem.Request(0x20000) == 0);
+        CHECK_FALSE(restoredMem.PageDirty(0x20000 / Memory::pageBytes));
+
+        Simulation sim{restored};
+        CHECK(sim.Run() == 0);
+        CHECK(restored.Registers().Get(6) == 7);
+        std::remove(filename);
+    }
+
+    TEST_CASE("Time-parallel run matches a sequential one"){
+        std::vector<Word> code = {
+            0x0c800393,     // li t2, 200
+            0x00130313,     // loop: addi t1, t1, 1
+            0xfff38393,     // addi t2, t2, -1
+            0xfe039ce3,     // bnez t2, loop
+        };
+        ToHost(code, 0);
+
+        Memory mem;
+        StoreCode(mem, 0x200, code);
+        Cpu cpu{mem};
+        cpu.Reset(0x200);
+        TimingModel sequential;
+        Simulation sim{cpu};
+        sim.SetQuiet(true);
+        sim.AddInstrument(&sequential);
+        CHECK(sim.Run() == 0);
+
+        Memory parallelMem;
+        StoreCode(parallelMem, 0x200, code);
+        Cpu parallelCpu{parallelMem};
+        parallelCpu.Reset(0x200);
+        TimeParallelRun run(TimingConfig(), 100, 50, 3);
+        CHECK(run.Run(parallelCpu, parallelMem) == 0);
+
+        CHECK(run.Intervals().size() == 7);
+        CHECK(run.Total().instructions == sequential.instructions);
+        CHECK(run.Total().cycles == sequential.cycles);
+        CHECK(parallelCpu.Registers().Get(6) == 200);
+    }
+
+    TEST_CASE("Fuzzing resets only dirty pages"){
+        std::vector<Word> code;
+        Work(code, 3);              // setup, runs once
+        code.push_back(0x00010537); // lui a0, 0x10
+        code.push_back(0x01000593); // li a1, 16
+        ToHost(code, 0x80000);      // FuzzInput
+        code.push_back(0x00052283); // lw t0, 0(a0)
+        code.push_back(0x0ff2f293); // andi t0, t0, 0xff
+        code.push_back(0x10552023); // sw t0, 0x100(a0)
+        code.push_back(0x78029073); // csrw mtohost, t0: exit code = first input byte
+
+        Memory mem;
+        StoreCode(mem, 0x200, code);
+        Cpu cpu{mem};
+        cpu.Reset(0x200);
+        FuzzSession session(cpu, mem, 1000);
+
+        auto first = session.Run({5, 1, 2});
+        CHECK(first.consumedInput);
+        CHECK(first.exitCode == 5);
+        CHECK(session.Run({0}).exitCode == 0);
+        CHECK(session.Run({7}).exitCode == 7);
+        CHECK(session.Run({}).exitCode == 0);
+
+        // Only the input page is written after the snapshot
+        CHECK(session.pagesReset == 3);
+        CHECK(session.runs == 4);
+        CHECK(session.exitCodes[0] == 2);
+        CHECK(cpu.Registers().Get(6) == 3);
+    }
+}
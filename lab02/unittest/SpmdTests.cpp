@@ -0,0 +1,80 @@
+#include "doctest.h"
+
+#include "Cpu.h"
+#include "SpmdEngine.h"
+#include "TestImages.h"
+
+#include <memory>
+#include <vector>
+
+TEST_SUITE("SpmdEngine"){
+    TEST_CASE("Divergent lanes match the Cpu"){
+        auto image = MakeImage({
+            0x00000593,     // li a1, 0
+            0x00a585b3,     // loop: add a1, a1, a0
+            0xfff50513,     // addi a0, a0, -1
+            0xfe051ce3,     // bnez a0, loop
+            0x00359613,     // slli a2, a1, 3
+            0x10c02023,     // sw a2, 0x100(x0)
+            0x10002683,     // lw a3, 0x100(x0)
+            0x008000ef,     // jal ra, 0x224
+            0x0000006f,     // j 0x220
+            0x00b6b733,     // sltu a4, a3, a1
+            0x00008067,     // ret
+        });
+        constexpr uint64_t limit = 80;
+        SpmdEngine spmd(*image, 0x200);
+        for (size_t l = 0; l < SpmdEngine::lanes; l++)
+            spmd.Set(l, 10, static_cast<Word>(l + 1));
+        spmd.Run(limit);
+
+        size_t mismatches = 0;
+        for (size_t l = 0; l < SpmdEngine::lanes; l++)
+        {
+            Memory mem = *image;
+            Cpu cpu{mem};
+            cpu.Reset(0x200);
+            cpu.Registers().Set(10, static_cast<Word>(l + 1));
+            for (uint64_t i = 0; i < limit; i++)
+                cpu.ProcessInstruction();
+
+            CAPTURE(l);
+            mismatches += spmd.Ip(l) != cpu.Ip();
+            mismatches += spmd.Csrs(l).InstructionsRetired() != limit;
+            mismatches += spmd.LaneMemory(l).Request(0x100) != mem.Request(0x100);
+            for (RId r = 0; r < 32; r++)
+                mismatches += spmd.Get(l, r) != cpu.Registers().Get(r);
+        }
+        CHECK(mismatches == 0);
+        CHECK(spmd.Get(7, 12) == 36 * 8);
+        CHECK(spmd.divergentBranches > 0);
+        CHECK(spmd.Utilization() < 1.0);
+        CHECK(spmd.laneSteps == SpmdEngine::lanes * limit);
+    }
+
+    TEST_CASE("Inputs and exit codes"){
+        auto image = MakeImage({
+            0x00001537,     // lui a0, 0x1
+            0x01000593,     // li a1, 16
+            0x000802b7,     // lui t0, 0x80 (FuzzInput)
+            0x78029073,     // csrw mtohost, t0
+            0x00052303,     // lw t1, 0(a0)
+            0x0ff37313,     // andi t1, t1, 0xff
+            0x78031073,     // csrw mtohost, t1 (ExitCode)
+        });
+        SpmdEngine spmd(*image, 0x200, 5);
+        for (size_t l = 0; l < spmd.Active(); l++)
+            spmd.SetInput(l, {static_cast<uint8_t>(3 * l), 0xff});
+        spmd.Run(1000);
+
+        for (size_t l = 0; l < spmd.Active(); l++)
+        {
+            CAPTURE(l);
+            CHECK(spmd.Result(l).consumedInput);
+            CHECK(spmd.Result(l).exitCode == static_cast<int>(3 * l));
+            CHECK(spmd.Get(l, 11) == 2);
+        }
+        CHECK(spmd.divergentBranches == 0);
+        CHECK(spmd.steps == 7);
+    }
+}
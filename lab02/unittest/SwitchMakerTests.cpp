@@ -0,0 +1,131 @@
+#include "doctest.h"
+
+#include "Instruction.h"
+#include "SwitchMaker.h"
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+template<typename Key>
+class NamedCase
+{
+public:
+    NamedCase(Key key, std::string name)
+        : key(key), name(std::move(name))
+    {
+    }
+
+    Key GetSwitchType()
+    {
+        return key;
+    }
+
+    std::string operator()(int value)
+    {
+        return name + std::to_string(value);
+    }
+
+private:
+    Key key;
+    std::string name;
+};
+
+// Key type whose std::hash maps every value to one result
+struct Colliding
+{
+    int value;
+
+    bool operator==(const Colliding& other) const
+    {
+        return value == other.value;
+    }
+};
+
+template<>
+struct std::hash<Colliding>
+{
+    size_t operator()(const Colliding&) const
+    {
+        return 42;
+    }
+};
+
+template<typename Key>
+static std::unique_ptr<NamedCase<Key>> Case(Key key, const std::string& name)
+{
+    return std::make_unique<NamedCase<Key>>(key, name);
+}
+
+TEST_SUITE("SwitchMaker"){
+    TEST_CASE("Dense enum keys"){
+        SwitchMaker<Opcode, std::unique_ptr<NamedCase<Opcode>>> sMaker;
+        sMaker.AddCompare(Case(Opcode::Load, "load"));
+        sMaker.AddCompare(Case(Opcode::Store, "store"));
+        CHECK_THROWS_AS(sMaker.DoOperation(Opcode::Op, 1), std::invalid_argument);
+
+        sMaker.AddDefault(Case(Opcode::System, "default"));
+        CHECK(sMaker.DoOperation(Opcode::Load, 1) == "load1");
+        CHECK(sMaker.DoOperation(Opcode::Store, 2) == "store2");
+        CHECK(sMaker.DoOperation(Opcode::Op, 3) == "default3");
+
+        sMaker.DeleteCompare(Opcode::Load);
+        CHECK(sMaker.DoOperation(Opcode::Load, 4) == "default4");
+        CHECK_THROWS_AS(sMaker.GetCompare(Opcode::Load), std::out_of_range);
+    }
+
+    TEST_CASE("Hashed keys"){
+        SwitchMaker<uint32_t, std::unique_ptr<NamedCase<uint32_t>>> sMaker;
+        for (uint32_t key = 0; key < 40; key++)
+            sMaker.AddCompare(Case(key * 0x1000u + 7u, "k" + std::to_string(key) + "_"));
+        sMaker.AddDefault(Case(0u, "default"));
+
+        for (uint32_t key = 0; key < 40; key++)
+            CHECK(sMaker.DoOperation(key * 0x1000u + 7u, 0) == "k" + std::to_string(key) + "_0");
+        CHECK(sMaker.DoOperation(8u, 1) == "default1");
+
+        sMaker.AddCompare(Case(7u, "replaced"));
+        sMaker.DeleteCompare(0x1007u);
+        CHECK(sMaker.DoOperation(7u, 2) == "replaced2");
+        CHECK(sMaker.DoOperation(0x1007u, 3) == "default3");
+        CHECK(sMaker.DoOperation(0x2007u, 4) == "k2_4");
+    }
+
+    TEST_CASE("Colliding hashes"){
+        SwitchMaker<Colliding, std::unique_ptr<NamedCase<Colliding>>> sMaker;
+        for (int value = 0; value < 20; value++)
+            sMaker.AddCompare(Case(Colliding{value}, "c" + std::to_string(value) + "_"));
+        sMaker.AddDefault(Case(Colliding{-1}, "default"));
+
+        sMaker.DeleteCompare(Colliding{3});
+        for (int value = 0; value < 20; value++)
+            CHECK(sMaker.DoOperation(Colliding{value}, 0) == (value == 3 ? "default0" : "c" + std::to_string(value) + "_0"));
+        CHECK_THROWS_AS(sMaker.GetCompare(Colliding{3}), std::out_of_range);
+    }
+
+    TEST_CASE("Thousands of scattered keys"){
+        SwitchMaker<uint32_t, std::unique_ptr<NamedCase<uint32_t>>> sMaker;
+        std::vector<uint32_t> keys;
+        uint32_t state = 12345;
+        std::set<uint32_t> seen;
+        while (keys.size() < 4000)
+        {
+            state = state * 1664525u + 1013904223u;
+            if (seen.insert(state).second)
+                keys.push_back(state);
+        }
+        for (size_t i = 0; i < keys.size(); i++)
+            sMaker.AddCompare(Case(keys[i], std::to_string(i) + "_"));
+        sMaker.AddDefault(Case(0u, "default"));
+
+        // Delete every third key; the rest must still be reachable
+        for (size_t i = 0; i < keys.size(); i += 3)
+            sMaker.DeleteCompare(keys[i]);
+        size_t wrong = 0;
+        for (size_t i = 0; i < keys.size(); i++)
+            if (sMaker.DoOperation(keys[i], 1) != (i % 3 == 0 ? std::string("default1") : std::to_string(i) + "_1"))
+                wrong++;
+        CHECK(wrong == 0);
+    }
+}
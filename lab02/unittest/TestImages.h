@@ -0,0 +1,24 @@
+#ifndef RISCV_SIM_TESTIMAGES_H
+#define RISCV_SIM_TESTIMAGES_H
+
+#include "Memory.h"
+
+#include <memory>
+#include <vector>
+
+// Stores code word by word starting at addr
+inline void StoreCode(Memory& mem, Word addr, const std::vector<Word>& code)
+{
+    for (size_t i = 0; i < code.size(); i++)
+        mem.Store(addr + 4 * static_cast<Word>(i), code[i]);
+}
+
+// Fresh memory with code at the usual entry point 0x200
+inline std::unique_ptr<Memory> MakeImage(const std::vector<Word>& code)
+{
+    auto mem = std::make_unique<Memory>();
+    StoreCode(*mem, 0x200, code);
+    return mem;
+}
+
+#endif //RISCV_SIM_TESTIMAGES_H
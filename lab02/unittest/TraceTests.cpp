@@ -0,0 +1,125 @@
+#include "doctest.h"
+
+#include "Instructions.h"
+#include "Replay.h"
+#include "SampledTiming.h"
+#include "Trace.h"
+
+#include <cstdio>
+
+TEST_SUITE("Trace"){
+    TEST_CASE("Round trip"){
+        const char* filename = "trace_tests.trace";
+        std::vector<TraceRecord> written;
+        for (Word i = 0; i < 100; i++)
+        {
+            Word ip = 0x200 + 4 * i;
+            Word nextIp = i % 10 == 9 ? ip - 36 : ip + 4;
+            Word addr = i % 3 == 0 ? 0x4000 + 8 * i : 0;
+            written.push_back(TraceRecord{ip, i % 2 ? LW : BEQ, nextIp, addr});
+        }
+
+        {
+            TraceWriter writer(7);
+            REQUIRE(writer.Open(filename));
+            for (const auto& record : written)
+                writer.Add(record, record.addr != 0);
+        }
+
+        TraceReader reader;
+        REQUIRE(reader.Open(filename));
+        CHECK(reader.RecordCount() == written.size());
+        CHECK(reader.BlockCount() == (written.size() + 6) / 7);
+
+        std::vector<std::vector<TraceRecord>> blocks(reader.BlockCount());
+        reader.DecodeBlocks(0, blocks, 4);
+
+        size_t idx = 0;
+        for (const auto& block : blocks)
+        {
+            for (const auto& record : block)
+            {
+                CHECK(record.ip == written[idx].ip);
+                CHECK(record.word == written[idx].word);
+                CHECK(record.nextIp == written[idx].nextIp);
+                CHECK(record.addr == written[idx].addr);
+                idx++;
+            }
+        }
+        CHECK(idx == written.size());
+        std::remove(filename);
+    }
+
+    TEST_CASE("Replay events"){
+        std::vector<TraceRecord> records = {
+            {0x200, LW, 0x204, 0x1000},
+            {0x204, ADD, 0x208, 0},
+            {0x208, JALR, 0x7a, 0},
+        };
+        std::vector<TimingEvent> events;
+        ReplayEngine::ToEvents(records, events);
+
+        REQUIRE(events.size() == 3);
+        CHECK(events[0].type == IType::Ld);
+        CHECK(events[0].addr == 0x1000);
+        CHECK(events[0].dst == 15);
+        CHECK(events[1].src2 == 3);
+        CHECK(events[2].type == IType::Jr);
+        CHECK(events[2].IsTaken());
+
+        TimingModel model;
+        for (const auto& event : events)
+            model.Process(event);
+        CHECK(model.instructions == 3);
+        CHECK(model.cycles > 3);
+    }
+
+    TEST_CASE("Timing config"){
+        TimingConfig config = TimingConfig::Parse("icache.size=8K icache.ways=2 dcache.line=0x40 bpred.bht=1024");
+        CHECK(config.icache.sizeBytes == 8192);
+        CHECK(config.icache.ways == 2);
+        CHECK(config.dcache.lineBytes == 64);
+        CHECK(config.bpred.bhtEntries == 1024);
+
+        for (const char* bad : {"icache.ways=0", "dcache.line=0", "dcache.ways=3", "icache.line=48",
+                                "icache.size=8KB", "icache.size=", "bpred.bht=abc", "icache.size=-1", "ways"})
+        {
+            CAPTURE(bad);
+            CHECK_THROWS_AS(TimingConfig::Parse(bad), std::invalid_argument);
+        }
+    }
+
+    TEST_CASE("Sampled timing"){
+        // A loop of 16 instructions whose loads walk a 64 KiB buffer
+        std::vector<TimingEvent> loop;
+        for (Word i = 0; i < 16; i++)
+        {
+            TimingEvent event{0x200 + 4 * i, 0x204 + 4 * i, 0, IType::Alu, 5, 6, 0};
+            if (i % 4 == 1)
+                event.type = IType::Ld;
+            if (i == 15)
+                event = TimingEvent{0x23c, 0x200, 0, IType::Br, 0, 5, 6};
+            loop.push_back(event);
+        }
+
+        TimingModel full;
+        TimingModel model;
+        SampledTiming sampled(model, SamplingConfig{100, 200, 20});
+        for (Word iter = 0; iter < 20000; iter++)
+        {
+            for (auto event : loop)
+            {
+                event.addr = event.type == IType::Ld ? 0x10000 + (iter * 52 + event.ip) % 0x10000 : 0;
+                full.Process(event);
+                sampled.Process(event);
+            }
+        }
+
+        double cpi = double(full.cycles) / full.instructions;
+        CHECK(sampled.total == full.instructions);
+        CHECK(sampled.Samples() == full.instructions / 2000);
+        CHECK(model.instructions == sampled.Samples() * 300);
+        CHECK(sampled.Interval() > 0);
+        CHECK(std::abs(sampled.Cpi() - cpi) <= sampled.Interval());
+    }
+}